@@ -0,0 +1,183 @@
+//
+//  BlockDictionary.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "BlockDictionary.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kBlockDictionaryEmpty		(UINT32_MAX)
+#define kBlockDictionaryMinCapacity	(1024)
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static inline uint64_t hashBlock(VMAddr entry, VMAddr branch, uint32_t type);
+static bool grow(BlockDictionary* self);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool BlockDictionary_create(BlockDictionary* self, uint32_t capacity) {
+	bool retVal = false;
+	if (self == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		// round up to a power of 2 so we can mask rather than mod
+		uint32_t size = kBlockDictionaryMinCapacity;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		
+		self->entries = malloc(size * sizeof(BlockDictionaryEntry));
+		if (self->entries == NULL) {
+			Log_error("malloc");
+			
+		} else {
+			self->capacity = size;
+			BlockDictionary_reset(self);
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+bool BlockDictionary_lookup(BlockDictionary* self, Block* block, uint32_t* id, bool* added) {
+	bool retVal = false;
+	if (self == NULL || self->entries == NULL || block == NULL || id == NULL || added == NULL) {
+		Log_invalidArgument("self: %p, block: %p, id: %p, added: %p", self, block, id, added);
+		
+	} else if ((self->count + 1) * 2 > self->capacity && grow(self) == false) {
+		// keep the load factor under 50% so probe sequences stay short; grow's logged why it couldn't
+		
+	} else {
+		uint32_t mask = self->capacity - 1;
+		uint32_t i = (uint32_t) hashBlock(block->entry, block->branch, block->type) & mask;
+		while (1) {
+			BlockDictionaryEntry* e = &self->entries[i];
+			if (e->id == kBlockDictionaryEmpty) {
+				e->entry = block->entry;
+				e->branch = block->branch;
+				e->type = block->type;
+				e->id = self->count++;
+				*id = e->id;
+				*added = true;
+				break;
+				
+			} else if (	   e->entry == block->entry
+						&& e->branch == block->branch
+						&& e->type == (uint32_t) block->type) {
+				*id = e->id;
+				*added = false;
+				break;
+			}
+			i = (i + 1) & mask;
+		}
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+void BlockDictionary_reset(BlockDictionary* self) {
+	if (self && self->entries) {
+		// setting every byte to 0xFF marks every id as kBlockDictionaryEmpty
+		(void) memset(self->entries, 0xFF, self->capacity * sizeof(BlockDictionaryEntry));
+		self->count = 0;
+	}
+}
+
+
+void BlockDictionary_release(BlockDictionary* self) {
+	if (self) {
+		free(self->entries);
+		self->entries = NULL;
+		self->capacity = 0;
+		self->count = 0;
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static inline uint64_t hashBlock(VMAddr entry, VMAddr branch, uint32_t type) {
+	// entry alone is nearly unique; mix in the rest so the rare collisions still spread
+	uint64_t h = entry * 0x9E3779B97F4A7C15ull;
+	h ^= (branch - entry) + ((uint64_t) type << 56);
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ull;
+	h ^= h >> 32;
+	return h;
+}
+
+
+static bool grow(BlockDictionary* self) {
+	bool retVal = false;
+	uint32_t capacity = self->capacity * 2;
+	BlockDictionaryEntry* entries = malloc(capacity * sizeof(BlockDictionaryEntry));
+	if (entries == NULL) {
+		Log_error("malloc");
+		
+	} else {
+		(void) memset(entries, 0xFF, capacity * sizeof(BlockDictionaryEntry));
+		
+		// re-insert everything; ids are preserved so nothing already written changes
+		uint32_t mask = capacity - 1;
+		for (uint32_t i = 0; i < self->capacity; i++) {
+			BlockDictionaryEntry* e = &self->entries[i];
+			if (e->id != kBlockDictionaryEmpty) {
+				uint32_t j = (uint32_t) hashBlock(e->entry, e->branch, e->type) & mask;
+				while (entries[j].id != kBlockDictionaryEmpty) {
+					j = (j + 1) & mask;
+				}
+				entries[j] = *e;
+			}
+		}
+		free(self->entries);
+		self->entries = entries;
+		self->capacity = capacity;
+		retVal = true;
+	}
+	return retVal;
+}
@@ -0,0 +1,74 @@
+//
+//  BlockDictionary.h
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_BlockDictionary_h
+#define Flow_BlockDictionary_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "Task.h"
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sBlockDictionaryEntry {
+	VMAddr		entry;
+	VMAddr		branch;
+	uint32_t	type;
+	uint32_t	id;			// UINT32_MAX if the slot is unused
+} BlockDictionaryEntry;
+
+
+/*
+ * An open addressing hash table mapping (entry, branch, type) to a block id.  Ids
+ * are handed out sequentially from 0 in the order blocks are first seen; which is
+ * exactly the order a reader sees the definition records, so the id itself never
+ * needs to be written out.
+ */
+typedef struct sBlockDictionary {
+	BlockDictionaryEntry*	entries;
+	uint32_t				capacity;	// always a power of 2
+	uint32_t				count;
+} BlockDictionary;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool BlockDictionary_create(BlockDictionary* self, uint32_t capacity);
+bool BlockDictionary_lookup(BlockDictionary* self, Block* block, uint32_t* id, bool* added);
+void BlockDictionary_reset(BlockDictionary* self);
+void BlockDictionary_release(BlockDictionary* self);
+
+
+#endif
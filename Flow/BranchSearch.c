@@ -0,0 +1,105 @@
+//
+//  BranchSearch.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdio.h>
+
+#include "BranchSearch.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Exported function implementations
+ */
+
+/*
+ * This is the guts of findNextBranch; split out from the TaskArch's so it works on any 
+ * buffer of code - not just what we've read out of the task.  FlowCalls.py rebuilds 
+ * blocks from branch format logs with its own distorm3 copy of this (TraceCode's 
+ * findNextBranch); it has to find exactly the same branches we did when tracing, so 
+ * change both together.
+ */
+bool BranchSearch_findNextBranch(const uint8_t* code, 
+								 uint64_t length, 
+								 VMAddr pc, 
+								 _DecodeType dt, 
+								 Block* block) {
+	bool retVal = false;
+	if (code == NULL || block == NULL) {
+		Log_invalidArgument("code: %p, block: %p", code, block);
+		
+	} else {
+		// search forward from pc until we find next branch
+		_DInst result = {0};
+		unsigned int ic = 0;
+		
+		_CodeInfo ci = {0};
+		ci.code = code;
+		ci.codeLen = (int) length;
+		ci.dt = dt;
+		ci.codeOffset = pc;
+		while (ci.codeLen > 0) {
+			distorm_decompose64(&ci, &result, 1, &ic);
+			if (ic == 0 || result.flags == FLAG_NOT_DECODABLE) {
+				Log_error("Unable to decode instruction at: %llx, offset: %llx", pc, ci.codeOffset-pc);
+				break;
+				
+			} else {
+				int fc = META_GET_FC(result.meta);
+				if (fc != FC_NONE){
+					block->entry = pc;
+					block->branch = ci.codeOffset;
+					block->next = ci.codeOffset + result.size;
+					block->target = 0;
+					block->conditional = false;
+					switch (fc) {
+						case FC_CALL:	block->type = eBranchType_call;		break;
+						case FC_RET:	block->type = eBranchType_ret;		break;
+						case FC_SYS:	block->type = eBranchType_sys;		break;								
+						default:		block->type = eBranchType_other;	break;
+					}
+					
+					// work out where the branch goes, if thats fixed by the code
+					if (	(fc == FC_CALL || fc == FC_UNC_BRANCH || fc == FC_CND_BRANCH)
+						 && (result.ops[0].type == O_PC)) {
+						block->target = INSTRUCTION_GET_TARGET(&result);
+						block->conditional = (fc == FC_CND_BRANCH);
+						
+					} else if (fc == FC_SYS) {
+						block->target = block->next; // we always come back to the next instruction
+					}
+					retVal = true;
+					break;
+				}
+			}
+			ci.code += result.size;
+			ci.codeLen -= result.size;
+			ci.codeOffset += result.size;
+		}
+	}
+	return retVal;
+}
@@ -0,0 +1,490 @@
+//
+//  CallIndex.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CallIndex.h"
+#include "TraceScan.h"
+#include "HashMap.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kCallIndexUnknownName	"?"		// a call made before the trace (or thread) started
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sCallIndexThread {
+	uint64_t		id;
+	uint32_t		base;			// the root's depth; it goes down if the thread returns above where it started
+	uint32_t		top;			// stack[top] is the innermost open call
+	CallIndexNode*	stack;			// the open calls, the root first; written out as they return
+	uint32_t		capacity;
+} CallIndexThread;
+
+
+typedef struct sCallIndexBuild {
+	FILE*				file;
+	const char*			path;
+	uint64_t			nodeCount;		// written so far
+	TraceBuffer			strings;
+	HashMap				names;			// address called to offset into strings
+	uint32_t			unknown;		// kCallIndexUnknownName's offset
+	CallIndexThread*	threads;		// there aren't normally many threads; so we just search
+	uint32_t			threadCount;
+	uint32_t			threadCapacity;
+	uint32_t			last;			// the last block's thread; they come a chunk at a time
+} CallIndexBuild;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static bool mapIndex(CallIndex* self, const char* indexPath, const struct stat* trace);
+static bool buildIndex(const char* tracePath, const char* indexPath, const char* root, const struct stat* trace);
+static bool writeIndex(CallIndexBuild* build, TraceScan* scan, const struct stat* trace);
+static bool linkNodes(const char* path, uint64_t nodeCount);
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context);
+static CallIndexThread* findThread(CallIndexBuild* build, uint64_t id, const FlowReaderBlock* block);
+static bool openCall(CallIndexThread* thread, uint64_t entry, uint32_t name, uint64_t seq);
+static void closeCall(CallIndexBuild* build, CallIndexThread* thread);
+static uint64_t writeNode(CallIndexBuild* build, const CallIndexNode* node);
+static bool addName(CallIndexBuild* build, const char* name, uint32_t* offset);
+static bool findName(CallIndexBuild* build, TraceImages* images, uint64_t address, uint32_t* offset);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool CallIndex_open(CallIndex* self, const char* tracePath, const char* indexPath, const char* root, bool rebuild) {
+	bool retVal = false;
+	memset(self, 0, sizeof(*self));
+	struct stat trace = {0};
+	if (stat(tracePath, &trace) == -1) {
+		Log_errorPosix(errno, "stat: %s", tracePath);
+		
+	} else if (rebuild == false && mapIndex(self, indexPath, &trace)) {
+		retVal = true;
+		
+	} else if (buildIndex(tracePath, indexPath, root, &trace)) {
+		retVal = mapIndex(self, indexPath, &trace);
+		if (retVal == false) {
+			Log_error("unable to map the index we just wrote: %s", indexPath);
+		}
+	}
+	return retVal;
+}
+
+
+const CallIndexNode* CallIndex_getNode(CallIndex* self, uint64_t node) {
+	const CallIndexNode* retVal = NULL;
+	if (node < self->header->nodeCount) {
+		retVal = &self->nodes[node];
+	}
+	return retVal;
+}
+
+
+const char* CallIndex_getName(CallIndex* self, uint64_t node) {
+	const char* retVal = kCallIndexUnknownName;
+	if (node < self->header->nodeCount && self->nodes[node].name < self->header->stringsSize) {
+		retVal = &self->strings[self->nodes[node].name];
+	}
+	return retVal;
+}
+
+
+uint32_t CallIndex_getChildren(CallIndex* self, uint64_t first, uint64_t* children, uint32_t max) {
+	// up to max calls from first on; a node's firstChild, or the next of the last one listed
+	uint32_t retVal = 0;
+	uint64_t child = first;
+	while (retVal < max && child < self->header->nodeCount) {
+		children[retVal++] = child;
+		child = self->nodes[child].next;
+	}
+	return retVal;
+}
+
+
+void CallIndex_close(CallIndex* self) {
+	if (self->map) {
+		(void) munmap((void*) self->map, self->mapSize);
+	}
+	memset(self, 0, sizeof(*self));
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static bool mapIndex(CallIndex* self, const char* indexPath, const struct stat* trace) {
+	// false if there's no index, or it's for a different trace; that's not an error
+	bool retVal = false;
+	int fd = open(indexPath, O_RDONLY);
+	if (fd != -1) {
+		struct stat st = {0};
+		if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(CallIndexHeader)) {
+			void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				const CallIndexHeader* header = map;
+				uint64_t size = st.st_size - sizeof(*header);
+				if (	(header->magic == kCallIndexMagic)
+					 && (header->version == kCallIndexVersion)
+					 && (header->mtime == (uint64_t) trace->st_mtime)
+					 && (header->fileSize == (uint64_t) trace->st_size)
+					 && (header->nodeCount <= size / sizeof(CallIndexNode))
+					 && (header->stringsSize > 0)
+					 && (	(header->nodeCount * sizeof(CallIndexNode)) 
+						  + ((uint64_t) header->threadCount * sizeof(uint64_t)) 
+						  + header->stringsSize == size)
+					 && (((const char*) map)[st.st_size - 1] == '\0')) {
+					self->map = map;
+					self->mapSize = st.st_size;
+					self->header = header;
+					self->nodes = (const CallIndexNode*) (header + 1);
+					self->threads = (const uint64_t*) (self->nodes + header->nodeCount);
+					self->strings = (const char*) (self->threads + header->threadCount);
+					retVal = true;
+					
+				} else {
+					(void) munmap(map, st.st_size);
+				}
+			}
+		}
+		(void) close(fd);
+	}
+	return retVal;
+}
+
+
+static bool buildIndex(const char* tracePath, const char* indexPath, const char* root, const struct stat* trace) {
+	// written to a temporary file then renamed; so another run never maps half of one
+	bool retVal = false;
+	char tempFile[PATH_MAX] = "";
+	(void) snprintf(tempFile, sizeof(tempFile), "%s.%d", indexPath, (int) getpid());
+	
+	CallIndexBuild build = {0};
+	build.path = tempFile;
+	// there's a FlowReaderBlock buffer inside so it's too big for the stack
+	TraceScan* scan = malloc(sizeof(TraceScan));
+	if (scan == NULL) {
+		Log_error("out of memory");
+		
+	} else if (	   TraceBuffer_create(&build.strings, 0) 
+				&& HashMap_create(&build.names, 0) 
+				&& addName(&build, kCallIndexUnknownName, &build.unknown)
+				&& TraceScan_open(scan, tracePath, root)) {
+		build.file = fopen(tempFile, "w");
+		if (build.file == NULL) {
+			Log_errorPosix(errno, "fopen: %s", tempFile);
+			
+		} else {
+			(void) setvbuf(build.file, NULL, _IOFBF, 1024 * 1024);
+			bool written = writeIndex(&build, scan, trace);
+			if (fclose(build.file) != 0 && written) {
+				Log_errorPosix(errno, "write: %s", tempFile);
+				written = false;
+			}
+			written = written && linkNodes(tempFile, build.nodeCount);
+			
+			if (written && rename(tempFile, indexPath) == -1) {
+				Log_errorPosix(errno, "rename: %s", indexPath);
+				written = false;
+			}
+			if (written == false) {
+				(void) unlink(tempFile);
+			}
+			retVal = written;
+		}
+		TraceScan_close(scan);
+	}
+	
+	for (uint32_t i = 0; i < build.threadCount; i++) {
+		free(build.threads[i].stack);
+	}
+	free(build.threads);
+	HashMap_release(&build.names);
+	TraceBuffer_release(&build.strings);
+	free(scan);
+	return retVal;
+}
+
+
+static bool writeIndex(CallIndexBuild* build, TraceScan* scan, const struct stat* trace) {
+	// the header's filled in once we know the counts
+	CallIndexHeader header = {0};
+	bool retVal = (fwrite(&header, sizeof(header), 1, build->file) == 1) && TraceScan_run(scan, addBlocks, build);
+	
+	// whatever's still open ends with the trace; then the threads themselves
+	uint64_t* roots = malloc((build->threadCount ? build->threadCount: 1) * sizeof(uint64_t));
+	if (roots == NULL) {
+		Log_error("out of memory");
+		retVal = false;
+	}
+	for (uint32_t i = 0; retVal && i < build->threadCount; i++) {
+		CallIndexThread* thread = &build->threads[i];
+		while (thread->top) {
+			closeCall(build, thread);
+		}
+		roots[i] = writeNode(build, &thread->stack[0]);
+	}
+	
+	if (retVal) {
+		header.magic = kCallIndexMagic;
+		header.version = kCallIndexVersion;
+		header.mtime = trace->st_mtime;
+		header.fileSize = trace->st_size;
+		header.nodeCount = build->nodeCount;
+		header.threadCount = build->threadCount;
+		header.stringsSize = build->strings.size;
+		retVal = (	 fwrite(roots, sizeof(uint64_t), build->threadCount, build->file) == build->threadCount
+				  && fwrite(build->strings.data, 1, build->strings.size, build->file) == build->strings.size
+				  && fseek(build->file, 0, SEEK_SET) == 0
+				  && fwrite(&header, sizeof(header), 1, build->file) == 1);
+		if (retVal == false) {
+			Log_errorPosix(errno, "write: %s", build->path);
+		}
+	}
+	free(roots);
+	return retVal;
+}
+
+
+static bool linkNodes(const char* path, uint64_t nodeCount) {
+	// a node's next isn't known until the call after it returns, long after it was written; so
+	// they're filled in afterwards, in one pass over the nodes
+	bool retVal = false;
+	int fd = open(path, O_RDWR);
+	if (fd == -1) {
+		Log_errorPosix(errno, "open: %s", path);
+		
+	} else {
+		size_t size = sizeof(CallIndexHeader) + nodeCount * sizeof(CallIndexNode);
+		void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			Log_errorPosix(errno, "mmap: %s", path);
+			
+		} else {
+			CallIndexNode* nodes = (CallIndexNode*) ((CallIndexHeader*) map + 1);
+			for (uint64_t i = 0; i < nodeCount; i++) {
+				if (nodes[i].previous < i) {
+					nodes[nodes[i].previous].next = i;
+				}
+			}
+			retVal = (munmap(map, size) == 0);
+			if (retVal == false) {
+				Log_errorPosix(errno, "munmap: %s", path);
+			}
+		}
+		(void) close(fd);
+	}
+	return retVal;
+}
+
+
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context) {
+	bool retVal = true;
+	CallIndexBuild* build = context;
+	CallIndexThread* thread = findThread(build, scan->chunk.thread, &blocks[0]);
+	for (uint32_t i = 0; retVal && thread && i < count; i++) {
+		const FlowReaderBlock* block = &blocks[i];
+		if (block->depth < thread->base) {
+			// it returned above where it started; the root becomes what it returned to
+			while (thread->top) {
+				closeCall(build, thread);
+			}
+			thread->base = block->depth;
+		}
+		
+		uint32_t level = block->depth - thread->base;
+		while (thread->top > level) {
+			closeCall(build, thread);
+		}
+		while (retVal && thread->top < level) {
+			// only the innermost call is this block's; any others were made before the chunk
+			uint32_t name = build->unknown;
+			bool known = (thread->top + 1 == level);
+			retVal = (known == false || findName(build, &scan->images, block->landed, &name))
+				  && openCall(thread, known ? block->landed: 0, name, block->seq);
+		}
+		
+		CallIndexNode* node = &thread->stack[thread->top];
+		node->blocks++;
+		node->lastBlock = block->seq;
+	}
+	return retVal && thread;
+}
+
+
+static CallIndexThread* findThread(CallIndexBuild* build, uint64_t id, const FlowReaderBlock* block) {
+	CallIndexThread* retVal = NULL;
+	if (build->last < build->threadCount && build->threads[build->last].id == id) {
+		retVal = &build->threads[build->last];
+	}
+	for (uint32_t i = 0; retVal == NULL && i < build->threadCount; i++) {
+		if (build->threads[i].id == id) {
+			retVal = &build->threads[i];
+			build->last = i;
+		}
+	}
+	
+	if (retVal == NULL) {
+		if (build->threadCount == build->threadCapacity) {
+			uint32_t capacity = build->threadCapacity ? build->threadCapacity * 2: 16;
+			CallIndexThread* threads = realloc(build->threads, capacity * sizeof(CallIndexThread));
+			if (threads) {
+				build->threads = threads;
+				build->threadCapacity = capacity;
+			}
+		}
+		
+		char name[64] = {0};
+		uint32_t offset = 0;
+		(void) snprintf(name, sizeof(name), "thread %llx", id);
+		if (build->threadCount == build->threadCapacity) {
+			Log_error("out of memory");
+			
+		} else if (addName(build, name, &offset)) {
+			retVal = &build->threads[build->threadCount];
+			memset(retVal, 0, sizeof(*retVal));
+			retVal->id = id;
+			retVal->base = block->depth;
+			retVal->top = UINT32_MAX;		// so the root is stack[0]
+			if (openCall(retVal, 0, offset, block->seq)) {
+				build->last = build->threadCount++;
+				
+			} else {
+				free(retVal->stack);
+				retVal = NULL;
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static bool openCall(CallIndexThread* thread, uint64_t entry, uint32_t name, uint64_t seq) {
+	bool retVal = false;
+	uint32_t top = thread->top + 1;
+	if (top == thread->capacity) {
+		uint32_t capacity = thread->capacity ? thread->capacity * 2: 256;
+		CallIndexNode* stack = realloc(thread->stack, capacity * sizeof(CallIndexNode));
+		if (stack) {
+			thread->stack = stack;
+			thread->capacity = capacity;
+		}
+	}
+	
+	if (top == thread->capacity) {
+		Log_error("out of memory");
+		
+	} else {
+		CallIndexNode* node = &thread->stack[top];
+		memset(node, 0, sizeof(*node));
+		node->entry = entry;
+		node->firstBlock = seq;
+		node->lastBlock = seq;
+		node->firstChild = kCallIndexNone;
+		node->lastChild = kCallIndexNone;
+		node->previous = kCallIndexNone;
+		node->next = kCallIndexNone;
+		node->name = name;
+		thread->top = top;
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static void closeCall(CallIndexBuild* build, CallIndexThread* thread) {
+	// only for calls; the root is written at the end
+	CallIndexNode* node = &thread->stack[thread->top];
+	CallIndexNode* caller = &thread->stack[thread->top - 1];
+	node->previous = caller->lastChild;
+	caller->lastChild = writeNode(build, node);
+	if (caller->children == 0) {
+		caller->firstChild = caller->lastChild;
+	}
+	caller->children++;
+	caller->blocks += node->blocks;
+	caller->lastBlock = node->lastBlock;
+	thread->top--;
+}
+
+
+static uint64_t writeNode(CallIndexBuild* build, const CallIndexNode* node) {
+	// a failed write shows up in fclose
+	(void) fwrite(node, sizeof(*node), 1, build->file);
+	return build->nodeCount++;
+}
+
+
+static bool addName(CallIndexBuild* build, const char* name, uint32_t* offset) {
+	*offset = (uint32_t) build->strings.size;
+	return TraceBuffer_append(&build->strings, name, strlen(name) + 1);
+}
+
+
+static bool findName(CallIndexBuild* build, TraceImages* images, uint64_t address, uint32_t* offset) {
+	// named after the function, so every call to it is the same; each is only formatted once
+	bool retVal = true;
+	if (HashMap_lookup(&build->names, address, offset) == false) {
+		char name[kTraceImagesNameSize] = "";
+		uint64_t start = address;
+		const char* symbolName = NULL;
+		uint32_t image = TraceImages_find(images, address);
+		uint32_t symbol = TraceImages_findSymbol(images, image, address);
+		if (symbol != kTraceImagesNone) {
+			(void) TraceImages_getSymbol(images, image, symbol, &start, &symbolName);
+		}
+		(void) TraceImages_format(images, name, sizeof(name), image, symbol, start);
+		retVal = addName(build, name, offset) && HashMap_set(&build->names, address, *offset);
+	}
+	return retVal;
+}
@@ -0,0 +1,117 @@
+//
+//  CallIndex.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_CallIndex_h
+#define Flow_CallIndex_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/*
+ * Defines
+ */
+#define kCallIndexMagic		(0x4C4C4143)	// 'CALL'
+#define kCallIndexVersion	(2)
+#define kCallIndexNone		(UINT64_MAX)	// no node
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+
+/*
+ * An index file is a CallIndexHeader, nodeCount CallIndexNode's, threadCount root 
+ * node indexes (uint64_t's) then the names.  It's only used if the trace's mtime and
+ * size still match.
+ */
+typedef struct sCallIndexHeader {
+	uint32_t	magic;			// kCallIndexMagic
+	uint32_t	version;		// kCallIndexVersion
+	uint64_t	mtime;			// of the trace
+	uint64_t	fileSize;
+	uint64_t	nodeCount;
+	uint32_t	threadCount;
+	uint32_t	reserved;
+	uint64_t	stringsSize;
+} CallIndexHeader;
+
+
+/*
+ * A call, and everything it called; or a whole thread, for the roots.  Nodes are 
+ * written as they return, so a node's calls all come before it and it links to the 
+ * first and last; each links to the ones either side.  So a call's calls can be listed
+ * a page at a time without reading anything they called in turn, and a whole subtree
+ * skipped in one step.
+ */
+typedef struct sCallIndexNode {
+	uint64_t	entry;			// the address called; 0 for a thread, or a call made before the trace started
+	uint64_t	firstBlock;		// sequence number of its first block
+	uint64_t	lastBlock;		// and of its last, including the calls it made; the return
+	uint64_t	blocks;			// run in it and everything it called
+	uint64_t	firstChild;		// the first call it made; kCallIndexNone if it made none
+	uint64_t	lastChild;		// and the last
+	uint64_t	previous;		// the call its caller made before it; kCallIndexNone if it's the first
+	uint64_t	next;			// and after it; kCallIndexNone if it's the last
+	uint32_t	children;		// calls it made
+	uint32_t	name;			// offset into the strings
+} CallIndexNode;
+
+
+/*
+ * The call tree of every thread in a trace, from an index file next to it.  Building
+ * it takes one pass over the trace, with memory for the open calls and the names; 
+ * after that CallIndex_open just maps it, however big the trace.
+ */
+typedef struct sCallIndex {
+	const uint8_t*			map;
+	uint64_t				mapSize;
+	const CallIndexHeader*	header;
+	const CallIndexNode*	nodes;
+	const uint64_t*			threads;		// their root nodes
+	const char*				strings;
+} CallIndex;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool CallIndex_open(CallIndex* self, const char* tracePath, const char* indexPath, const char* root, bool rebuild);
+const CallIndexNode* CallIndex_getNode(CallIndex* self, uint64_t node);
+const char* CallIndex_getName(CallIndex* self, uint64_t node);
+uint32_t CallIndex_getChildren(CallIndex* self, uint64_t first, uint64_t* children, uint32_t max);
+void CallIndex_close(CallIndex* self);
+
+
+#endif
@@ -0,0 +1,338 @@
+//
+//  Columns.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Columns.h"
+#include "TraceScan.h"
+#include "HashMap.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kColumnsHeader		(eColumn_count)		// maps/sizes index of the header file
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sColumnsBuild {
+	const char*	directory;
+	FILE*		files[eColumn_count];
+	HashMap		threadMap;					// thread id to index into threads
+	uint64_t*	threads;
+	uint32_t	threadCount;
+	uint32_t	threadCapacity;
+	uint64_t	count;
+	
+	// a run of blocks, a column at a time
+	uint64_t	entry[kTraceScanBlocks];
+	uint64_t	branch[kTraceScanBlocks];
+	uint8_t		type[kTraceScanBlocks];
+	uint32_t	thread[kTraceScanBlocks];
+	uint64_t	seq[kTraceScanBlocks];
+	uint64_t	timestamp[kTraceScanBlocks];
+} ColumnsBuild;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static bool mapColumns(Columns* self, const char* directory, const struct stat* trace);
+static bool mapFile(const char* directory, uint32_t column, void** map, uint64_t* size);
+static bool convert(const char* tracePath, const char* directory, const struct stat* trace);
+static bool writeColumns(ColumnsBuild* build, TraceScan* scan, const struct stat* trace);
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context);
+static void removeColumns(const char* directory);
+
+
+
+
+/*
+ * Global variables
+ */
+static const char* gColumnNames[eColumn_count + 1] = {"entry", "branch", "type", "thread", "seq", "timestamp", "header"};
+static const uint32_t gColumnWidths[eColumn_count] = {sizeof(uint64_t), sizeof(uint64_t), sizeof(uint8_t), sizeof(uint32_t), sizeof(uint64_t), sizeof(uint64_t)};
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool Columns_open(Columns* self, const char* tracePath, const char* directory, bool rebuild) {
+	bool retVal = false;
+	memset(self, 0, sizeof(*self));
+	struct stat trace = {0};
+	if (stat(tracePath, &trace) == -1) {
+		Log_errorPosix(errno, "stat: %s", tracePath);
+		
+	} else if (rebuild == false && mapColumns(self, directory, &trace)) {
+		retVal = true;
+		
+	} else if (convert(tracePath, directory, &trace)) {
+		retVal = mapColumns(self, directory, &trace);
+		if (retVal == false) {
+			Log_error("unable to map the columns we just wrote: %s", directory);
+		}
+	}
+	return retVal;
+}
+
+
+void Columns_close(Columns* self) {
+	for (uint32_t i = 0; i <= eColumn_count; i++) {
+		if (self->maps[i]) {
+			(void) munmap(self->maps[i], self->sizes[i]);
+		}
+	}
+	memset(self, 0, sizeof(*self));
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static bool mapColumns(Columns* self, const char* directory, const struct stat* trace) {
+	// false if they're not there, or they're for a different trace; that's not an error
+	bool retVal = false;
+	if (mapFile(directory, kColumnsHeader, &self->maps[kColumnsHeader], &self->sizes[kColumnsHeader])) {
+		const ColumnsHeader* header = self->maps[kColumnsHeader];
+		uint64_t size = self->sizes[kColumnsHeader];
+		retVal = (	 (size >= sizeof(*header))
+				  && (header->magic == kColumnsMagic)
+				  && (header->version == kColumnsVersion)
+				  && (header->mtime == (uint64_t) trace->st_mtime)
+				  && (header->fileSize == (uint64_t) trace->st_size)
+				  && (sizeof(*header) + ((uint64_t) header->threadCount * sizeof(uint64_t)) == size));
+		for (uint32_t i = 0; retVal && i < eColumn_count; i++) {
+			retVal = mapFile(directory, i, &self->maps[i], &self->sizes[i]) && (self->sizes[i] == header->count * gColumnWidths[i]);
+		}
+		
+		if (retVal) {
+			self->count = header->count;
+			self->threadCount = header->threadCount;
+			self->threads = (const uint64_t*) (header + 1);
+			self->entry = self->maps[eColumn_entry];
+			self->branch = self->maps[eColumn_branch];
+			self->type = self->maps[eColumn_type];
+			self->thread = self->maps[eColumn_thread];
+			self->seq = self->maps[eColumn_seq];
+			self->timestamp = self->maps[eColumn_timestamp];
+			
+		} else {
+			Columns_close(self);
+		}
+	}
+	return retVal;
+}
+
+
+static bool mapFile(const char* directory, uint32_t column, void** map, uint64_t* size) {
+	// an empty column is left NULL
+	bool retVal = false;
+	char path[PATH_MAX] = "";
+	(void) snprintf(path, sizeof(path), "%s/%s", directory, gColumnNames[column]);
+	int fd = open(path, O_RDONLY);
+	if (fd != -1) {
+		struct stat st = {0};
+		if (fstat(fd, &st) == 0) {
+			*size = st.st_size;
+			*map = NULL;
+			if (st.st_size > 0) {
+				void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				*map = (m != MAP_FAILED) ? m: NULL;
+			}
+			retVal = (st.st_size == 0 || *map != NULL);
+		}
+		(void) close(fd);
+	}
+	return retVal;
+}
+
+
+static bool convert(const char* tracePath, const char* directory, const struct stat* trace) {
+	// written to a temporary directory then renamed; so another run never maps half of one
+	bool retVal = false;
+	char tempDirectory[PATH_MAX] = "";
+	(void) snprintf(tempDirectory, sizeof(tempDirectory), "%s.%d", directory, (int) getpid());
+	
+	// there are FlowReaderBlock (and column) buffers inside so they're too big for the stack
+	TraceScan* scan = malloc(sizeof(TraceScan));
+	ColumnsBuild* build = calloc(1, sizeof(ColumnsBuild));
+	if (scan == NULL || build == NULL) {
+		Log_error("out of memory");
+		
+	} else if (mkdir(tempDirectory, 0755) == -1) {
+		Log_errorPosix(errno, "mkdir: %s", tempDirectory);
+		
+	} else {
+		build->directory = tempDirectory;
+		if (HashMap_create(&build->threadMap, 0) && TraceScan_open(scan, tracePath, "")) {
+			retVal = writeColumns(build, scan, trace);
+			TraceScan_close(scan);
+		}
+		
+		for (uint32_t i = 0; i < eColumn_count; i++) {
+			if (build->files[i] && fclose(build->files[i]) != 0 && retVal) {
+				Log_errorPosix(errno, "write: %s/%s", tempDirectory, gColumnNames[i]);
+				retVal = false;
+			}
+		}
+		
+		if (retVal) {
+			removeColumns(directory);
+			if (rename(tempDirectory, directory) == -1) {
+				Log_errorPosix(errno, "rename: %s", directory);
+				retVal = false;
+			}
+		}
+		if (retVal == false) {
+			removeColumns(tempDirectory);
+		}
+		HashMap_release(&build->threadMap);
+		free(build->threads);
+	}
+	free(build);
+	free(scan);
+	return retVal;
+}
+
+
+static bool writeColumns(ColumnsBuild* build, TraceScan* scan, const struct stat* trace) {
+	bool retVal = true;
+	char path[PATH_MAX] = "";
+	for (uint32_t i = 0; retVal && i < eColumn_count; i++) {
+		(void) snprintf(path, sizeof(path), "%s/%s", build->directory, gColumnNames[i]);
+		build->files[i] = fopen(path, "w");
+		if (build->files[i] == NULL) {
+			Log_errorPosix(errno, "fopen: %s", path);
+			retVal = false;
+		}
+	}
+	
+	if (retVal && TraceScan_run(scan, addBlocks, build)) {
+		// the header last; without it the rest are ignored
+		ColumnsHeader header = {0};
+		header.magic = kColumnsMagic;
+		header.version = kColumnsVersion;
+		header.mtime = trace->st_mtime;
+		header.fileSize = trace->st_size;
+		header.count = build->count;
+		header.threadCount = build->threadCount;
+		(void) snprintf(path, sizeof(path), "%s/%s", build->directory, gColumnNames[kColumnsHeader]);
+		FILE* file = fopen(path, "w");
+		retVal = (	 file != NULL
+				  && fwrite(&header, sizeof(header), 1, file) == 1
+				  && fwrite(build->threads, sizeof(uint64_t), build->threadCount, file) == build->threadCount);
+		if ((file && fclose(file) != 0) || retVal == false) {
+			Log_errorPosix(errno, "write: %s", path);
+			retVal = false;
+		}
+		
+	} else {
+		retVal = false;
+	}
+	return retVal;
+}
+
+
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context) {
+	bool retVal = true;
+	ColumnsBuild* build = context;
+	uint32_t thread = 0;
+	if (HashMap_lookup(&build->threadMap, scan->chunk.thread, &thread) == false) {
+		if (build->threadCount == build->threadCapacity) {
+			uint32_t capacity = build->threadCapacity ? build->threadCapacity * 2: 16;
+			uint64_t* threads = realloc(build->threads, capacity * sizeof(uint64_t));
+			if (threads) {
+				build->threads = threads;
+				build->threadCapacity = capacity;
+			}
+		}
+		
+		if (build->threadCount == build->threadCapacity) {
+			Log_error("out of memory");
+			retVal = false;
+			
+		} else {
+			thread = build->threadCount;
+			build->threads[build->threadCount++] = scan->chunk.thread;
+			retVal = HashMap_set(&build->threadMap, scan->chunk.thread, thread);
+		}
+	}
+	
+	if (retVal) {
+		// a run is all from one chunk; so one thread and timestamp
+		for (uint32_t i = 0; i < count; i++) {
+			build->entry[i] = blocks[i].landed;
+			build->branch[i] = blocks[i].fc;
+			build->type[i] = (uint8_t) blocks[i].fcType;
+			build->thread[i] = thread;
+			build->seq[i] = blocks[i].seq;
+			build->timestamp[i] = scan->chunk.timestamp;
+		}
+		
+		const void* columns[eColumn_count] = {build->entry, build->branch, build->type, build->thread, build->seq, build->timestamp};
+		for (uint32_t i = 0; retVal && i < eColumn_count; i++) {
+			retVal = fwrite(columns[i], gColumnWidths[i], count, build->files[i]) == count;
+			if (retVal == false) {
+				Log_errorPosix(errno, "write: %s/%s", build->directory, gColumnNames[i]);
+			}
+		}
+		build->count += count;
+	}
+	return retVal;
+}
+
+
+static void removeColumns(const char* directory) {
+	char path[PATH_MAX] = "";
+	for (uint32_t i = 0; i <= eColumn_count; i++) {
+		(void) snprintf(path, sizeof(path), "%s/%s", directory, gColumnNames[i]);
+		(void) unlink(path);
+	}
+	(void) rmdir(directory);
+}
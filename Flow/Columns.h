@@ -0,0 +1,107 @@
+//
+//  Columns.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_Columns_h
+#define Flow_Columns_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/*
+ * Defines
+ */
+#define kColumnsMagic		(0x534C4F43)	// 'COLS'
+#define kColumnsVersion		(2)
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef enum eColumn {
+	eColumn_entry,			// uint64_t; the block's first instruction
+	eColumn_branch,			// uint64_t; the branch which ended it
+	eColumn_type,			// uint8_t; the branch's FlowReaderBlock fcType
+	eColumn_thread,			// uint32_t; index into threads
+	eColumn_seq,			// uint64_t; the block's sequence number in its thread
+	eColumn_timestamp,		// uint64_t; mach_absolute_time its chunk was started
+	eColumn_count
+} Column;
+
+
+/*
+ * The header file of a columns directory; then threadCount thread ids.  It's only 
+ * used if the trace's mtime and size still match.
+ */
+typedef struct sColumnsHeader {
+	uint32_t	magic;			// kColumnsMagic
+	uint32_t	version;		// kColumnsVersion
+	uint64_t	mtime;			// of the trace
+	uint64_t	fileSize;
+	uint64_t	count;			// of blocks; the rows in each column
+	uint32_t	threadCount;
+	uint32_t	reserved;
+} ColumnsHeader;
+
+
+/*
+ * A trace's blocks a column at a time, in the order they're in the log; a file per 
+ * column in a directory next to it, each a plain array, mapped in.  So a query only
+ * reads the columns it's asking about and can work through them at memory speed, 
+ * rather than decoding every record.  Columns_open converts the trace the first time.
+ */
+typedef struct sColumns {
+	uint64_t			count;
+	uint32_t			threadCount;
+	const uint64_t*		threads;		// their ids
+	const uint64_t*		entry;
+	const uint64_t*		branch;
+	const uint8_t*		type;
+	const uint32_t*		thread;
+	const uint64_t*		seq;
+	const uint64_t*		timestamp;
+	
+	void*				maps[eColumn_count + 1];	// the columns, then the header
+	uint64_t			sizes[eColumn_count + 1];
+} Columns;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool Columns_open(Columns* self, const char* tracePath, const char* directory, bool rebuild);
+void Columns_close(Columns* self);
+
+
+#endif
@@ -0,0 +1,591 @@
+//
+//  Coverage.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "Coverage.h"
+#include "TraceScan.h"
+#include "HashMap.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kCoverageMagic			(0x564F4346)	// 'FCOV'
+#define kCoverageVersion		(1)
+#define kCoverageMaxPath		(4096)
+#define kCoverageMaxSize		(1ull << 32)	// of an image; drcov offsets are 32bit anyway
+#define kCoverageMaxBasicBlock	(0xFFFF)		// drcov's basic block sizes are 16bit
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef enum eCoverageFormat {
+	eCoverageFormat_cov,
+	eCoverageFormat_drcov
+} CoverageFormat;
+
+
+typedef struct sOptions {
+	const char*		root;
+	CoverageFormat	format;
+	const char*		outputFilename;		// NULL to just print a summary
+	char**			inputs;				// traces and .cov files
+	uint32_t		inputCount;
+} Options;
+
+
+/*
+ * A .cov file is a CoverageFileHeader then, for each image, a CoverageFileImage, its
+ * path and its bitmap (words uint64_t's).  In the host's byte order, like the log.
+ */
+typedef struct sCoverageFileHeader {
+	uint32_t	magic;			// kCoverageMagic
+	uint32_t	version;		// kCoverageVersion
+	uint32_t	count;			// of images
+	uint32_t	reserved;
+} CoverageFileHeader;
+
+
+typedef struct sCoverageFileImage {
+	uint64_t	hash;
+	uint64_t	base;
+	uint64_t	size;
+	uint32_t	pathLength;
+	uint32_t	words;
+} CoverageFileImage;
+
+
+typedef struct sCoverageImage {
+	uint64_t	hash;			// of the path; runs are merged by it, so it doesn't matter where it loaded
+	uint64_t	base;			// where it was in the first run we saw; drcov wants one
+	uint64_t	size;
+	uint32_t	path;			// offset into strings
+	uint64_t*	bits;			// a bit per byte from base; set if a block covered it
+	uint32_t	words;
+} CoverageImage;
+
+
+/*
+ * Blocks are marked from entry to branch inclusive; the first byte of the branch is
+ * as much of it as we know.  Each trace's images are mapped to ours as they're first
+ * run in, by traceImages.
+ */
+typedef struct sCoverage {
+	TraceBuffer		strings;
+	HashMap			map;			// image hash to index into images
+	CoverageImage*	images;
+	uint32_t		count;
+	uint32_t		capacity;
+	uint32_t*		traceImages;	// the scan's image index to ours; kTraceImagesNone until it's run in
+	uint32_t		traceImageCount;
+	uint64_t		lastEntry;		// of the last block; loops run the same one over and over
+	uint64_t		lastBranch;
+	uint64_t		blocks;			// run
+	uint64_t		outside;		// blocks which weren't in any image we know
+} Coverage;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void parseOptions(Options* options, int argc, char* argv[]);
+static void usage(void);
+static bool addInput(Coverage* self, const char* path, const char* root);
+static bool addTrace(Coverage* self, const char* path, const char* root);
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context);
+static uint32_t mapImage(Coverage* self, TraceImages* images, uint32_t image);
+static uint32_t findImage(Coverage* self, uint64_t hash, const char* path, uint32_t pathLength, uint64_t base, uint64_t size);
+static bool growImage(CoverageImage* image, uint64_t size);
+static void setBits(CoverageImage* image, uint64_t start, uint64_t end);
+static bool readCoverage(Coverage* self, FILE* file, const char* path);
+static bool writeCoverage(Coverage* self, FILE* file);
+static bool writeDrcov(Coverage* self, FILE* file);
+static uint64_t countBits(CoverageImage* image);
+static void printSummary(Coverage* self);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+int Coverage_main(int argc, char* argv[]) {
+	int retVal = -1;
+	Options options = {0};
+	parseOptions(&options, argc, argv);
+	
+	Coverage coverage = {0};
+	if (TraceBuffer_create(&coverage.strings, 0) && HashMap_create(&coverage.map, 0)) {
+		bool ok = true;
+		for (uint32_t i = 0; ok && i < options.inputCount; i++) {
+			ok = addInput(&coverage, options.inputs[i], options.root);
+		}
+		
+		if (ok && options.outputFilename) {
+			FILE* file = fopen(options.outputFilename, "w");
+			if (file == NULL) {
+				Log_errorPosix(errno, "fopen: %s", options.outputFilename);
+				ok = false;
+				
+			} else {
+				ok = (options.format == eCoverageFormat_drcov) ? writeDrcov(&coverage, file): writeCoverage(&coverage, file);
+				if (fclose(file) != 0 || ok == false) {
+					Log_errorPosix(errno, "write: %s", options.outputFilename);
+					ok = false;
+				}
+			}
+		}
+		
+		if (ok) {
+			printSummary(&coverage);
+			retVal = 0;
+		}
+	}
+	
+	for (uint32_t i = 0; i < coverage.count; i++) {
+		free(coverage.images[i].bits);
+	}
+	free(coverage.images);
+	free(coverage.traceImages);
+	HashMap_release(&coverage.map);
+	TraceBuffer_release(&coverage.strings);
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void parseOptions(Options* options, int argc, char* argv[]) {
+	options->root = "";
+	options->format = eCoverageFormat_cov;
+	
+	int c = -1;
+	while ((c = getopt(argc, argv, "r:f:o:")) != -1) {
+		switch (c) {
+			case 'r':
+				options->root = optarg;
+				break;
+				
+			case 'f':
+				if (strcmp(optarg, "drcov") == 0) {
+					options->format = eCoverageFormat_drcov;
+					
+				} else if (strcmp(optarg, "cov") != 0) {
+					usage();
+				}
+				break;
+				
+			case 'o':
+				options->outputFilename = optarg;
+				break;
+				
+			default:
+				usage();
+				break;
+		}
+	}
+	
+	if (optind >= argc) {
+		usage();
+	}
+	options->inputs = &argv[optind];
+	options->inputCount = argc - optind;
+}
+
+
+static void usage(void) {
+	printf("Usage: flowtool coverage [-r root] [-f cov|drcov] [-o outputfile] tracefile|covfile ...\n");
+	printf("    -r: where the traced process's root was; prefixed to image paths to read their sizes\n");
+	printf("    -f: cov (default); a bitmap per image, which can be given back to merge with other runs.\n");
+	printf("        drcov; for binary coverage tools\n");
+	printf("    -o: where to write the coverage of all the inputs; otherwise there's just a summary\n");
+	exit(-1);
+}
+
+
+static bool addInput(Coverage* self, const char* path, const char* root) {
+	bool retVal = false;
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		Log_errorPosix(errno, "fopen: %s", path);
+		
+	} else {
+		uint32_t magic = 0;
+		bool isCoverage = (fread(&magic, sizeof(magic), 1, file) == 1) && (magic == kCoverageMagic);
+		if (isCoverage) {
+			rewind(file);
+			retVal = readCoverage(self, file, path);
+		}
+		fclose(file);
+		
+		if (isCoverage == false) {
+			retVal = addTrace(self, path, root);
+		}
+	}
+	return retVal;
+}
+
+
+static bool addTrace(Coverage* self, const char* path, const char* root) {
+	bool retVal = false;
+	// there's a FlowReaderBlock buffer inside so it's too big for the stack
+	TraceScan* scan = malloc(sizeof(TraceScan));
+	if (scan == NULL) {
+		Log_error("out of memory");
+		
+	} else if (TraceScan_open(scan, path, root)) {
+		// image indexes are per trace
+		for (uint32_t i = 0; i < self->traceImageCount; i++) {
+			self->traceImages[i] = kTraceImagesNone;
+		}
+		self->lastEntry = 0;
+		self->lastBranch = 0;
+		retVal = TraceScan_run(scan, addBlocks, self);
+		if (scan->droppedChunks) {
+			printf("%s: %llu chunks were dropped; the coverage is from what's left\n", path, scan->droppedChunks);
+		}
+		TraceScan_close(scan);
+	}
+	free(scan);
+	return retVal;
+}
+
+
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context) {
+	bool retVal = true;
+	Coverage* self = context;
+	self->blocks += count;
+	for (uint32_t i = 0; retVal && i < count; i++) {
+		const FlowReaderBlock* block = &blocks[i];
+		if (block->landed != self->lastEntry || block->fc != self->lastBranch) {
+			uint32_t image = TraceImages_find(&scan->images, block->landed);
+			if (image == kTraceImagesNone || block->fc < block->landed) {
+				self->outside++;
+				
+			} else {
+				uint32_t ours = mapImage(self, &scan->images, image);
+				if (ours == kTraceImagesNone) {
+					retVal = false;
+					
+				} else {
+					uint64_t base = scan->images.images[image].base;
+					setBits(&self->images[ours], block->landed - base, block->fc - base);
+				}
+			}
+			self->lastEntry = block->landed;
+			self->lastBranch = block->fc;
+		}
+	}
+	return retVal;
+}
+
+
+static uint32_t mapImage(Coverage* self, TraceImages* images, uint32_t image) {
+	uint32_t retVal = kTraceImagesNone;
+	if (image >= self->traceImageCount) {
+		uint32_t count = images->count;
+		uint32_t* traceImages = realloc(self->traceImages, count * sizeof(uint32_t));
+		if (traceImages) {
+			for (uint32_t i = self->traceImageCount; i < count; i++) {
+				traceImages[i] = kTraceImagesNone;
+			}
+			self->traceImages = traceImages;
+			self->traceImageCount = count;
+		}
+	}
+	
+	if (image >= self->traceImageCount) {
+		Log_error("out of memory");
+		
+	} else {
+		retVal = self->traceImages[image];
+		if (retVal == kTraceImagesNone) {
+			TraceImage* i = &images->images[image];
+			const char* path = TraceImages_getPath(images, image);
+			retVal = findImage(self, i->hash, path, (uint32_t) strlen(path), i->base, i->size);
+			self->traceImages[image] = retVal;
+		}
+	}
+	return retVal;
+}
+
+
+static uint32_t findImage(Coverage* self, uint64_t hash, const char* path, uint32_t pathLength, uint64_t base, uint64_t size) {
+	uint32_t retVal = kTraceImagesNone;
+	if (HashMap_lookup(&self->map, hash, &retVal) == false) {
+		if (self->count == self->capacity) {
+			uint32_t capacity = self->capacity ? self->capacity * 2: 64;
+			CoverageImage* images = realloc(self->images, capacity * sizeof(CoverageImage));
+			if (images) {
+				self->images = images;
+				self->capacity = capacity;
+			}
+		}
+		
+		if (self->count == self->capacity) {
+			Log_error("out of memory");
+			
+		} else {
+			CoverageImage* image = &self->images[self->count];
+			memset(image, 0, sizeof(*image));
+			image->hash = hash;
+			image->base = base;
+			image->path = (uint32_t) self->strings.size;
+			if (	TraceBuffer_append(&self->strings, path, pathLength)
+				 && TraceBuffer_append(&self->strings, "", 1)
+				 && HashMap_set(&self->map, hash, self->count)) {
+				retVal = self->count++;
+			}
+		}
+	}
+	
+	if (retVal != kTraceImagesNone && growImage(&self->images[retVal], size) == false) {
+		retVal = kTraceImagesNone;
+	}
+	return retVal;
+}
+
+
+static bool growImage(CoverageImage* image, uint64_t size) {
+	// another run may have had a different build of it; we keep the biggest
+	bool retVal = true;
+	if (size > kCoverageMaxSize) {
+		Log_invalidArgument("image too big: %llu", size);
+		retVal = false;
+		
+	} else if (size > image->size) {
+		uint32_t words = (uint32_t) ((size + 63) / 64);
+		uint64_t* bits = realloc(image->bits, words * sizeof(uint64_t));
+		if (bits == NULL) {
+			Log_error("out of memory");
+			retVal = false;
+			
+		} else {
+			memset(&bits[image->words], 0, (words - image->words) * sizeof(uint64_t));
+			image->bits = bits;
+			image->words = words;
+			image->size = size;
+		}
+	}
+	return retVal;
+}
+
+
+static void setBits(CoverageImage* image, uint64_t start, uint64_t end) {
+	// the branch can only be past the end of the image if the log's wrong
+	if (end >= image->size) {
+		end = image->size - 1;
+	}
+	
+	uint64_t first = start / 64;
+	uint64_t last = end / 64;
+	uint64_t firstMask = ~0ull << (start % 64);
+	uint64_t lastMask = ~0ull >> (63 - (end % 64));
+	if (first == last) {
+		image->bits[first] |= firstMask & lastMask;
+		
+	} else {
+		image->bits[first] |= firstMask;
+		for (uint64_t i = first + 1; i < last; i++) {
+			image->bits[i] = ~0ull;
+		}
+		image->bits[last] |= lastMask;
+	}
+}
+
+
+static bool readCoverage(Coverage* self, FILE* file, const char* path) {
+	bool retVal = false;
+	CoverageFileHeader header = {0};
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.version != kCoverageVersion) {
+		Log_invalidArgument("not a coverage file we know: %s", path);
+		
+	} else {
+		retVal = true;
+		char name[kCoverageMaxPath] = {0};
+		uint64_t* bits = NULL;
+		for (uint32_t i = 0; retVal && i < header.count; i++) {
+			CoverageFileImage entry = {0};
+			uint32_t image = kTraceImagesNone;
+			retVal = false;
+			if (	fread(&entry, sizeof(entry), 1, file) != 1
+				 || entry.pathLength >= sizeof(name)
+				 || entry.words != (entry.size + 63) / 64
+				 || fread(name, 1, entry.pathLength, file) != entry.pathLength) {
+				Log_invalidArgument("corrupt coverage file: %s", path);
+				
+			} else if ((image = findImage(self, entry.hash, name, entry.pathLength, entry.base, entry.size)) != kTraceImagesNone) {
+				// it's at least as big as this one now; so the words line up
+				uint64_t* b = realloc(bits, (entry.words ? entry.words: 1) * sizeof(uint64_t));
+				if (b == NULL) {
+					Log_error("out of memory");
+					
+				} else if (fread(b, sizeof(uint64_t), entry.words, file) != entry.words) {
+					Log_invalidArgument("corrupt coverage file: %s", path);
+					
+				} else {
+					uint64_t* to = self->images[image].bits;
+					for (uint32_t w = 0; w < entry.words; w++) {
+						to[w] |= b[w];
+					}
+					retVal = true;
+				}
+				bits = b ? b: bits;
+			}
+		}
+		free(bits);
+	}
+	return retVal;
+}
+
+
+static bool writeCoverage(Coverage* self, FILE* file) {
+	CoverageFileHeader header = {0};
+	header.magic = kCoverageMagic;
+	header.version = kCoverageVersion;
+	header.count = self->count;
+	bool retVal = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (uint32_t i = 0; retVal && i < self->count; i++) {
+		CoverageImage* image = &self->images[i];
+		const char* path = (const char*) self->strings.data + image->path;
+		CoverageFileImage entry = {0};
+		entry.hash = image->hash;
+		entry.base = image->base;
+		entry.size = image->size;
+		entry.pathLength = (uint32_t) strlen(path);
+		entry.words = image->words;
+		retVal = (	 fwrite(&entry, sizeof(entry), 1, file) == 1
+				  && fwrite(path, 1, entry.pathLength, file) == entry.pathLength
+				  && fwrite(image->bits, sizeof(uint64_t), image->words, file) == image->words);
+	}
+	return retVal;
+}
+
+
+static bool writeDrcov(Coverage* self, FILE* file) {
+	// drcov v2; the basic blocks are the runs of covered bytes, as blocks from different runs overlap
+	fprintf(file, "DRCOV VERSION: 2\n");
+	fprintf(file, "DRCOV FLAVOR: flowtool\n");
+	fprintf(file, "Module Table: version 2, count %u\n", self->count);
+	fprintf(file, "Columns: id, base, end, entry, checksum, timestamp, path\n");
+	for (uint32_t i = 0; i < self->count; i++) {
+		CoverageImage* image = &self->images[i];
+		fprintf(file, "%3u, 0x%016llx, 0x%016llx, 0x0000000000000000, 0x00000000, 0x00000000, %s\n", 
+				i, 
+				image->base, 
+				image->base + image->size, 
+				(const char*) self->strings.data + image->path);
+	}
+	
+	uint64_t count = 0;
+	for (uint32_t pass = 0; pass < 2; pass++) {
+		// the table's size comes first; so count them, then write them
+		if (pass == 1) {
+			fprintf(file, "BB Table: %llu bbs\n", count);
+		}
+		
+		for (uint32_t i = 0; i < self->count; i++) {
+			CoverageImage* image = &self->images[i];
+			uint64_t offset = 0;
+			while (offset < image->size) {
+				uint64_t word = image->bits[offset / 64] >> (offset % 64);
+				if (word == 0) {
+					offset += 64 - (offset % 64);
+					
+				} else {
+					offset += __builtin_ctzll(word);
+					uint64_t start = offset;
+					while (offset < image->size && (offset - start) < kCoverageMaxBasicBlock && (image->bits[offset / 64] & (1ull << (offset % 64)))) {
+						offset++;
+					}
+					
+					if (pass == 0) {
+						count++;
+						
+					} else {
+						// struct { uint32_t start; uint16_t size; uint16_t id; }
+						uint32_t bbStart = (uint32_t) start;
+						uint16_t bbSize = (uint16_t) (offset - start);
+						uint16_t bbId = (uint16_t) i;
+						fwrite(&bbStart, sizeof(bbStart), 1, file);
+						fwrite(&bbSize, sizeof(bbSize), 1, file);
+						fwrite(&bbId, sizeof(bbId), 1, file);
+					}
+				}
+			}
+		}
+	}
+	return ferror(file) == 0;
+}
+
+
+static uint64_t countBits(CoverageImage* image) {
+	uint64_t retVal = 0;
+	for (uint32_t i = 0; i < image->words; i++) {
+		retVal += __builtin_popcountll(image->bits[i]);
+	}
+	return retVal;
+}
+
+
+static void printSummary(Coverage* self) {
+	uint64_t total = 0;
+	uint64_t covered = 0;
+	printf("\n%14s %14s %7s  %s\n", "covered", "size", "%", "image");
+	for (uint32_t i = 0; i < self->count; i++) {
+		CoverageImage* image = &self->images[i];
+		uint64_t bytes = countBits(image);
+		printf("%14llu %14llu %6.2f%%  %s\n",
+			   bytes,
+			   image->size,
+			   image->size ? (100.0 * bytes) / image->size: 0.0,
+			   (const char*) self->strings.data + image->path);
+		total += image->size;
+		covered += bytes;
+	}
+	printf("\n%llu bytes of code covered in %u images", covered, self->count);
+	if (self->blocks) {
+		printf(", from %llu blocks run; %llu outside any image we know", self->blocks, self->outside);
+	}
+	printf("\n");
+}
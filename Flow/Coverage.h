@@ -0,0 +1,51 @@
+//
+//  Coverage.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_Coverage_h
+#define Flow_Coverage_h
+
+
+
+
+/*
+ * flowtool coverage; which bytes of each image a trace ran, as a bitmap per image
+ * (a bit per byte, set from each block's entry to its branch).  Bitmaps from many 
+ * runs are OR'd together, whether from the traces themselves or from .cov files
+ * written earlier, and written out as a .cov file or as drcov for binary coverage
+ * tools (lighthouse, bncov etc).
+ */
+
+
+
+
+/*
+ * Exported function definitions
+ */
+int Coverage_main(int argc, char* argv[]);
+
+
+#endif
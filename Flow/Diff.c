@@ -0,0 +1,686 @@
+//
+//  Diff.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Diff.h"
+#include "TraceScan.h"
+#include "HashMap.h"
+#include "HashSet.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kDiffWindow			(65536)		// units each side reads ahead looking for the two to agree again
+#define kDiffDefaultRegions	(10)
+#define kDiffRegionLines	(8)			// units listed for each side of a region
+#define kDiffStackLines		(8)			// calls listed leading to the first divergence
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sOptions {
+	const char*	root;
+	uint32_t	thread;			// which to compare; in the order they first appear
+	uint32_t	regions;		// to list; 0 for all of them
+	const char*	traceFilenames[2];
+} Options;
+
+
+/*
+ * What a frame runs is split into units; one of its own blocks and, if that's a call, 
+ * every block until the call returns.  So two units with the same hash ran the same.
+ */
+typedef struct sDiffUnit {
+	uint64_t	hash;
+	uint64_t	seq;			// of its first block
+	uint64_t	entry;			// its first block
+	uint64_t	callee;			// the first block of the call it makes; 0 if it doesn't
+	uint64_t	blocks;
+	uint32_t	image;
+	uint32_t	symbol;
+	uint32_t	calleeImage;
+	uint32_t	calleeSymbol;
+} DiffUnit;
+
+
+typedef enum eDiffRead {
+	eDiffRead_unit,
+	eDiffRead_frameEnd,			// the frame returned; the next block is in its caller
+	eDiffRead_finished			// there are no more blocks
+} DiffRead;
+
+
+typedef struct sDiffSide {
+	TraceScan*		scan;
+	const char*		name;
+	uint64_t		thread;
+	uint32_t		next;			// in scan->blocks
+	uint32_t		count;
+	FlowReaderBlock	pending;		// read ahead; the first block of the next unit
+	bool			hasPending;
+	bool			finished;
+	bool			failed;
+	bool			frameEnded;
+	uint64_t		blocks;
+	
+	DiffUnit*		units;			// a ring of kDiffWindow; the ones waiting to be compared
+	uint64_t		head;			// absolute indexes
+	uint64_t		tail;
+	HashMap			map;			// unit hash to (the bottom 32 bits of) its index; while looking for a match
+} DiffSide;
+
+
+typedef struct sDiff {
+	DiffSide	sides[2];
+	uint32_t	level;			// the call depth whose units we're comparing
+	uint64_t*	calls;			// the call made at each depth, while the two agree
+	uint32_t	callCapacity;
+	uint64_t	common;			// blocks the same in both
+	uint32_t	regions;
+	uint32_t	maxRegions;
+	uint64_t	only[2];		// blocks in the regions that differ
+} Diff;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void parseOptions(Options* options, int argc, char* argv[]);
+static void usage(void);
+static bool openSide(DiffSide* side, const char* path, const char* root, uint32_t thread);
+static void closeSide(DiffSide* side);
+static bool findThread(TraceScan* scan, uint32_t index, uint64_t* thread);
+static bool nextBlock(DiffSide* side, FlowReaderBlock* block);
+static bool takeBlock(DiffSide* side, FlowReaderBlock* block);
+static inline uint64_t mix(uint64_t h);
+static uint64_t blockKey(DiffSide* side, const FlowReaderBlock* block, uint32_t* image);
+static bool findDivergence(Diff* self);
+static bool addCall(Diff* self, const FlowReaderBlock* block);
+static DiffRead readUnit(Diff* self, DiffSide* side, DiffUnit* unit);
+static void fill(Diff* self, DiffSide* side);
+static void compareUnits(Diff* self);
+static void findRegion(Diff* self);
+static bool matchUnit(Diff* self, uint32_t side, uint64_t index, uint64_t* match);
+static void printRegion(Diff* self, uint64_t end[2]);
+static void printUnit(DiffSide* side, char prefix, DiffUnit* unit);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+int Diff_main(int argc, char* argv[]) {
+	int retVal = -1;
+	Options options = {0};
+	parseOptions(&options, argc, argv);
+	
+	Diff diff = {0};
+	diff.maxRegions = options.regions;
+	if (	openSide(&diff.sides[0], options.traceFilenames[0], options.root, options.thread)
+		 && openSide(&diff.sides[1], options.traceFilenames[1], options.root, options.thread)) {
+		printf("--- %s thread %llx\n", diff.sides[0].name, diff.sides[0].thread);
+		printf("+++ %s thread %llx\n", diff.sides[1].name, diff.sides[1].thread);
+		if (findDivergence(&diff)) {
+			compareUnits(&diff);
+		}
+		
+		// whichever has blocks left over ran them on its own
+		for (uint32_t i = 0; i < 2; i++) {
+			FlowReaderBlock block = {0};
+			while (takeBlock(&diff.sides[i], &block)) {
+				diff.only[i]++;
+			}
+		}
+		
+		if (diff.sides[0].failed == false && diff.sides[1].failed == false) {
+			printf("\n%llu blocks the same; %u regions differ, %llu blocks only in %s and %llu only in %s\n",
+				   diff.common,
+				   diff.regions,
+				   diff.only[0],
+				   diff.sides[0].name,
+				   diff.only[1],
+				   diff.sides[1].name);
+			for (uint32_t i = 0; i < 2; i++) {
+				if (diff.sides[i].scan->droppedChunks) {
+					printf("%s dropped %llu chunks\n", diff.sides[i].name, diff.sides[i].scan->droppedChunks);
+				}
+			}
+			// like diff(1)
+			retVal = (diff.only[0] || diff.only[1]) ? 1: 0;
+		}
+	}
+	closeSide(&diff.sides[0]);
+	closeSide(&diff.sides[1]);
+	free(diff.calls);
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void parseOptions(Options* options, int argc, char* argv[]) {
+	options->root = "";
+	options->regions = kDiffDefaultRegions;
+	
+	int c = -1;
+	while ((c = getopt(argc, argv, "r:t:n:")) != -1) {
+		switch (c) {
+			case 'r':
+				options->root = optarg;
+				break;
+				
+			case 't':
+				options->thread = atoi(optarg);
+				break;
+				
+			case 'n':
+				options->regions = atoi(optarg);
+				break;
+				
+			default:
+				usage();
+				break;
+		}
+	}
+	
+	if (optind != argc - 2) {
+		usage();
+	}
+	options->traceFilenames[0] = argv[optind];
+	options->traceFilenames[1] = argv[optind + 1];
+}
+
+
+static void usage(void) {
+	printf("Usage: flowtool diff [-r root] [-t thread] [-n regions] tracefile1 tracefile2\n");
+	printf("    -r: where the traced process's root was; prefixed to image paths to read their symbols\n");
+	printf("    -t: which thread to compare; 0 (the default) is the first in each trace, 1 the next to start etc\n");
+	printf("    -n: how many of the regions which differ to list; 0 for all (default %d)\n", kDiffDefaultRegions);
+	exit(-1);
+}
+
+
+static bool openSide(DiffSide* side, const char* path, const char* root, uint32_t thread) {
+	bool retVal = false;
+	side->name = path;
+	side->scan = malloc(sizeof(TraceScan));
+	side->units = malloc(kDiffWindow * sizeof(DiffUnit));
+	if (side->scan == NULL || side->units == NULL) {
+		Log_error("out of memory");
+		
+	} else if (TraceScan_open(side->scan, path, root)) {
+		if (findThread(side->scan, thread, &side->thread) == false) {
+			Log_error("%s has no thread %u", path, thread);
+			
+		} else {
+			retVal = HashMap_create(&side->map, kDiffWindow * 2);
+		}
+		
+		if (retVal == false) {
+			TraceScan_close(side->scan);
+		}
+	}
+	
+	if (retVal == false) {
+		free(side->scan);
+		side->scan = NULL;
+		side->failed = true;
+	}
+	return retVal;
+}
+
+
+static void closeSide(DiffSide* side) {
+	if (side->scan) {
+		TraceScan_close(side->scan);
+		free(side->scan);
+	}
+	HashMap_release(&side->map);
+	free(side->units);
+	side->scan = NULL;
+	side->units = NULL;
+}
+
+
+static bool findThread(TraceScan* scan, uint32_t index, uint64_t* thread) {
+	// the index'th thread to appear; there's no thread ids in a log from before version 2,
+	// and in later ones thread 0 is the metadata stream which has no blocks
+	bool retVal = false;
+	HashSet seen = {0};
+	if (scan->reader.version < 2) {
+		*thread = 0;
+		retVal = (index == 0);
+		
+	} else if (HashSet_create(&seen, 0)) {
+		uint32_t count = FlowReader_getChunkCount(&scan->reader);
+		for (uint32_t i = 0; retVal == false && i < count; i++) {
+			TraceLogIndexEntry entry = {0};
+			bool added = false;
+			if (	FlowReader_getChunk(&scan->reader, i, &entry)
+				 && (entry.flags & eTraceLogChunkFlag_dropped) == 0
+				 && (entry.thread != 0)
+				 && HashSet_add(&seen, entry.thread, &added)
+				 && added
+				 && seen.count == index + 1) {
+				*thread = entry.thread;
+				retVal = true;
+			}
+		}
+		HashSet_release(&seen);
+	}
+	return retVal;
+}
+
+
+static bool nextBlock(DiffSide* side, FlowReaderBlock* block) {
+	// the thread's next block; false at the end
+	while (side->next == side->count && side->finished == false) {
+		uint32_t count = 0;
+		side->next = 0;
+		side->count = 0;
+		if (TraceScan_next(side->scan, &count) == false) {
+			side->failed = true;
+			side->finished = true;
+			
+		} else if (count == 0) {
+			side->finished = true;
+			
+		} else if (side->scan->chunk.thread == side->thread) {
+			side->count = count;
+		}
+	}
+	
+	bool retVal = (side->next < side->count);
+	if (retVal) {
+		*block = side->scan->blocks[side->next++];
+		side->blocks++;
+	}
+	return retVal;
+}
+
+
+static bool takeBlock(DiffSide* side, FlowReaderBlock* block) {
+	bool retVal = true;
+	if (side->hasPending) {
+		*block = side->pending;
+		side->hasPending = false;
+		
+	} else {
+		retVal = nextBlock(side, block);
+	}
+	return retVal;
+}
+
+
+static inline uint64_t mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+
+static uint64_t blockKey(DiffSide* side, const FlowReaderBlock* block, uint32_t* image) {
+	// the same block in another run has the same key; the image's path and offset into it, as the bases move
+	TraceImages* images = &side->scan->images;
+	uint64_t retVal = block->landed;
+	*image = TraceImages_find(images, block->landed);
+	if (*image != kTraceImagesNone) {
+		retVal = images->images[*image].hash ^ mix(block->landed - images->images[*image].base);
+	}
+	return mix(retVal ^ ((block->fc - block->landed) << 40) ^ ((uint64_t) block->fcType << 62));
+}
+
+
+static bool findDivergence(Diff* self) {
+	// block by block while they agree; true if they then differ
+	bool retVal = false;
+	DiffSide* a = &self->sides[0];
+	DiffSide* b = &self->sides[1];
+	FlowReaderBlock blocks[2] = {{0}};
+	bool same = true;
+	bool hasA = false;
+	bool hasB = false;
+	while (same && (hasA = nextBlock(a, &blocks[0])) && (hasB = nextBlock(b, &blocks[1]))) {
+		uint32_t images[2] = {0};
+		same = (blockKey(a, &blocks[0], &images[0]) == blockKey(b, &blocks[1], &images[1]));
+		if (same) {
+			self->common++;
+			if (blocks[0].fcType == 0x1) {
+				same = addCall(self, &blocks[0]);
+			}
+			
+		} else {
+			// they'll be the first units compared
+			a->pending = blocks[0];
+			b->pending = blocks[1];
+			a->hasPending = true;
+			b->hasPending = true;
+			self->level = blocks[0].depth < blocks[1].depth ? blocks[0].depth: blocks[1].depth;
+			retVal = true;
+			
+			printf("\nfirst divergence after %llu blocks, at depth %u\n", self->common, blocks[0].depth);
+			for (uint32_t i = 0; i < 2; i++) {
+				printf("%c block %llu: ", i ? '+': '-', blocks[i].seq);
+				TraceImages_print(&self->sides[i].scan->images, 
+								  stdout, 
+								  images[i], 
+								  TraceImages_findSymbol(&self->sides[i].scan->images, images[i], blocks[i].landed), 
+								  blocks[i].landed);
+				printf(" - %llx\n", blocks[i].fc);
+			}
+			
+			// the calls were made by the first trace; its images are as they were then
+			uint32_t depth = blocks[0].depth < self->callCapacity ? blocks[0].depth: self->callCapacity;
+			for (uint32_t i = 0; i < depth && i < kDiffStackLines; i++) {
+				uint64_t call = self->calls[depth - i - 1];
+				uint32_t image = TraceImages_find(&a->scan->images, call);
+				if (call == 0) {
+					// the trace started below it
+					printf("  called from ?\n");
+					
+				} else {
+					printf("  called from ");
+					TraceImages_print(&a->scan->images, stdout, image, TraceImages_findSymbol(&a->scan->images, image, call), call);
+					printf("\n");
+				}
+			}
+			if (depth > kDiffStackLines) {
+				printf("  ... and %u more\n", depth - kDiffStackLines);
+			}
+		}
+	}
+	
+	if (same && hasA && hasB == false) {
+		// the second ran out; the first's block is only in it
+		self->only[0]++;
+	}
+	return retVal;
+}
+
+
+static bool addCall(Diff* self, const FlowReaderBlock* block) {
+	bool retVal = true;
+	if (block->depth >= self->callCapacity) {
+		uint32_t capacity = self->callCapacity ? self->callCapacity * 2: 256;
+		while (capacity <= block->depth) {
+			capacity *= 2;
+		}
+		uint64_t* calls = realloc(self->calls, capacity * sizeof(uint64_t));
+		if (calls == NULL) {
+			Log_error("out of memory");
+			retVal = false;
+			
+		} else {
+			memset(&calls[self->callCapacity], 0, (capacity - self->callCapacity) * sizeof(uint64_t));
+			self->calls = calls;
+			self->callCapacity = capacity;
+		}
+	}
+	if (retVal) {
+		self->calls[block->depth] = block->landed;
+	}
+	return retVal;
+}
+
+
+static DiffRead readUnit(Diff* self, DiffSide* side, DiffUnit* unit) {
+	DiffRead retVal = eDiffRead_finished;
+	FlowReaderBlock block = {0};
+	if (takeBlock(side, &block)) {
+		if (block.depth < self->level) {
+			side->pending = block;
+			side->hasPending = true;
+			retVal = eDiffRead_frameEnd;
+			
+		} else {
+			TraceImages* images = &side->scan->images;
+			memset(unit, 0, sizeof(*unit));
+			unit->hash = blockKey(side, &block, &unit->image);
+			unit->symbol = TraceImages_findSymbol(images, unit->image, block.landed);
+			unit->seq = block.seq;
+			unit->entry = block.landed;
+			unit->blocks = 1;
+			unit->calleeImage = kTraceImagesNone;
+			unit->calleeSymbol = kTraceImagesNone;
+			
+			// everything deeper is in the call it makes
+			uint32_t image = 0;
+			while (nextBlock(side, &block)) {
+				if (block.depth <= self->level) {
+					side->pending = block;
+					side->hasPending = true;
+					break;
+				}
+				unit->hash = mix(unit->hash + blockKey(side, &block, &image));
+				if (unit->callee == 0) {
+					unit->callee = block.landed;
+					unit->calleeImage = image;
+					unit->calleeSymbol = TraceImages_findSymbol(images, image, block.landed);
+				}
+				unit->blocks++;
+			}
+			retVal = eDiffRead_unit;
+		}
+	}
+	return retVal;
+}
+
+
+static void fill(Diff* self, DiffSide* side) {
+	if (	(side->head == side->tail)
+		 && (side->frameEnded == false)
+		 && (side->finished == false || side->hasPending)) {
+		DiffRead read = readUnit(self, side, &side->units[side->tail % kDiffWindow]);
+		if (read == eDiffRead_unit) {
+			side->tail++;
+			
+		} else if (read == eDiffRead_frameEnd) {
+			side->frameEnded = true;
+		}
+	}
+}
+
+
+static void compareUnits(Diff* self) {
+	// unit by unit; when they differ find where they agree again
+	DiffSide* a = &self->sides[0];
+	DiffSide* b = &self->sides[1];
+	bool done = false;
+	while (done == false && a->failed == false && b->failed == false) {
+		fill(self, a);
+		fill(self, b);
+		bool hasA = (a->head != a->tail);
+		bool hasB = (b->head != b->tail);
+		if (hasA && hasB && a->units[a->head % kDiffWindow].hash == b->units[b->head % kDiffWindow].hash) {
+			self->common += a->units[a->head % kDiffWindow].blocks;
+			a->head++;
+			b->head++;
+			
+		} else if (hasA || hasB) {
+			findRegion(self);
+			
+		} else if (a->frameEnded && b->frameEnded && self->level) {
+			// both returned; carry on in the caller
+			self->level--;
+			a->frameEnded = false;
+			b->frameEnded = false;
+			
+		} else {
+			// one, or both, finished; anything left is counted as only in it
+			done = true;
+		}
+	}
+}
+
+
+static void findRegion(Diff* self) {
+	// read ahead on both until a unit turns up in both, or neither can go any further
+	uint64_t end[2] = {0};
+	bool found = false;
+	
+	// what's already waiting; the first trace's go in as they are, the second's are looked up
+	DiffSide* a = &self->sides[0];
+	DiffSide* b = &self->sides[1];
+	for (uint64_t i = a->head; i < a->tail; i++) {
+		uint32_t index = 0;
+		uint64_t hash = a->units[i % kDiffWindow].hash;
+		if (HashMap_lookup(&a->map, hash, &index) == false) {
+			(void) HashMap_set(&a->map, hash, (uint32_t) i);
+		}
+	}
+	for (uint64_t i = b->head; found == false && i < b->tail; i++) {
+		uint64_t match = 0;
+		found = matchUnit(self, 1, i, &match);
+		end[0] = match;
+		end[1] = i;
+	}
+	
+	bool progressed = true;
+	while (found == false && progressed) {
+		progressed = false;
+		for (uint32_t i = 0; found == false && i < 2; i++) {
+			DiffSide* side = &self->sides[i];
+			if (	(side->frameEnded == false)
+				 && (side->finished == false || side->hasPending)
+				 && (side->tail - side->head < kDiffWindow)) {
+				DiffRead read = readUnit(self, side, &side->units[side->tail % kDiffWindow]);
+				if (read == eDiffRead_unit) {
+					uint64_t match = 0;
+					side->tail++;
+					found = matchUnit(self, i, side->tail - 1, &match);
+					end[i] = side->tail - 1;
+					end[1 - i] = match;
+					progressed = true;
+					
+				} else if (read == eDiffRead_frameEnd) {
+					side->frameEnded = true;
+				}
+			}
+		}
+	}
+	
+	if (found == false) {
+		// no match in the window, or the frame ended on both; they differ from here to there
+		end[0] = a->tail;
+		end[1] = b->tail;
+	}
+	printRegion(self, end);
+	for (uint32_t i = 0; i < 2; i++) {
+		DiffSide* side = &self->sides[i];
+		for (uint64_t j = side->head; j < end[i]; j++) {
+			self->only[i] += side->units[j % kDiffWindow].blocks;
+		}
+		
+		// everything this region put in the map is still in the ring; take just those out, rather
+		// than clearing the whole map each time
+		for (uint64_t j = side->head; j < side->tail; j++) {
+			(void) HashMap_remove(&side->map, side->units[j % kDiffWindow].hash);
+		}
+		side->head = end[i];
+	}
+	self->regions++;
+}
+
+
+static bool matchUnit(Diff* self, uint32_t side, uint64_t index, uint64_t* match) {
+	// is side's unit waiting in the other; if not it's added to side's map, so the other can find it
+	bool retVal = false;
+	DiffSide* own = &self->sides[side];
+	DiffSide* other = &self->sides[1 - side];
+	uint64_t hash = own->units[index % kDiffWindow].hash;
+	uint32_t found = 0;
+	if (HashMap_lookup(&other->map, hash, &found)) {
+		// the map only has the bottom 32 bits; the window is a lot smaller than that
+		uint64_t i = other->head + (uint32_t) (found - (uint32_t) other->head);
+		if (i < other->tail && other->units[i % kDiffWindow].hash == hash) {
+			*match = i;
+			retVal = true;
+		}
+	}
+	if (retVal == false && HashMap_lookup(&own->map, hash, &found) == false) {
+		(void) HashMap_set(&own->map, hash, (uint32_t) index);
+	}
+	return retVal;
+}
+
+
+static void printRegion(Diff* self, uint64_t end[2]) {
+	if (self->maxRegions == 0 || self->regions < self->maxRegions) {
+		DiffSide* a = &self->sides[0];
+		DiffSide* b = &self->sides[1];
+		printf("\n@@ depth %u", self->level);
+		if (a->head < end[0]) {
+			printf(", block %llu", a->units[a->head % kDiffWindow].seq);
+		}
+		if (b->head < end[1]) {
+			printf(", block %llu", b->units[b->head % kDiffWindow].seq);
+		}
+		printf(" @@\n");
+		
+		for (uint32_t i = 0; i < 2; i++) {
+			DiffSide* side = &self->sides[i];
+			for (uint64_t j = side->head; j < end[i] && j - side->head < kDiffRegionLines; j++) {
+				printUnit(side, i ? '+': '-', &side->units[j % kDiffWindow]);
+			}
+			if (end[i] - side->head > kDiffRegionLines) {
+				printf("%c ... and %llu more\n", i ? '+': '-', end[i] - side->head - kDiffRegionLines);
+			}
+		}
+	}
+}
+
+
+static void printUnit(DiffSide* side, char prefix, DiffUnit* unit) {
+	TraceImages* images = &side->scan->images;
+	printf("%c ", prefix);
+	TraceImages_print(images, stdout, unit->image, unit->symbol, unit->entry);
+	if (unit->callee) {
+		printf(" -> ");
+		TraceImages_print(images, stdout, unit->calleeImage, unit->calleeSymbol, unit->callee);
+	}
+	printf(" (%llu blocks)\n", unit->blocks);
+}
@@ -0,0 +1,52 @@
+//
+//  Diff.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_Diff_h
+#define Flow_Diff_h
+
+
+
+
+/*
+ * flowtool diff; compares a thread in two traces (a good run and a bad one, say).  The 
+ * blocks are compared by image path and offset, so they match even if the images 
+ * loaded at different addresses.  It reports where they first diverge, with the calls
+ * leading there, then each region where they differ as the calls each made; a call 
+ * being compared as a whole by a hash of its blocks.  Memory is bounded by how far 
+ * ahead it looks for the two to agree again, not how long the traces are.
+ */
+
+
+
+
+/*
+ * Exported function definitions
+ */
+int Diff_main(int argc, char* argv[]);
+
+
+#endif
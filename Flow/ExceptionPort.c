@@ -62,7 +62,8 @@ boolean_t mach_exc_server(mach_msg_header_t *InHeadP, mach_msg_header_t *OutHead
 static kern_return_t exceptionPort_attach(ExceptionPort* self, 
 										  task_t task, 
 										  ExceptionPort_onException* onException, 
-										  void* ctx);
+										  void* ctx,
+										  bool catchCrashes);
 static kern_return_t exceptionPort_detach(ExceptionPort* self);
 static kern_return_t exceptionPort_process(ExceptionPort* self);
 
@@ -115,7 +116,8 @@ ExceptionPort* gExceptionPort = NULL;
 kern_return_t ExceptionPort_attachToTask(ExceptionPort* self, 
 										 task_t task, 
 										 ExceptionPort_onException* onException, 
-										 void* ctx) {
+										 void* ctx,
+										 bool catchCrashes) {
 	kern_return_t retVal = KERN_INVALID_VALUE;
 	if (gExceptionPort != NULL || self == NULL || task == TASK_NULL) {
 		Log_invalidArgument("gExceptionPort: %p, self: %p, task: %p", 
@@ -124,7 +126,7 @@ kern_return_t ExceptionPort_attachToTask(ExceptionPort* self,
 							(void*) task);
 		
 	} else {
-		retVal = exceptionPort_attach(self, task, onException, ctx);
+		retVal = exceptionPort_attach(self, task, onException, ctx, catchCrashes);
 		if (retVal == KERN_SUCCESS) {
 			// add this port into the list to process
 			gExceptionPort = self;
@@ -166,7 +168,8 @@ kern_return_t ExceptionPort_process(ExceptionPort* self) {
 static kern_return_t exceptionPort_attach(ExceptionPort* self, 
 										  task_t task, 
 										  ExceptionPort_onException* onException, 
-										  void* ctx) {
+										  void* ctx,
+										  bool catchCrashes) {
 	kern_return_t retVal = mach_port_allocate(mach_task_self(), 
 											  MACH_PORT_RIGHT_RECEIVE, 
 											  &self->exceptionPort);
@@ -182,8 +185,10 @@ static kern_return_t exceptionPort_attach(ExceptionPort* self,
 			Log_errorMach(retVal, "mach_port_insert_right");
 			
 		} else {
+			// crashes only for the flight recorder's trigger; otherwise ReportCrash etc still get them
 			exception_mask_t mask =   EXC_MASK_SOFTWARE
-									| EXC_MASK_BREAKPOINT;
+									| EXC_MASK_BREAKPOINT
+									| (catchCrashes ? EXC_MASK_CRASH: 0);
 			// get the old exception port to allow us to restore it
 			self->originalExceptionPort.count = (  sizeof(self->originalExceptionPort.port)
 												 / sizeof(self->originalExceptionPort.port[0]));
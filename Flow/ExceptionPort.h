@@ -29,6 +29,7 @@
 
 
 #include <mach/mach.h>
+#include <stdbool.h>
 
 #include "Exception.h"
 
@@ -71,7 +72,8 @@ typedef struct sExceptionPort {
 kern_return_t ExceptionPort_attachToTask(ExceptionPort* self, 
 										 task_t task, 
 										 ExceptionPort_onException* onException, 
-										 void* ctx);
+										 void* ctx,
+										 bool catchCrashes);
 kern_return_t ExceptionPort_detachFromTask(ExceptionPort* self);
 
 kern_return_t ExceptionPort_process(ExceptionPort* self);
@@ -0,0 +1,400 @@
+//
+//  Export.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "Export.h"
+#include "TraceScan.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kExportUnknownFrame		"?"		// entered before the trace (or its chunk) started
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef enum eExportFormat {
+	eExportFormat_chrome,
+	eExportFormat_folded
+} ExportFormat;
+
+
+typedef struct sOptions {
+	const char*		root;
+	ExportFormat	format;
+	const char*		outputFilename;		// NULL for stdout
+	const char*		traceFilename;
+} Options;
+
+
+/*
+ * Calls and rets come from each block's depth; so a thread's chunk starting part way 
+ * down its calls, or a ret above where the trace started, is handled like anywhere else.
+ */
+typedef struct sExportThread {
+	uint64_t	id;
+	uint32_t	depth;			// of its last block
+	uint32_t	open;			// slices (or frames) we've started and not yet ended
+	uint64_t	seq;			// of its last block
+	uint64_t	weight;			// folded; blocks run since the stack last changed
+	TraceBuffer	stack;			// folded; "thread;frame;frame" with the open frames
+	uint32_t*	lengths;		// of stack before each open frame
+	uint32_t	lengthCapacity;
+} ExportThread;
+
+
+typedef struct sExport {
+	ExportFormat	format;
+	FILE*			file;
+	ExportThread*	threads;
+	uint32_t		threadCount;
+	uint32_t		threadCapacity;
+	uint32_t		last;			// the last block's thread; they come a chunk at a time
+	bool			started;		// chrome; there's been an event, so the next needs a comma
+} Export;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void parseOptions(Options* options, int argc, char* argv[]);
+static void usage(void);
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context);
+static ExportThread* findThread(Export* self, uint64_t id, uint32_t depth);
+static bool enter(Export* self, ExportThread* thread, TraceImages* images, const FlowReaderBlock* block, bool known);
+static void leave(Export* self, ExportThread* thread, uint64_t seq);
+static void flushStack(Export* self, ExportThread* thread);
+static void writeEvent(Export* self, const char* format, ...);
+static void writeString(Export* self, const char* string);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+int Export_main(int argc, char* argv[]) {
+	int retVal = -1;
+	Options options = {0};
+	parseOptions(&options, argc, argv);
+	
+	Export export = {0};
+	export.format = options.format;
+	export.file = stdout;
+	TraceScan* scan = malloc(sizeof(TraceScan));
+	if (scan == NULL) {
+		Log_error("out of memory");
+		
+	} else if (options.outputFilename && (export.file = fopen(options.outputFilename, "w")) == NULL) {
+		Log_errorPosix(errno, "fopen: %s", options.outputFilename);
+		
+	} else if (TraceScan_open(scan, options.traceFilename, options.root)) {
+		if (export.format == eExportFormat_chrome) {
+			// the time of each event is the block's sequence number; blocks rather than microseconds
+			fprintf(export.file, "{\"traceEvents\":[\n");
+			writeEvent(&export, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"");
+			writeString(&export, options.traceFilename);
+			fprintf(export.file, "\"}}");
+		}
+		
+		bool ok = TraceScan_run(scan, addBlocks, &export);
+		
+		// whatever's still open ends with the trace
+		for (uint32_t i = 0; i < export.threadCount; i++) {
+			ExportThread* thread = &export.threads[i];
+			while (thread->open) {
+				leave(&export, thread, thread->seq + 1);
+			}
+			flushStack(&export, thread);
+			TraceBuffer_release(&thread->stack);
+			free(thread->lengths);
+		}
+		if (export.format == eExportFormat_chrome) {
+			fprintf(export.file, "\n]}\n");
+		}
+		
+		if (fflush(export.file) != 0 || ferror(export.file)) {
+			Log_errorPosix(errno, "write: %s", options.outputFilename ? options.outputFilename: "stdout");
+			
+		} else if (ok) {
+			retVal = 0;
+		}
+		TraceScan_close(scan);
+	}
+	
+	if (export.file && export.file != stdout) {
+		fclose(export.file);
+	}
+	free(export.threads);
+	free(scan);
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void parseOptions(Options* options, int argc, char* argv[]) {
+	options->root = "";
+	options->format = eExportFormat_chrome;
+	
+	int c = -1;
+	while ((c = getopt(argc, argv, "r:f:o:")) != -1) {
+		switch (c) {
+			case 'r':
+				options->root = optarg;
+				break;
+				
+			case 'f':
+				if (strcmp(optarg, "folded") == 0) {
+					options->format = eExportFormat_folded;
+					
+				} else if (strcmp(optarg, "chrome") != 0) {
+					usage();
+				}
+				break;
+				
+			case 'o':
+				options->outputFilename = optarg;
+				break;
+				
+			default:
+				usage();
+				break;
+		}
+	}
+	
+	if (optind != argc - 1) {
+		usage();
+	}
+	options->traceFilename = argv[optind];
+}
+
+
+static void usage(void) {
+	printf("Usage: flowtool export [-r root] [-f chrome|folded] [-o outputfile] tracefile\n");
+	printf("    -r: where the traced process's root was; prefixed to image paths to read their symbols\n");
+	printf("    -f: chrome (default); Chrome trace events, for Perfetto or chrome://tracing, with a slice\n");
+	printf("        per call and time in blocks run.  folded; stacks for flamegraph.pl, weighted by blocks run\n");
+	printf("    -o: where to write it; stdout by default\n");
+	exit(-1);
+}
+
+
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context) {
+	bool retVal = true;
+	Export* self = context;
+	ExportThread* thread = findThread(self, scan->chunk.thread, blocks[0].depth);
+	for (uint32_t i = 0; retVal && thread && i < count; i++) {
+		const FlowReaderBlock* block = &blocks[i];
+		if (block->depth > thread->depth) {
+			// only the innermost call is this block's; any others were made before the chunk
+			for (uint32_t d = thread->depth; retVal && d < block->depth; d++) {
+				retVal = enter(self, thread, &scan->images, block, d + 1 == block->depth);
+			}
+			
+		} else {
+			for (uint32_t d = block->depth; thread->open && d < thread->depth; d++) {
+				leave(self, thread, block->seq);
+			}
+		}
+		thread->depth = block->depth;
+		thread->seq = block->seq;
+		thread->weight++;
+	}
+	return retVal && thread;
+}
+
+
+static ExportThread* findThread(Export* self, uint64_t id, uint32_t depth) {
+	// there aren't normally many threads; so we just search
+	ExportThread* retVal = NULL;
+	if (self->last < self->threadCount && self->threads[self->last].id == id) {
+		retVal = &self->threads[self->last];
+	}
+	for (uint32_t i = 0; retVal == NULL && i < self->threadCount; i++) {
+		if (self->threads[i].id == id) {
+			retVal = &self->threads[i];
+			self->last = i;
+		}
+	}
+	
+	if (retVal == NULL) {
+		if (self->threadCount == self->threadCapacity) {
+			uint32_t capacity = self->threadCapacity ? self->threadCapacity * 2: 16;
+			ExportThread* threads = realloc(self->threads, capacity * sizeof(ExportThread));
+			if (threads) {
+				self->threads = threads;
+				self->threadCapacity = capacity;
+			}
+		}
+		
+		if (self->threadCount == self->threadCapacity) {
+			Log_error("out of memory");
+			
+		} else {
+			char name[64] = {0};
+			int length = snprintf(name, sizeof(name), "thread %llx", id);
+			retVal = &self->threads[self->threadCount];
+			memset(retVal, 0, sizeof(*retVal));
+			retVal->id = id;
+			retVal->depth = depth;
+			if (TraceBuffer_create(&retVal->stack, 0) && TraceBuffer_append(&retVal->stack, name, length)) {
+				self->last = self->threadCount++;
+				if (self->format == eExportFormat_chrome) {
+					writeEvent(self, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":\"%s\"}}", id, name);
+				}
+				
+			} else {
+				TraceBuffer_release(&retVal->stack);
+				retVal = NULL;
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static bool enter(Export* self, ExportThread* thread, TraceImages* images, const FlowReaderBlock* block, bool known) {
+	bool retVal = true;
+	char name[kTraceImagesNameSize] = kExportUnknownFrame;
+	uint32_t length = (uint32_t) strlen(name);
+	if (known) {
+		// named after the function, so every call to it is the same frame
+		uint64_t address = block->landed;
+		const char* symbolName = NULL;
+		uint32_t image = TraceImages_find(images, block->landed);
+		uint32_t symbol = TraceImages_findSymbol(images, image, block->landed);
+		if (symbol != kTraceImagesNone) {
+			(void) TraceImages_getSymbol(images, image, symbol, &address, &symbolName);
+		}
+		length = TraceImages_format(images, name, sizeof(name), image, symbol, address);
+	}
+	
+	if (self->format == eExportFormat_chrome) {
+		writeEvent(self, "{\"name\":\"");
+		writeString(self, name);
+		fprintf(self->file, "\",\"ph\":\"B\",\"ts\":%llu,\"pid\":1,\"tid\":%llu}", block->seq, thread->id);
+		
+	} else {
+		flushStack(self, thread);
+		if (thread->open == thread->lengthCapacity) {
+			uint32_t capacity = thread->lengthCapacity ? thread->lengthCapacity * 2: 256;
+			uint32_t* lengths = realloc(thread->lengths, capacity * sizeof(uint32_t));
+			if (lengths) {
+				thread->lengths = lengths;
+				thread->lengthCapacity = capacity;
+			}
+		}
+		
+		if (thread->open == thread->lengthCapacity) {
+			Log_error("out of memory");
+			retVal = false;
+			
+		} else {
+			// ; separates the frames
+			for (uint32_t i = 0; i < length; i++) {
+				name[i] = (name[i] == ';') ? ':': name[i];
+			}
+			thread->lengths[thread->open] = (uint32_t) thread->stack.size;
+			retVal = TraceBuffer_append(&thread->stack, ";", 1) && TraceBuffer_append(&thread->stack, name, length);
+		}
+	}
+	
+	// leave reads lengths[open]; so it's only counted once there's room for it
+	if (retVal) {
+		thread->open++;
+	}
+	return retVal;
+}
+
+
+static void leave(Export* self, ExportThread* thread, uint64_t seq) {
+	thread->open--;
+	if (self->format == eExportFormat_chrome) {
+		writeEvent(self, "{\"ph\":\"E\",\"ts\":%llu,\"pid\":1,\"tid\":%llu}", seq, thread->id);
+		
+	} else {
+		flushStack(self, thread);
+		thread->stack.size = thread->lengths[thread->open];
+	}
+}
+
+
+static void flushStack(Export* self, ExportThread* thread) {
+	// a line each time the stack changes; flamegraph.pl adds up the ones that are the same
+	if (self->format == eExportFormat_folded && thread->weight) {
+		fwrite(thread->stack.data, 1, thread->stack.size, self->file);
+		fprintf(self->file, " %llu\n", thread->weight);
+	}
+	thread->weight = 0;
+}
+
+
+static void writeEvent(Export* self, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	if (self->started) {
+		fputs(",\n", self->file);
+	}
+	vfprintf(self->file, format, args);
+	self->started = true;
+	va_end(args);
+}
+
+
+static void writeString(Export* self, const char* string) {
+	// JSON escaped
+	for (const char* c = string; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			fprintf(self->file, "\\%c", *c);
+			
+		} else if ((unsigned char) *c < 0x20) {
+			fprintf(self->file, "\\u%04x", *c);
+			
+		} else {
+			fputc(*c, self->file);
+		}
+	}
+}
@@ -29,6 +29,7 @@
 #include "TraceLog.h"
 
 #include <mach-o/dyld_images.h>
+#include <signal.h>
 
 
 
@@ -38,6 +39,15 @@
  */
 static void getAllImageInfos32(Flow* self, VMAddr* dyldImageLoadAddress);
 static void getAllImageInfos64(Flow* self, VMAddr* dyldImageLoadAddress);
+static bool isCrashSignal(int signum);
+
+
+
+
+/*
+ * Global variables
+ */
+static volatile sig_atomic_t gTriggerRequested = 0;	// set from a signal handler; so we can't do the work there
 
 
 
@@ -45,11 +55,12 @@ static void getAllImageInfos64(Flow* self, VMAddr* dyldImageLoadAddress);
 /*
  * Exported function implementations
  */
-kern_return_t Flow_create(Flow* self, task_t task, const char* traceFilename) {
+kern_return_t Flow_create(Flow* self, task_t task, const char* traceFilename, TraceLogOptions* traceOptions) {
 	kern_return_t retVal = Task_createWithTask(&self->task, task);
 	if (retVal == KERN_SUCCESS) {
 		self->dyldNotificationFunc = 0;
 		self->dyldAddrLogged = false;
+		self->flightRecorder = (traceOptions->ringChunks != 0);
 
 		bzero(&self->dyldInfoData, sizeof(self->dyldInfoData));
 		retVal = Task_getDyldAllImageInfosAddr(&self->task, &self->dyldInfoData);
@@ -65,7 +76,7 @@ kern_return_t Flow_create(Flow* self, task_t task, const char* traceFilename) {
 			gettimeofday(&self->start, NULL);
 			
 			// create a trace log for this task
-			if (TraceLog_open(&self->traceLog, &self->task, traceFilename) == false) {
+			if (TraceLog_open(&self->traceLog, &self->task, traceFilename, traceOptions) == false) {
 				retVal = KERN_FAILURE;
 			}
 			
@@ -84,6 +95,11 @@ void Flow_release(Flow* self) {
 }
 
 
+void Flow_requestTrigger(void) {
+	gTriggerRequested = 1;
+}
+
+
 ExceptionAction Flow_onException(Flow* self, Exception* exception) {
 	ExceptionAction retVal = eExceptionAction_abortTask;
 	/*
@@ -94,74 +110,94 @@ ExceptionAction Flow_onException(Flow* self, Exception* exception) {
 	printf("\n");
 	*/
 	
-	// if the dyld notification function hasn't been set yet; check again
-	if (self->dyldNotificationFunc == 0) {
-		// we've not hooked the notification handler yet; so check if its been set yet
-		VMAddr dyldImageLoadAddress = 0;
-		self->getAllImageInfos(self, &dyldImageLoadAddress);
-
-		// the first time we get a valid dyldImageLoadAddress; log it
-		if (self->dyldAddrLogged == false && dyldImageLoadAddress != 0) {
-			(void) TraceLog_dyldLoadAddress(&self->traceLog, dyldImageLoadAddress);
-			self->dyldAddrLogged = true;
-		}
+	// the flight recorder triggers
+	if (gTriggerRequested) {
+		gTriggerRequested = 0;
+		(void) TraceLog_trigger(&self->traceLog, eTraceLogTrigger_request, 0, 0);
 	}
 	
-	Thread thread = {0};
-	Thread_initialize(&thread, &self->task, exception->thread, exception->state);
-
-	VMAddr pc = Thread_getPC(&thread);
-	if (pc == self->dyldNotificationFunc) {
-
-			// we've got the params, now log out the content
-		if (TraceLog_libraryNotification(&self->traceLog, &thread) == false) {
-			return eExceptionAction_abortTask; // bad error
+	if (self->flightRecorder && exception->type == EXC_CRASH) {
+		// theres nothing to trace on a crash so we let it carry on dying
+		(void) TraceLog_trigger(&self->traceLog, eTraceLogTrigger_crash, 0, 0);
+		retVal = eExceptionAction_continue;
+		
+	} else {
+		int signum = Exception_softwareSignal(exception);
+		if (self->flightRecorder && isCrashSignal(signum)) {
+			Thread crashed = {0};
+			Thread_initialize(&crashed, &self->task, exception->thread, exception->state);
+			(void) TraceLog_trigger(&self->traceLog, eTraceLogTrigger_signal, signum, Thread_getPC(&crashed));
 		}
+		
+		// if the dyld notification function hasn't been set yet; check again
+		if (self->dyldNotificationFunc == 0) {
+			// we've not hooked the notification handler yet; so check if its been set yet
+			VMAddr dyldImageLoadAddress = 0;
+			self->getAllImageInfos(self, &dyldImageLoadAddress);
 			
-		// calculate our performance
-		struct timeval end = {0};
-		gettimeofday(&end, NULL);
-		double x_ms = (double)self->start.tv_sec + (double)self->start.tv_usec/1000000;
-		double y_ms = (double)end.tv_sec + (double)end.tv_usec/1000000;
-		double diff = (double)y_ms - (double)x_ms;
-		printf("t %f\n", diff);
-		self->start.tv_sec = end.tv_sec;
-		self->start.tv_usec = end.tv_usec;
-	}
-
-	/*
-	 * This deals with branch stepping.  
-	 *
-	 * If we're in single step mode we search forward from pc until we find a branch instruction.  
-	 * We then disable single step mode, setup a hw breakpoint on the branch instruction and log 
-	 * out the block between pc and the branch.  The process will then run until the branch.
-	 *
-	 * If we're not in single step mode we've just hit a branch instruction.  Thus, we set single
-	 * step and disable the hw breakpoint.  We then perform a step (over the branch) and repeat
-	 * (running the signle step logic above).
-	 *
-	 * What this means is that after a single step pc rests at the first instruction of a new block, 
-	 * we search forward until we find a branch (which ends the block) and log it.  We run the the 
-	 * block at native speed and when its complete single step to find where the branch took us.
-	 */
-	bool singleStep = false;
-	if (Thread_getSingleStep(&thread, &singleStep) == KERN_SUCCESS) {
-		if (singleStep) {
-			Block block = {0};
-			if (	(Thread_findNextBranch(&thread, &block) == KERN_SUCCESS)
-				 && (Thread_setSingleStep(&thread, false) == KERN_SUCCESS)
-				 && (Thread_setBreakpoint(&thread, block.branch) == KERN_SUCCESS)) {
-				
-				// log block record
-				if (TraceLog_block(&self->traceLog, &block)) {
-					retVal = eExceptionAction_continue;
-				}
+			// the first time we get a valid dyldImageLoadAddress; log it
+			if (self->dyldAddrLogged == false && dyldImageLoadAddress != 0) {
+				(void) TraceLog_dyldLoadAddress(&self->traceLog, dyldImageLoadAddress);
+				self->dyldAddrLogged = true;
+			}
+		}
+		
+		Thread thread = {0};
+		Thread_initialize(&thread, &self->task, exception->thread, exception->state);
+		
+		VMAddr pc = Thread_getPC(&thread);
+		if (pc == self->dyldNotificationFunc) {
+			
+				// we've got the params, now log out the content
+			if (TraceLog_libraryNotification(&self->traceLog, &thread) == false) {
+				return eExceptionAction_abortTask; // bad error
 			}
-		} else {
-			if (	(Thread_setSingleStep(&thread, true) == KERN_SUCCESS)
-				 && (Thread_clearBreakpoint(&thread) == KERN_SUCCESS)) {
-				retVal = eExceptionAction_continue;		
 				
+			// calculate our performance
+			struct timeval end = {0};
+			gettimeofday(&end, NULL);
+			double x_ms = (double)self->start.tv_sec + (double)self->start.tv_usec/1000000;
+			double y_ms = (double)end.tv_sec + (double)end.tv_usec/1000000;
+			double diff = (double)y_ms - (double)x_ms;
+			printf("t %f\n", diff);
+			self->start.tv_sec = end.tv_sec;
+			self->start.tv_usec = end.tv_usec;
+		}
+		
+		/*
+		 * This deals with branch stepping.  
+		 *
+		 * If we're in single step mode we search forward from pc until we find a branch instruction.  
+		 * We then disable single step mode, setup a hw breakpoint on the branch instruction and log 
+		 * out the block between pc and the branch.  The process will then run until the branch.
+		 *
+		 * If we're not in single step mode we've just hit a branch instruction.  Thus, we set single
+		 * step and disable the hw breakpoint.  We then perform a step (over the branch) and repeat
+		 * (running the signle step logic above).
+		 *
+		 * What this means is that after a single step pc rests at the first instruction of a new block, 
+		 * we search forward until we find a branch (which ends the block) and log it.  We run the the 
+		 * block at native speed and when its complete single step to find where the branch took us.
+		 */
+		bool singleStep = false;
+		if (Thread_getSingleStep(&thread, &singleStep) == KERN_SUCCESS) {
+			if (singleStep) {
+				Block block = {0};
+				if (	(Thread_findNextBranch(&thread, &block) == KERN_SUCCESS)
+					 && (Thread_setSingleStep(&thread, false) == KERN_SUCCESS)
+					 && (Thread_setBreakpoint(&thread, block.branch) == KERN_SUCCESS)) {
+					
+					// log block record
+					if (TraceLog_block(&self->traceLog, &thread, &block)) {
+						retVal = eExceptionAction_continue;
+					}
+				}
+			} else {
+				if (	(Thread_setSingleStep(&thread, true) == KERN_SUCCESS)
+					 && (Thread_clearBreakpoint(&thread) == KERN_SUCCESS)) {
+					retVal = eExceptionAction_continue;		
+					
+				}
 			}
 		}
 	}
@@ -174,6 +210,14 @@ ExceptionAction Flow_onException(Flow* self, Exception* exception) {
 /*
  * Static function implementations
  */
+static bool isCrashSignal(int signum) {
+	return (	(signum == SIGSEGV)
+			 || (signum == SIGBUS)
+			 || (signum == SIGILL)
+			 || (signum == SIGFPE)
+			 || (signum == SIGABRT)
+			 || (signum == SIGSYS));
+}
 
 
 /*
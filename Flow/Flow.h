@@ -58,6 +58,7 @@ struct sFlow {
 
 	VMAddr						dyldNotificationFunc;
 	bool						dyldAddrLogged;
+	bool						flightRecorder;		// crashes trigger a dump; otherwise they're left alone
 	
 	task_dyld_info_data_t		dyldInfoData;
 	GetAllImageInfos*			getAllImageInfos;
@@ -71,8 +72,9 @@ struct sFlow {
 /*
  * Exported function definitions
  */
-kern_return_t Flow_create(Flow* self, task_t task, const char* traceFilename);
+kern_return_t Flow_create(Flow* self, task_t task, const char* traceFilename, TraceLogOptions* traceOptions);
 void Flow_release(Flow* self);
+void Flow_requestTrigger(void);
 ExceptionAction Flow_onException(Flow* self, Exception* exception);
 
 
@@ -0,0 +1,675 @@
+//
+//  FlowReader.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FlowReader.h"
+#include "TraceCompress.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static inline uint64_t read64(const uint8_t* p);
+static inline bool isBlockRecord(uint8_t type);
+static bool readIndex(FlowReader* self);
+static void resetChunk(FlowReader* self);
+static bool readVarint(const uint8_t** p, const uint8_t* end, uint64_t* value);
+static bool readVarintTail(uint8_t first, const uint8_t** p, const uint8_t* end, uint64_t* value);
+static bool readBlock(uint8_t type, bool hasLanded, const uint8_t** p, const uint8_t* end, FlowReaderBlock* block);
+static bool skipMeta(uint8_t type, const uint8_t** p, const uint8_t* end);
+static bool skipBytes(const uint8_t** p, const uint8_t* end, uint64_t length);
+static void addBlock(FlowReader* self, FlowReaderBlock* out, const FlowReaderBlock* block);
+static bool defineBlock(FlowReader* self, const FlowReaderBlock* block);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+uint64_t FlowReader_getSize(void) {
+	// so bindings (which don't see the struct) can allocate one
+	return sizeof(FlowReader);
+}
+
+
+bool FlowReader_open(FlowReader* self, const char* path) {
+	bool retVal = false;
+	if (self == NULL || path == NULL) {
+		Log_invalidArgument("self: %p, path: %p", self, path);
+		
+	} else {
+		memset(self, 0, sizeof(*self));
+		self->fd = open(path, O_RDONLY);
+		if (self->fd == -1) {
+			Log_errorPosix(errno, "open: %s", path);
+			
+		} else {
+			struct stat st = {0};
+			if (fstat(self->fd, &st) == -1) {
+				Log_errorPosix(errno, "fstat: %s", path);
+				
+			} else if (st.st_size < (off_t) sizeof(uint32_t)) {
+				Log_error("not a log: %s", path);
+				
+			} else {
+				void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, self->fd, 0);
+				if (map == MAP_FAILED) {
+					Log_errorPosix(errno, "mmap: %s", path);
+					
+				} else {
+					self->map = map;
+					self->mapSize = st.st_size;
+					(void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+					
+					TraceLogHeader header = {0};
+					(void) memcpy(&header, self->map, self->mapSize < sizeof(header) ? self->mapSize: sizeof(header));
+					if (header.magic == kTraceLogMagic && self->mapSize >= sizeof(header)) {
+						self->version = header.version;
+						self->format = header.format;
+						self->cpuType = header.cpuType;
+						self->flags = header.flags;
+						self->headerSize = sizeof(header);
+						
+					} else {
+						// older logs start directly with the cpuType
+						self->format = eTraceLogFormat_raw;
+						self->cpuType = header.magic;
+						self->headerSize = sizeof(uint32_t);
+					}
+					
+					if (TraceBuffer_create(&self->decompressed, 0)) {
+						retVal = readIndex(self);
+					}
+				}
+			}
+		}
+		
+		if (retVal == false) {
+			FlowReader_close(self);
+		}
+	}
+	return retVal;
+}
+
+
+uint32_t FlowReader_getChunkCount(FlowReader* self) {
+	return self->indexCount;
+}
+
+
+bool FlowReader_getChunk(FlowReader* self, uint32_t index, TraceLogIndexEntry* entry) {
+	bool retVal = false;
+	if (index >= self->indexCount || entry == NULL) {
+		Log_invalidArgument("index: %u, entry: %p", index, entry);
+		
+	} else {
+		*entry = self->index[index];
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+bool FlowReader_getSummary(FlowReader* self, uint32_t index, const TraceLogChunkSummary** summary) {
+	bool retVal = false;
+	if (self->summaries && index < self->indexCount) {
+		*summary = &self->summaries[index];
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+bool FlowReader_startChunk(FlowReader* self, uint64_t offset) {
+	bool retVal = false;
+	resetChunk(self);
+	if (self->version < 2) {
+		if (offset != self->headerSize) {
+			Log_invalidArgument("offset: %llu; the log has no chunks", offset);
+			
+		} else {
+			self->pos = &self->map[offset];
+			self->end = &self->map[self->mapSize];
+			self->seq = 0;
+			retVal = true;
+		}
+		
+	} else if (	(offset < self->headerSize) 
+			   || (offset > self->mapSize) 
+			   || (self->mapSize - offset < sizeof(TraceLogChunkHeader))) {
+		Log_invalidArgument("offset: %llu", offset);
+		
+	} else {
+		TraceLogChunkHeader header = {0};
+		(void) memcpy(&header, &self->map[offset], sizeof(header));
+		const uint8_t* data = &self->map[offset + sizeof(header)];
+		if (self->mapSize - offset - sizeof(header) < header.size) {
+			// Flow didn't exit cleanly; the records stop where the file does
+			header.size = (uint32_t) (self->mapSize - offset - sizeof(header));
+		}
+		if (header.magic != kTraceLogChunkMagic) {
+			Log_error("no chunk at %llu", offset);
+			
+		} else if (header.flags & eTraceLogChunkFlag_dropped) {
+			// no records; just what was dropped, which the caller can get from the index
+			retVal = true;
+			
+		} else if (header.flags & eTraceLogChunkFlag_compressed) {
+			if (	TraceBuffer_reserve(&self->decompressed, header.rawSize)
+				 && TraceCompress_decompress(data, header.size, self->decompressed.data, header.rawSize)) {
+				self->pos = self->decompressed.data;
+				self->end = &self->decompressed.data[header.rawSize];
+				self->seq = header.firstBlock;
+				retVal = true;
+			}
+			
+		} else {
+			self->pos = data;
+			self->end = &data[header.size];
+			self->seq = header.firstBlock;
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+uint32_t FlowReader_read(FlowReader* self, FlowReaderBlock* blocks, uint32_t capacity, FlowReaderMeta* meta) {
+	uint32_t retVal = 0;
+	if (self == NULL || blocks == NULL || meta == NULL) {
+		Log_invalidArgument("self: %p, blocks: %p, meta: %p", self, blocks, meta);
+		
+	} else {
+		memset(meta, 0, sizeof(*meta));
+		bool stop = false;
+		while (stop == false && retVal < capacity) {
+			if (self->foldRemaining) {
+				// each repeat is the block period blocks back; so the history does the work
+				FlowReaderBlock block = self->history[(self->historyCount - self->foldPeriod) % kTraceLogFoldWindow];
+				addBlock(self, &blocks[retVal++], &block);
+				self->foldRemaining--;
+				
+			} else if (self->pos >= self->end) {
+				stop = true;
+				
+			} else {
+				const uint8_t* p = self->pos;
+				const uint8_t* end = self->end;
+				uint8_t type = *p++;
+				FlowReaderBlock block = {0};
+				bool ok = true;
+				bool consume = true;
+				if (self->format == eTraceLogFormat_branch || ((type & 0x80) && !isBlockRecord(type))) {
+					// blocks before it go back first; they come before it in the trace
+					ok = skipMeta(type, &p, end);
+					if (retVal != 0) {
+						consume = false;
+						
+					} else if (ok) {
+						meta->type = type;
+						meta->data = self->pos + 1;
+						meta->size = p - meta->data;
+					}
+					stop = true;
+					
+				} else if ((type & 0x80) == 0) {
+					if (self->format == eTraceLogFormat_dictionary) {
+						uint64_t id = 0;
+						ok = readVarintTail(type, &p, end, &id);
+						if (ok && id >= self->blockCount) {
+							Log_error("undefined block: %llu", id);
+							ok = false;
+						}
+						if (ok) {
+							block = self->blocks[id];
+						}
+						
+					} else {
+						ok = readBlock(type, false, &p, end, &block);
+					}
+					if (ok) {
+						addBlock(self, &blocks[retVal++], &block);
+					}
+					
+				} else if (type == eTraceLogRecord_return) {
+					// landed where the last ret should have; after the call
+					ok = (end - p >= 2) && self->returnValid;
+					if (ok) {
+						block.landed = self->returnTo + p[0];
+						type = p[1];
+						p += 2;
+						ok = readBlock(type, true, &p, end, &block);
+					}
+					if (ok) {
+						addBlock(self, &blocks[retVal++], &block);
+					}
+					
+				} else if (type == eTraceLogRecord_fold) {
+					uint64_t period = 0;
+					uint64_t count = 0;
+					ok = readVarint(&p, end, &period) && readVarint(&p, end, &count);
+					if (ok && (period == 0 || period > kTraceLogFoldWindow || period > self->historyCount)) {
+						Log_error("bad fold; period: %llu", period);
+						ok = false;
+					}
+					if (ok) {
+						self->foldPeriod = period;
+						self->foldRemaining = period * count;
+					}
+					
+				} else if (type == eTraceLogRecord_blockDefinition) {
+					// gets the next id and also counts as executed
+					ok = (p < end);
+					if (ok) {
+						type = *p++;
+						ok = readBlock(type, false, &p, end, &block) && defineBlock(self, &block);
+					}
+					if (ok) {
+						addBlock(self, &blocks[retVal++], &block);
+					}
+					
+				} else if (type == eTraceLogRecord_sync) {
+					// the start of the chunk; where the thread was in its calls
+					ok = readVarint(&p, end, &self->depth);
+					
+				} else {
+					// eTraceLogRecord_sequence; another thread ran.  The blocks we return are 
+					// always consecutive so they stop here
+					ok = readVarint(&p, end, &self->seq);
+					stop = (retVal != 0);
+				}
+				
+				if (ok == false) {
+					// truncated (Flow didn't exit cleanly) or corrupt; either way the chunk ends here
+					self->pos = self->end;
+					
+				} else if (consume) {
+					self->pos = p;
+				}
+			}
+		}
+	}
+	return retVal;
+}
+
+
+void FlowReader_close(FlowReader* self) {
+	if (self) {
+		if (self->map) {
+			munmap((void*) self->map, self->mapSize);
+		}
+		if (self->fd != -1) {
+			close(self->fd);
+		}
+		free(self->index);
+		free(self->summaries);
+		self->map = NULL;
+		self->fd = -1;
+		self->index = NULL;
+		self->summaries = NULL;
+		self->indexCount = 0;
+		free(self->blocks);
+		self->blocks = NULL;
+		TraceBuffer_release(&self->decompressed);
+	}
+}
+
+
+bool FlowReader_readVarint(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+	// for whoever parses the meta records
+	return readVarint(p, end, value);
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static inline uint64_t read64(const uint8_t* p) {
+	uint64_t value = 0;
+	(void) memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+
+static inline bool isBlockRecord(uint8_t type) {
+	// the records FlowReader_read turns into blocks (or handles itself)
+	return (	(type == eTraceLogRecord_blockDefinition)
+			 || (type == eTraceLogRecord_return)
+			 || (type == eTraceLogRecord_fold)
+			 || (type == eTraceLogRecord_sequence)
+			 || (type == eTraceLogRecord_sync));
+}
+
+
+static bool readIndex(FlowReader* self) {
+	bool retVal = false;
+	TraceLogFooter footer = {0};
+	if (self->mapSize >= self->headerSize + sizeof(footer)) {
+		(void) memcpy(&footer, &self->map[self->mapSize - sizeof(footer)], sizeof(footer));
+	}
+	
+	if (self->version < 2) {
+		// no chunks; the records run from the header to the end of the file
+		self->index = calloc(1, sizeof(TraceLogIndexEntry));
+		if (self->index == NULL) {
+			Log_error("calloc");
+			
+		} else {
+			self->index[0].offset = self->headerSize;
+			self->index[0].size = (uint32_t) (self->mapSize - self->headerSize);
+			self->indexCount = 1;
+			retVal = true;
+		}
+		
+	} else if (	(footer.magic == kTraceLogFooterMagic)
+			   && (footer.indexOffset <= self->mapSize - sizeof(footer))
+			   && (footer.count <= (self->mapSize - sizeof(footer) - footer.indexOffset) / sizeof(TraceLogIndexEntry))) {
+		self->index = malloc((footer.count + 1) * sizeof(TraceLogIndexEntry));
+		if (self->index == NULL) {
+			Log_error("malloc");
+			
+		} else {
+			(void) memcpy(self->index, &self->map[footer.indexOffset], footer.count * sizeof(TraceLogIndexEntry));
+			self->indexCount = footer.count;
+			retVal = true;
+			
+			// the summaries fill the rest of the space before the footer; if there are any
+			uint64_t rest = self->mapSize - sizeof(footer) - footer.indexOffset - (footer.count * sizeof(TraceLogIndexEntry));
+			if (footer.count && rest == footer.count * sizeof(TraceLogChunkSummary)) {
+				self->summaries = malloc(rest);
+				if (self->summaries) {
+					(void) memcpy(self->summaries, &self->map[self->mapSize - sizeof(footer) - rest], rest);
+				}
+			}
+		}
+		
+	} else {
+		// no footer (Flow didn't exit cleanly); walk the chunk headers instead
+		uint32_t capacity = 0;
+		uint64_t offset = self->headerSize;
+		retVal = true;
+		while (retVal && self->mapSize - offset >= sizeof(TraceLogChunkHeader)) {
+			TraceLogChunkHeader header = {0};
+			(void) memcpy(&header, &self->map[offset], sizeof(header));
+			if (header.magic != kTraceLogChunkMagic) {
+				break;
+			}
+			
+			if (self->indexCount == capacity) {
+				capacity = capacity ? capacity * 2: 64;
+				TraceLogIndexEntry* index = realloc(self->index, capacity * sizeof(TraceLogIndexEntry));
+				if (index == NULL) {
+					Log_error("realloc");
+					retVal = false;
+					break;
+				}
+				self->index = index;
+			}
+			
+			TraceLogIndexEntry* entry = &self->index[self->indexCount++];
+			entry->offset = offset;
+			entry->firstBlock = header.firstBlock;
+			entry->timestamp = header.timestamp;
+			entry->thread = header.thread;
+			entry->size = header.size;
+			entry->flags = header.flags;
+			offset += sizeof(header) + header.size;
+			if (offset > self->mapSize) {
+				break; // the last one's truncated; FlowReader_startChunk reads what there is
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static void resetChunk(FlowReader* self) {
+	self->pos = NULL;
+	self->end = NULL;
+	self->seq = 0;
+	self->depth = 0;
+	self->blockCount = 0;
+	self->historyCount = 0;
+	self->foldPeriod = 0;
+	self->foldRemaining = 0;
+	self->returnTop = 0;
+	self->returnCount = 0;
+	self->returnValid = false;
+	self->returnTo = 0;
+}
+
+
+static bool readVarint(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+	bool retVal = false;
+	if (*p < end) {
+		uint8_t first = *(*p)++;
+		retVal = readVarintTail(first, p, end, value);
+	}
+	return retVal;
+}
+
+
+static bool readVarintTail(uint8_t first, const uint8_t** p, const uint8_t* end, uint64_t* value) {
+	// the first byte holds 6 bits (bit 6 is the continuation), the rest hold 7
+	bool retVal = true;
+	uint64_t v = first & 0x3F;
+	uint32_t shift = 6;
+	bool more = (first & 0x40) != 0;
+	while (more) {
+		if (*p >= end || shift >= 64) {
+			retVal = false;
+			break;
+		}
+		uint8_t b = *(*p)++;
+		v |= (uint64_t) (b & 0x7F) << shift;
+		shift += 7;
+		more = (b & 0x80) != 0;
+	}
+	*value = v;
+	return retVal;
+}
+
+
+static bool readBlock(uint8_t type, bool hasLanded, const uint8_t** p, const uint8_t* end, FlowReaderBlock* block) {
+	// |0ttlllll| then landed (unless we know it); fc is landed+l, or follows if l is 0x1F
+	bool retVal = false;
+	uint64_t need = (hasLanded ? 0: sizeof(uint64_t)) + ((type & 0x1F) == 0x1F ? sizeof(uint64_t): 0);
+	if ((uint64_t) (end - *p) >= need) {
+		if (hasLanded == false) {
+			block->landed = read64(*p);
+			*p += sizeof(uint64_t);
+		}
+		block->fc = block->landed + (type & 0x1F);
+		if ((type & 0x1F) == 0x1F) {
+			block->fc = read64(*p);
+			*p += sizeof(uint64_t);
+		}
+		block->fcType = (type & 0x60) >> 5;
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static bool skipMeta(uint8_t type, const uint8_t** p, const uint8_t* end) {
+	bool retVal = true;
+	uint64_t value = 0;
+	uint64_t count = 0;
+	if ((type & 0x80) == 0 || type == eTraceLogRecord_return) {
+		// a branch log's taken bits or return; just the type byte
+		
+	} else if (type == eTraceLogRecord_dyldLoadAddress || type == eTraceLogRecord_branchTarget) {
+		retVal = skipBytes(p, end, sizeof(uint64_t));
+		
+	} else if (type == eTraceLogRecord_branchResync) {
+		retVal = readVarint(p, end, &value) && skipBytes(p, end, sizeof(uint64_t));
+		
+	} else if (	(type == eTraceLogRecord_branchEnd) 
+			   || (type == eTraceLogRecord_sequence) 
+			   || (type == eTraceLogRecord_sync)) {
+		retVal = readVarint(p, end, &value);
+		
+	} else if (type == eTraceLogRecord_libraryNotification) {
+		// uint64_t mode, uint32_t count, then a uint64_t base and uint16_t length path each
+		retVal = skipBytes(p, end, sizeof(uint64_t));
+		if (retVal && (uint64_t) (end - *p) >= sizeof(uint32_t)) {
+			uint32_t infoCount = 0;
+			(void) memcpy(&infoCount, *p, sizeof(infoCount));
+			*p += sizeof(infoCount);
+			for (uint32_t i = 0; retVal && i < infoCount; i++) {
+				uint16_t length = 0;
+				retVal = skipBytes(p, end, sizeof(uint64_t)) && (end - *p >= (long) sizeof(length));
+				if (retVal) {
+					(void) memcpy(&length, *p, sizeof(length));
+					*p += sizeof(length);
+					retVal = skipBytes(p, end, length);
+				}
+			}
+			
+		} else {
+			retVal = false;
+		}
+		
+	} else if (type == eTraceLogRecord_imageSymbols) {
+		// base, size, uuid, then a varint count of (varint offset delta, varint length, name)
+		retVal = skipBytes(p, end, 2 * sizeof(uint64_t) + 16) && readVarint(p, end, &count);
+		for (uint64_t i = 0; retVal && i < count; i++) {
+			retVal = readVarint(p, end, &value) && readVarint(p, end, &value) && skipBytes(p, end, value);
+		}
+		
+	} else if (type == eTraceLogRecord_codePage) {
+		uint32_t size = 0;
+		retVal = skipBytes(p, end, sizeof(uint64_t)) && (end - *p >= (long) sizeof(size));
+		if (retVal) {
+			(void) memcpy(&size, *p, sizeof(size));
+			*p += sizeof(size);
+			retVal = skipBytes(p, end, size);
+		}
+		
+	} else if (type == eTraceLogRecord_codePageMap) {
+		retVal = skipBytes(p, end, 2 * sizeof(uint64_t));
+		
+	} else if (type == eTraceLogRecord_trigger) {
+		retVal = skipBytes(p, end, sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t));
+		
+	} else if (type == eTraceLogRecord_pathDefinition) {
+		retVal = readVarint(p, end, &value) && readVarint(p, end, &value) && skipBytes(p, end, value);
+		
+	} else if (type == eTraceLogRecord_imageNotification) {
+		// varint mode, varint count, then a uint64_t base and varint path id each
+		retVal = readVarint(p, end, &value) && readVarint(p, end, &count);
+		for (uint64_t i = 0; retVal && i < count; i++) {
+			retVal = skipBytes(p, end, sizeof(uint64_t)) && readVarint(p, end, &value);
+		}
+		
+	} else {
+		Log_error("unknown record type: %x", type);
+		retVal = false;
+	}
+	return retVal;
+}
+
+
+static bool skipBytes(const uint8_t** p, const uint8_t* end, uint64_t length) {
+	bool retVal = false;
+	if ((uint64_t) (end - *p) >= length) {
+		*p += length;
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static void addBlock(FlowReader* self, FlowReaderBlock* out, const FlowReaderBlock* block) {
+	out->landed = block->landed;
+	out->fc = block->fc;
+	out->fcType = block->fcType;
+	out->seq = self->seq++;
+	out->depth = (uint32_t) self->depth;
+	self->history[self->historyCount++ % kTraceLogFoldWindow] = *out;
+	
+	// the same as the writer; a ret at the top of the chunk's calls doesn't go above them
+	if (out->fcType == 0x1) {
+		self->depth++;
+		
+	} else if (out->fcType == 0x2 && self->depth) {
+		self->depth--;
+	}
+	
+	if (self->format == eTraceLogFormat_raw) {
+		// the same shadow stack as the writer; calls push, rets pop where we expect to go
+		self->returnValid = false;
+		if (out->fcType == 0x1) {
+			self->returns[self->returnTop] = out->fc;
+			self->returnTop = (self->returnTop + 1) % kTraceLogReturnStackSize;
+			if (self->returnCount < kTraceLogReturnStackSize) {
+				self->returnCount++;
+			}
+			
+		} else if (out->fcType == 0x2 && self->returnCount) {
+			self->returnTop = (self->returnTop + kTraceLogReturnStackSize - 1) % kTraceLogReturnStackSize;
+			self->returnCount--;
+			self->returnTo = self->returns[self->returnTop];
+			self->returnValid = true;
+		}
+	}
+}
+
+
+static bool defineBlock(FlowReader* self, const FlowReaderBlock* block) {
+	bool retVal = true;
+	if (self->blockCount == self->blockCapacity) {
+		uint32_t capacity = self->blockCapacity ? self->blockCapacity * 2: 1024;
+		FlowReaderBlock* blocks = realloc(self->blocks, capacity * sizeof(FlowReaderBlock));
+		if (blocks == NULL) {
+			Log_error("realloc");
+			retVal = false;
+			
+		} else {
+			self->blocks = blocks;
+			self->blockCapacity = capacity;
+		}
+	}
+	
+	if (retVal) {
+		self->blocks[self->blockCount++] = *block;
+	}
+	return retVal;
+}
@@ -0,0 +1,134 @@
+//
+//  FlowReader.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_FlowReader_h
+#define Flow_FlowReader_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "TraceBuffer.h"
+#include "TraceLog.h"
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sFlowReaderBlock {
+	uint64_t	landed;
+	uint64_t	fc;
+	uint64_t	seq;			// its place in the whole trace; across all the threads
+	uint32_t	fcType;			// 0 jump, 1 call, 2 ret, 3 syscall
+	uint32_t	depth;			// calls (less rets) the thread was in when it ran
+} FlowReaderBlock;
+
+
+/*
+ * Any record which isn't a block (or a eTraceLogRecord_sequence/sync); data points at what 
+ * follows its type byte, in the mapped file or the chunk we've decompressed, and is only
+ * valid until the next FlowReader_startChunk.
+ */
+typedef struct sFlowReaderMeta {
+	uint32_t		type;		// a TraceLogRecord (or a branch log's taken bits); 0 if there's no record
+	uint32_t		reserved;
+	const uint8_t*	data;
+	uint64_t		size;
+} FlowReaderMeta;
+
+
+/*
+ * Reads a log written by TraceLog; the file is mapped in and each chunk decoded straight
+ * from the map (or from one buffer we reuse, if it's compressed) into the caller's
+ * FlowReaderBlock's, so nothing is allocated per record.  Only eTraceLogFormat_raw and
+ * eTraceLogFormat_dictionary blocks are decoded; rebuilding a eTraceLogFormat_branch
+ * log needs the code, so all its records are returned as meta records.
+ *
+ * FlowReader_startChunk takes the offset of a chunk (from its TraceLogIndexEntry); logs
+ * from before version 2 have no chunks, so they're read as one starting at headerSize.
+ * After it, FlowReader_read returns blocks until it reaches a meta 
+ * record; it then returns 0 with the record in meta.  It returns 0 with meta->type 0 at
+ * the end of the chunk.  Every block in one call has consecutive sequence numbers.
+ * FlowReader_readVarint reads the varints in a meta record's data.  FlowReader_getSummary
+ * gets a chunk's TraceLogChunkSummary; false if the log doesn't have them.
+ */
+typedef struct sFlowReader {
+	int					fd;
+	const uint8_t*		map;
+	uint64_t			mapSize;
+	
+	uint16_t			version;		// 0 for logs from before the TraceLogHeader
+	uint16_t			format;			// TraceLogFormat
+	uint32_t			cpuType;
+	uint32_t			flags;			// TraceLogFlag's
+	uint64_t			headerSize;
+	TraceLogIndexEntry*	index;			// from the footer, or by walking the chunks if there isn't one
+	TraceLogChunkSummary*	summaries;	// one per index entry; NULL if the log doesn't have them
+	uint32_t			indexCount;
+	
+	// the chunk we're reading
+	TraceBuffer			decompressed;
+	const uint8_t*		pos;
+	const uint8_t*		end;
+	uint64_t			seq;			// of the next block
+	uint64_t			depth;			// and its call depth
+	
+	// decoder state; reset for each chunk
+	FlowReaderBlock*	blocks;			// eTraceLogFormat_dictionary; indexed by id
+	uint32_t			blockCount;
+	uint32_t			blockCapacity;
+	FlowReaderBlock		history[kTraceLogFoldWindow];
+	uint64_t			historyCount;
+	uint64_t			foldPeriod;
+	uint64_t			foldRemaining;	// blocks of a eTraceLogRecord_fold still to return
+	uint64_t			returns[kTraceLogReturnStackSize];	// eTraceLogFormat_raw
+	uint32_t			returnTop;
+	uint32_t			returnCount;
+	bool				returnValid;
+	uint64_t			returnTo;
+} FlowReader;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+uint64_t FlowReader_getSize(void);
+bool FlowReader_open(FlowReader* self, const char* path);
+uint32_t FlowReader_getChunkCount(FlowReader* self);
+bool FlowReader_getChunk(FlowReader* self, uint32_t index, TraceLogIndexEntry* entry);
+bool FlowReader_getSummary(FlowReader* self, uint32_t index, const TraceLogChunkSummary** summary);
+bool FlowReader_startChunk(FlowReader* self, uint64_t offset);
+uint32_t FlowReader_read(FlowReader* self, FlowReaderBlock* blocks, uint32_t capacity, FlowReaderMeta* meta);
+void FlowReader_close(FlowReader* self);
+bool FlowReader_readVarint(const uint8_t** p, const uint8_t* end, uint64_t* value);
+
+
+#endif
@@ -0,0 +1,114 @@
+//
+//  FlowTool.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Profile.h"
+#include "Diff.h"
+#include "Coverage.h"
+#include "Export.h"
+#include "Tree.h"
+#include "Query.h"
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef int (Command_main)(int argc, char* argv[]);
+
+
+typedef struct sCommand {
+	const char*		name;
+	Command_main*	main;
+	const char*		description;
+} Command;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void usage(void);
+
+
+
+
+/*
+ * Global variables
+ */
+static const Command gCommands[] = {
+	{"profile", Profile_main, "the hottest blocks, symbols and images; with how often they ran"},
+	{"diff", Diff_main, "where a thread in two traces diverges, and the calls which differ"},
+	{"coverage", Coverage_main, "which bytes of each image ran, merged across traces; as a bitmap or drcov"},
+	{"export", Export_main, "the calls as Chrome trace events (for Perfetto) or folded stacks (for flamegraphs)"},
+	{"tree", Tree_main, "view the call tree, from an index built the first time"},
+	{"query", Query_main, "find blocks by address, type, thread or callee; from columns built the first time"},
+};
+
+
+
+
+/*
+ * flowtool; analyses a trace natively, in one pass, for when it's too big for FlowCalls.py.
+ * Each command parses its own options (argv[0] is its name).
+ */
+int main(int argc, char* argv[])
+{
+	int retVal = -1;
+	if (argc < 2) {
+		usage();
+	}
+	
+	uint32_t i = 0;
+	while (i < sizeof(gCommands) / sizeof(gCommands[0]) && strcmp(gCommands[i].name, argv[1]) != 0) {
+		i++;
+	}
+	if (i == sizeof(gCommands) / sizeof(gCommands[0])) {
+		usage();
+	}
+	retVal = gCommands[i].main(argc - 1, &argv[1]);
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void usage(void) {
+	printf("Usage: flowtool command [options] tracefile ...\n");
+	for (uint32_t i = 0; i < sizeof(gCommands) / sizeof(gCommands[0]); i++) {
+		printf("    %s: %s\n", gCommands[i].name, gCommands[i].description);
+	}
+	exit(-1);
+}
@@ -0,0 +1,241 @@
+//
+//  HashMap.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "HashMap.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kHashMapMinCapacity	(1024)
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static inline uint64_t hashKey(uint64_t key);
+static bool grow(HashMap* self);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool HashMap_create(HashMap* self, uint32_t capacity) {
+	bool retVal = false;
+	if (self == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		uint32_t size = kHashMapMinCapacity;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		
+		self->keys = calloc(size, sizeof(uint64_t));
+		self->values = malloc(size * sizeof(uint32_t));
+		if (self->keys == NULL || self->values == NULL) {
+			Log_error("calloc");
+			free(self->keys);
+			free(self->values);
+			self->keys = NULL;
+			self->values = NULL;
+			
+		} else {
+			self->capacity = size;
+			self->count = 0;
+			self->hasZero = false;
+			self->zeroValue = 0;
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+bool HashMap_lookup(HashMap* self, uint64_t key, uint32_t* value) {
+	bool retVal = false;
+	if (self && self->keys) {
+		if (key == 0) {
+			retVal = self->hasZero;
+			*value = self->zeroValue;
+			
+		} else {
+			uint32_t mask = self->capacity - 1;
+			uint32_t i = (uint32_t) hashKey(key) & mask;
+			while (self->keys[i] != 0) {
+				if (self->keys[i] == key) {
+					*value = self->values[i];
+					retVal = true;
+					break;
+				}
+				i = (i + 1) & mask;
+			}
+		}
+	}
+	return retVal;
+}
+
+
+bool HashMap_set(HashMap* self, uint64_t key, uint32_t value) {
+	bool retVal = false;
+	if (self == NULL || self->keys == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else if (key == 0) {
+		self->hasZero = true;
+		self->zeroValue = value;
+		retVal = true;
+		
+	} else if ((self->count + 1) * 2 <= self->capacity || grow(self)) {
+		uint32_t mask = self->capacity - 1;
+		uint32_t i = (uint32_t) hashKey(key) & mask;
+		while (self->keys[i] != 0 && self->keys[i] != key) {
+			i = (i + 1) & mask;
+		}
+		if (self->keys[i] == 0) {
+			self->keys[i] = key;
+			self->count++;
+		}
+		self->values[i] = value;
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+bool HashMap_remove(HashMap* self, uint64_t key) {
+	// backward shift deletion; later entries in the run move up, so no tombstones are needed
+	bool retVal = false;
+	if (self && self->keys) {
+		if (key == 0) {
+			retVal = self->hasZero;
+			self->hasZero = false;
+			
+		} else {
+			uint32_t mask = self->capacity - 1;
+			uint32_t i = (uint32_t) hashKey(key) & mask;
+			while (self->keys[i] != 0 && self->keys[i] != key) {
+				i = (i + 1) & mask;
+			}
+			if (self->keys[i] == key) {
+				uint32_t j = i;
+				for (j = (j + 1) & mask; self->keys[j] != 0; j = (j + 1) & mask) {
+					// an entry can fill the hole if its home slot isn't between the hole and where it is
+					uint32_t home = (uint32_t) hashKey(self->keys[j]) & mask;
+					if (((j - home) & mask) >= ((j - i) & mask)) {
+						self->keys[i] = self->keys[j];
+						self->values[i] = self->values[j];
+						i = j;
+					}
+				}
+				self->keys[i] = 0;
+				self->count--;
+				retVal = true;
+			}
+		}
+	}
+	return retVal;
+}
+
+
+void HashMap_reset(HashMap* self) {
+	if (self && self->keys) {
+		(void) memset(self->keys, 0x00, self->capacity * sizeof(uint64_t));
+		self->count = 0;
+		self->hasZero = false;
+	}
+}
+
+
+void HashMap_release(HashMap* self) {
+	if (self) {
+		free(self->keys);
+		free(self->values);
+		self->keys = NULL;
+		self->values = NULL;
+		self->capacity = 0;
+		self->count = 0;
+		self->hasZero = false;
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static inline uint64_t hashKey(uint64_t key) {
+	// the keys are often addresses, or small numbers packed together; so mix well
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return key;
+}
+
+
+static bool grow(HashMap* self) {
+	bool retVal = false;
+	uint32_t capacity = self->capacity * 2;
+	uint64_t* keys = calloc(capacity, sizeof(uint64_t));
+	uint32_t* values = malloc(capacity * sizeof(uint32_t));
+	if (keys == NULL || values == NULL) {
+		Log_error("calloc");
+		free(keys);
+		free(values);
+		
+	} else {
+		uint32_t mask = capacity - 1;
+		for (uint32_t i = 0; i < self->capacity; i++) {
+			if (self->keys[i] != 0) {
+				uint32_t j = (uint32_t) hashKey(self->keys[i]) & mask;
+				while (keys[j] != 0) {
+					j = (j + 1) & mask;
+				}
+				keys[j] = self->keys[i];
+				values[j] = self->values[i];
+			}
+		}
+		free(self->keys);
+		free(self->values);
+		self->keys = keys;
+		self->values = values;
+		self->capacity = capacity;
+		retVal = true;
+	}
+	return retVal;
+}
@@ -0,0 +1,69 @@
+//
+//  HashMap.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_HashMap_h
+#define Flow_HashMap_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+
+/*
+ * An open addressing map from 64bit keys to 32bit values; usually an index into an 
+ * array held elsewhere.  Like HashSet, 0 marks an empty slot so it's tracked separately.
+ */
+typedef struct sHashMap {
+	uint64_t*	keys;
+	uint32_t*	values;
+	uint32_t	capacity;	// always a power of 2
+	uint32_t	count;
+	bool		hasZero;
+	uint32_t	zeroValue;
+} HashMap;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool HashMap_create(HashMap* self, uint32_t capacity);
+bool HashMap_lookup(HashMap* self, uint64_t key, uint32_t* value);
+bool HashMap_set(HashMap* self, uint64_t key, uint32_t value);
+bool HashMap_remove(HashMap* self, uint64_t key);
+void HashMap_reset(HashMap* self);
+void HashMap_release(HashMap* self);
+
+
+#endif
@@ -0,0 +1,189 @@
+//
+//  HashSet.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "HashSet.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kHashSetMinCapacity	(1024)
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static inline uint64_t hashKey(uint64_t key);
+static bool grow(HashSet* self);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool HashSet_create(HashSet* self, uint32_t capacity) {
+	bool retVal = false;
+	if (self == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		uint32_t size = kHashSetMinCapacity;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		
+		self->keys = calloc(size, sizeof(uint64_t));
+		if (self->keys == NULL) {
+			Log_error("calloc");
+			
+		} else {
+			self->capacity = size;
+			self->count = 0;
+			self->hasZero = false;
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+bool HashSet_add(HashSet* self, uint64_t key, bool* added) {
+	bool retVal = false;
+	if (self == NULL || self->keys == NULL || added == NULL) {
+		Log_invalidArgument("self: %p, added: %p", self, added);
+		
+	} else if (key == 0) {
+		*added = (self->hasZero == false);
+		self->hasZero = true;
+		retVal = true;
+		
+	} else if ((self->count + 1) * 2 <= self->capacity || grow(self)) {
+		uint32_t mask = self->capacity - 1;
+		uint32_t i = (uint32_t) hashKey(key) & mask;
+		while (self->keys[i] != 0 && self->keys[i] != key) {
+			i = (i + 1) & mask;
+		}
+		*added = (self->keys[i] == 0);
+		if (*added) {
+			self->keys[i] = key;
+			self->count++;
+		}
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+bool HashSet_contains(HashSet* self, uint64_t key) {
+	bool retVal = false;
+	if (self && self->keys) {
+		if (key == 0) {
+			retVal = self->hasZero;
+			
+		} else {
+			uint32_t mask = self->capacity - 1;
+			uint32_t i = (uint32_t) hashKey(key) & mask;
+			while (self->keys[i] != 0) {
+				if (self->keys[i] == key) {
+					retVal = true;
+					break;
+				}
+				i = (i + 1) & mask;
+			}
+		}
+	}
+	return retVal;
+}
+
+
+void HashSet_reset(HashSet* self) {
+	if (self && self->keys) {
+		(void) memset(self->keys, 0x00, self->capacity * sizeof(uint64_t));
+		self->count = 0;
+		self->hasZero = false;
+	}
+}
+
+
+void HashSet_release(HashSet* self) {
+	if (self) {
+		free(self->keys);
+		self->keys = NULL;
+		self->capacity = 0;
+		self->count = 0;
+		self->hasZero = false;
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static inline uint64_t hashKey(uint64_t key) {
+	// page addresses have no entropy in the bottom bits; so mix well
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return key;
+}
+
+
+static bool grow(HashSet* self) {
+	bool retVal = false;
+	uint32_t capacity = self->capacity * 2;
+	uint64_t* keys = calloc(capacity, sizeof(uint64_t));
+	if (keys == NULL) {
+		Log_error("calloc");
+		
+	} else {
+		uint32_t mask = capacity - 1;
+		for (uint32_t i = 0; i < self->capacity; i++) {
+			if (self->keys[i] != 0) {
+				uint32_t j = (uint32_t) hashKey(self->keys[i]) & mask;
+				while (keys[j] != 0) {
+					j = (j + 1) & mask;
+				}
+				keys[j] = self->keys[i];
+			}
+		}
+		free(self->keys);
+		self->keys = keys;
+		self->capacity = capacity;
+		retVal = true;
+	}
+	return retVal;
+}
@@ -0,0 +1,65 @@
+//
+//  HashSet.h
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_HashSet_h
+#define Flow_HashSet_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+
+/*
+ * An open addressing set of 64bit keys; page addresses, content hashes and the like.  
+ * 0 marks an empty slot so it's tracked separately.
+ */
+typedef struct sHashSet {
+	uint64_t*	keys;
+	uint32_t	capacity;	// always a power of 2
+	uint32_t	count;
+	bool		hasZero;
+} HashSet;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool HashSet_create(HashSet* self, uint32_t capacity);
+bool HashSet_add(HashSet* self, uint64_t key, bool* added);
+bool HashSet_contains(HashSet* self, uint64_t key);
+void HashSet_reset(HashSet* self);
+void HashSet_release(HashSet* self);
+
+
+#endif
@@ -0,0 +1,383 @@
+//
+//  Image.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#include "Image.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kImageMaxStubSections	(8)
+
+
+
+
+/*
+ * Struct definitions
+ */
+typedef struct sStubSection {
+	uint64_t	addr;
+	uint64_t	size;
+	uint32_t	indirectIndex;	// reserved1
+	uint32_t	stubSize;		// reserved2
+} StubSection;
+
+
+/*
+ * Everything we pull out of the load commands; architecture independent
+ */
+typedef struct sLoadCommands {
+	uint64_t	textVmaddr;
+	uint64_t	linkeditVmaddr;
+	uint64_t	linkeditFileoff;
+	uint64_t	end;
+	bool		hasLinkedit;
+	
+	struct symtab_command	symtab;
+	struct dysymtab_command	dysymtab;
+	
+	StubSection	stubs[kImageMaxStubSections];
+	uint32_t	stubCount;
+} LoadCommands;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void parseSegment(LoadCommands* lc, 
+						 const char* segname, 
+						 uint64_t vmaddr, 
+						 uint64_t vmsize, 
+						 uint64_t fileoff);
+static void parseSection(LoadCommands* lc, 
+						 uint32_t flags, 
+						 uint64_t addr, 
+						 uint64_t size, 
+						 uint32_t reserved1, 
+						 uint32_t reserved2);
+static kern_return_t readSymbols(Image* self, Task* task, LoadCommands* lc, bool is64);
+static int compareSymbols(const void* a, const void* b);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+kern_return_t Image_read(Image* self, Task* task, VMAddr base) {
+	kern_return_t retVal = KERN_INVALID_ARGUMENT;
+	if (self == NULL || task == NULL) {
+		Log_invalidArgument("self: %p, task: %p", self, task);
+		
+	} else {
+		bzero(self, sizeof(*self));
+		self->base = base;
+		
+		struct mach_header_64 header = {0};
+		retVal = Task_readMemory(task, base, &header, sizeof(header));
+		if (retVal == KERN_SUCCESS) {
+			bool is64 = (header.magic == MH_MAGIC_64);
+			if (is64 == false && header.magic != MH_MAGIC) {
+				Log_error("not a mach-o image at: %llx", base);
+				retVal = KERN_FAILURE;
+				
+			} else {
+				// read all the load commands in one go
+				uint64_t headerSize = is64 ? sizeof(struct mach_header_64): sizeof(struct mach_header);
+				uint8_t* commands = malloc(header.sizeofcmds);
+				if (commands == NULL) {
+					Log_error("malloc");
+					retVal = KERN_FAILURE;
+					
+				} else {
+					retVal = Task_readMemory(task, base + headerSize, commands, header.sizeofcmds);
+				}
+				
+				LoadCommands lc = {0};
+				uint64_t offset = 0;
+				for (uint32_t i = 0; retVal == KERN_SUCCESS && i < header.ncmds; i++) {
+					struct load_command* cmd = (struct load_command*) &commands[offset];
+					if (	(offset + sizeof(*cmd) > header.sizeofcmds)
+						 || (cmd->cmdsize < sizeof(*cmd))
+						 || (offset + cmd->cmdsize > header.sizeofcmds)) {
+						Log_error("bad load command %u at: %llx", i, base);
+						break;
+					}
+					
+					if (cmd->cmd == LC_SEGMENT_64) {
+						struct segment_command_64* seg = (struct segment_command_64*) cmd;
+						struct section_64* sect = (struct section_64*) (seg + 1);
+						parseSegment(&lc, seg->segname, seg->vmaddr, seg->vmsize, seg->fileoff);
+						for (uint32_t j = 0; j < seg->nsects; j++) {
+							parseSection(&lc, sect[j].flags, sect[j].addr, sect[j].size, sect[j].reserved1, sect[j].reserved2);
+						}
+						
+					} else if (cmd->cmd == LC_SEGMENT) {
+						struct segment_command* seg = (struct segment_command*) cmd;
+						struct section* sect = (struct section*) (seg + 1);
+						parseSegment(&lc, seg->segname, seg->vmaddr, seg->vmsize, seg->fileoff);
+						for (uint32_t j = 0; j < seg->nsects; j++) {
+							parseSection(&lc, sect[j].flags, sect[j].addr, sect[j].size, sect[j].reserved1, sect[j].reserved2);
+						}
+						
+					} else if (cmd->cmd == LC_SYMTAB) {
+						lc.symtab = *((struct symtab_command*) cmd);
+						
+					} else if (cmd->cmd == LC_DYSYMTAB) {
+						lc.dysymtab = *((struct dysymtab_command*) cmd);
+						
+					} else if (cmd->cmd == LC_UUID) {
+						(void) memcpy(self->uuid, ((struct uuid_command*) cmd)->uuid, sizeof(self->uuid));
+					}
+					offset += cmd->cmdsize;
+				}
+				free(commands);
+				
+				if (retVal == KERN_SUCCESS) {
+					self->size = lc.end - lc.textVmaddr;
+					retVal = readSymbols(self, task, &lc, is64);
+				}
+			}
+		}
+		
+		if (retVal != KERN_SUCCESS) {
+			Image_release(self);
+		}
+	}
+	return retVal;
+}
+
+
+void Image_release(Image* self) {
+	if (self) {
+		free(self->symbols);
+		self->symbols = NULL;
+		self->count = 0;
+		
+		free(self->strings);
+		self->strings = NULL;
+		self->stringsSize = 0;
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void parseSegment(LoadCommands* lc, 
+						 const char* segname, 
+						 uint64_t vmaddr, 
+						 uint64_t vmsize, 
+						 uint64_t fileoff) {
+	if (strncmp(segname, SEG_TEXT, sizeof(((struct segment_command*) 0)->segname)) == 0) {
+		lc->textVmaddr = vmaddr;
+		
+	} else if (strncmp(segname, SEG_LINKEDIT, sizeof(((struct segment_command*) 0)->segname)) == 0) {
+		lc->linkeditVmaddr = vmaddr;
+		lc->linkeditFileoff = fileoff;
+		lc->hasLinkedit = true;
+	}
+	
+	if (vmaddr + vmsize > lc->end) {
+		lc->end = vmaddr + vmsize;
+	}
+}
+
+
+static void parseSection(LoadCommands* lc, 
+						 uint32_t flags, 
+						 uint64_t addr, 
+						 uint64_t size, 
+						 uint32_t reserved1, 
+						 uint32_t reserved2) {
+	// stubs are what calls to imported functions actually land on; name them like otool -I does
+	if (	((flags & SECTION_TYPE) == S_SYMBOL_STUBS)
+		 && (reserved2 != 0)
+		 && (lc->stubCount < kImageMaxStubSections)) {
+		StubSection* stubs = &lc->stubs[lc->stubCount++];
+		stubs->addr = addr;
+		stubs->size = size;
+		stubs->indirectIndex = reserved1;
+		stubs->stubSize = reserved2;
+	}
+}
+
+
+static kern_return_t readSymbols(Image* self, Task* task, LoadCommands* lc, bool is64) {
+	kern_return_t retVal = KERN_SUCCESS;
+	
+	/*
+	 * The symbol table offsets are file offsets into __LINKEDIT; this also works for 
+	 * images in the shared cache where all the images share one (huge) __LINKEDIT.
+	 */
+	uint64_t slide = self->base - lc->textVmaddr;
+	VMAddr linkedit = lc->linkeditVmaddr + slide - lc->linkeditFileoff;
+	
+	uint64_t nlistSize = is64 ? sizeof(struct nlist_64): sizeof(struct nlist);
+	uint32_t stubCount = 0;
+	for (uint32_t i = 0; i < lc->stubCount; i++) {
+		stubCount += (uint32_t) (lc->stubs[i].size / lc->stubs[i].stubSize);
+	}
+	
+	uint8_t* nlists = NULL;
+	uint32_t* indirect = NULL;
+	if (lc->hasLinkedit == false || lc->symtab.nsyms == 0) {
+		// nothing to read; not an error
+		
+	} else if (	   ((nlists = malloc(lc->symtab.nsyms * nlistSize)) == NULL)
+				|| ((indirect = malloc((lc->dysymtab.nindirectsyms + 1) * sizeof(uint32_t))) == NULL)
+				|| ((self->symbols = malloc((lc->symtab.nsyms + stubCount) * sizeof(ImageSymbol))) == NULL)) {
+		Log_error("malloc");
+		retVal = KERN_FAILURE;
+		
+	} else {
+		retVal = Task_readMemory(task, linkedit + lc->symtab.symoff, nlists, lc->symtab.nsyms * nlistSize);
+		if (retVal == KERN_SUCCESS && lc->dysymtab.nindirectsyms) {
+			retVal = Task_readMemory(task, 
+									 linkedit + lc->dysymtab.indirectsymoff, 
+									 indirect, 
+									 lc->dysymtab.nindirectsyms * sizeof(uint32_t));
+		}
+	}
+	
+	if (retVal == KERN_SUCCESS && self->symbols) {
+		// the defined symbols; store the string index in name for now
+		uint32_t minStrx = UINT32_MAX;
+		uint32_t maxStrx = 0;
+		for (uint32_t i = 0; i < lc->symtab.nsyms; i++) {
+			uint32_t strx = 0;
+			uint8_t type = 0;
+			uint64_t value = 0;
+			if (is64) {
+				struct nlist_64* nl = &((struct nlist_64*) nlists)[i];
+				strx = nl->n_un.n_strx;
+				type = nl->n_type;
+				value = nl->n_value;
+				
+			} else {
+				struct nlist* nl = &((struct nlist*) nlists)[i];
+				strx = nl->n_un.n_strx;
+				type = nl->n_type;
+				value = nl->n_value;
+			}
+			
+			if (	((type & N_STAB) == 0)
+				 && ((type & N_TYPE) == N_SECT)
+				 && (strx != 0 && strx < lc->symtab.strsize)) {
+				ImageSymbol* sym = &self->symbols[self->count++];
+				sym->offset = value - lc->textVmaddr;
+				sym->name = strx;
+			}
+		}
+		
+		// and the stubs, named after the symbol they call through to
+		for (uint32_t i = 0; i < lc->stubCount; i++) {
+			StubSection* stubs = &lc->stubs[i];
+			for (uint64_t j = 0; j < stubs->size / stubs->stubSize; j++) {
+				uint64_t idx = stubs->indirectIndex + j;
+				if (idx < lc->dysymtab.nindirectsyms) {
+					uint32_t sym = indirect[idx];
+					if (	((sym & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS)) == 0)
+						 && (sym < lc->symtab.nsyms)) {
+						uint32_t strx = is64 ? ((struct nlist_64*) nlists)[sym].n_un.n_strx
+											 : ((struct nlist*) nlists)[sym].n_un.n_strx;
+						if (strx != 0 && strx < lc->symtab.strsize) {
+							ImageSymbol* s = &self->symbols[self->count++];
+							s->offset = stubs->addr + (j * stubs->stubSize) - lc->textVmaddr;
+							s->name = strx;
+						}
+					}
+				}
+			}
+		}
+		
+		for (uint32_t i = 0; i < self->count; i++) {
+			if (self->symbols[i].name < minStrx) {
+				minStrx = self->symbols[i].name;
+			}
+			if (self->symbols[i].name > maxStrx) {
+				maxStrx = self->symbols[i].name;
+			}
+		}
+		
+		/*
+		 * Only read the part of the string table we use; in the shared cache the string 
+		 * table is shared between every image and is many MB.
+		 */
+		if (self->count) {
+			uint64_t end = (uint64_t) maxStrx + PATH_MAX;
+			if (end > lc->symtab.strsize) {
+				end = lc->symtab.strsize;
+			}
+			self->stringsSize = end - minStrx + 1;
+			self->strings = malloc(self->stringsSize);
+			if (self->strings == NULL) {
+				Log_error("malloc");
+				retVal = KERN_FAILURE;
+				
+			} else {
+				retVal = Task_readMemory(task, 
+										 linkedit + lc->symtab.stroff + minStrx, 
+										 self->strings, 
+										 self->stringsSize - 1);
+				self->strings[self->stringsSize - 1] = '\0';
+				for (uint32_t i = 0; i < self->count; i++) {
+					self->symbols[i].name -= minStrx;
+				}
+				qsort(self->symbols, self->count, sizeof(ImageSymbol), compareSymbols);
+			}
+		}
+	}
+	free(nlists);
+	free(indirect);
+	return retVal;
+}
+
+
+static int compareSymbols(const void* a, const void* b) {
+	const ImageSymbol* symA = a;
+	const ImageSymbol* symB = b;
+	int retVal = 0;
+	if (symA->offset < symB->offset) {
+		retVal = -1;
+	} else if (symA->offset > symB->offset) {
+		retVal = 1;
+	}
+	return retVal;
+}
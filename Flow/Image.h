@@ -0,0 +1,74 @@
+//
+//  Image.h
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_Image_h
+#define Flow_Image_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <mach/mach.h>
+
+#include "Task.h"
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sImageSymbol {
+	uint64_t	offset;		// from the image's load address
+	uint32_t	name;		// offset of the name in Image.strings
+} ImageSymbol;
+
+
+/*
+ * What we can find out about a loaded Mach-O image by reading it out of the task; 
+ * its extent, UUID and symbols (both its defined symbols and the names of its stubs).
+ */
+typedef struct sImage {
+	VMAddr			base;
+	uint64_t		size;			// from base to the end of the last segment
+	uint8_t			uuid[16];
+	
+	ImageSymbol*	symbols;		// sorted by offset
+	uint32_t		count;
+	char*			strings;
+	uint64_t		stringsSize;
+} Image;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+kern_return_t Image_read(Image* self, Task* task, VMAddr base);
+void Image_release(Image* self);
+
+
+#endif
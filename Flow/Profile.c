@@ -0,0 +1,419 @@
+//
+//  Profile.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Profile.h"
+#include "TraceScan.h"
+#include "BlockDictionary.h"
+#include "HashMap.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kProfileDefaultCount	(20)		// of each list
+#define kProfileNoSymbol		(0xFFFFFFFFull)
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sOptions {
+	const char*	root;			// prefixed to the image paths in the log
+	uint32_t	count;			// rows in each list; 0 for all of them
+	bool		hasRange;		// only count the blocks which ran something from low to high
+	uint64_t	low;
+	uint64_t	high;
+	const char*	traceFilename;
+} Options;
+
+
+typedef struct sProfileBlock {
+	uint64_t	entry;
+	uint64_t	branch;
+	uint64_t	count;
+	uint32_t	type;			// FlowReaderBlock's fcType
+	uint32_t	image;			// kTraceImagesNone if it wasn't in one we know
+	uint32_t	symbol;
+} ProfileBlock;
+
+
+typedef struct sProfileTotal {
+	uint64_t	count;			// blocks run
+	uint64_t	bytes;			// of code they covered
+	uint32_t	blocks;			// different blocks
+	uint32_t	image;
+	uint32_t	symbol;
+} ProfileTotal;
+
+
+/*
+ * Blocks are told apart by (entry, branch, type), as the dictionary format does; the 
+ * dictionary id indexes blocks.  Each is resolved the first time it's seen, when the
+ * images are as they were when it ran.
+ */
+typedef struct sProfile {
+	BlockDictionary	dictionary;
+	ProfileBlock*	blocks;
+	uint32_t		blockCount;
+	uint32_t		blockCapacity;
+	uint32_t		last;			// the last block; loops run the same one over and over
+	bool			hasRange;
+	uint64_t		low;
+	uint64_t		high;
+	uint64_t		count;
+	uint64_t		bytes;
+} Profile;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void parseOptions(Options* options, int argc, char* argv[]);
+static void usage(void);
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context);
+static bool addBlock(Profile* self, TraceScan* scan, const FlowReaderBlock* block);
+static bool totalSymbols(Profile* self, ProfileTotal** totals, uint32_t* count);
+static bool totalImages(Profile* self, TraceImages* images, ProfileTotal** totals, uint32_t* count);
+static int compareBlocks(const void* a, const void* b);
+static int compareTotals(const void* a, const void* b);
+static void printBlocks(Profile* self, TraceImages* images, uint32_t rows);
+static void printTotals(Profile* self, TraceImages* images, const char* title, ProfileTotal* totals, uint32_t count, uint32_t rows);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+int Profile_main(int argc, char* argv[]) {
+	int retVal = -1;
+	Options options = {0};
+	parseOptions(&options, argc, argv);
+	
+	// there's a FlowReaderBlock buffer inside so it's too big for the stack
+	TraceScan* scan = malloc(sizeof(TraceScan));
+	Profile profile = {0};
+	if (scan == NULL) {
+		Log_error("out of memory");
+		
+	} else if (TraceScan_open(scan, options.traceFilename, options.root)) {
+		profile.hasRange = options.hasRange;
+		profile.low = options.low;
+		profile.high = options.high;
+		if (options.hasRange) {
+			TraceScan_setRange(scan, options.low, options.high);
+		}
+		
+		if (BlockDictionary_create(&profile.dictionary, 0) && TraceScan_run(scan, addBlocks, &profile)) {
+			ProfileTotal* images = NULL;
+			ProfileTotal* symbols = NULL;
+			uint32_t imageCount = 0;
+			uint32_t symbolCount = 0;
+			if (	totalImages(&profile, &scan->images, &images, &imageCount)
+				 && totalSymbols(&profile, &symbols, &symbolCount)) {
+				printf("%s: %llu blocks run, %llu bytes of code; %u different blocks in %u symbols\n",
+					   options.traceFilename,
+					   profile.count,
+					   profile.bytes,
+					   profile.blockCount,
+					   symbolCount);
+				if (scan->droppedChunks) {
+					printf("%llu chunks were dropped; the counts are from what's left\n", scan->droppedChunks);
+				}
+				if (options.hasRange) {
+					printf("only blocks running %llx-%llx; %llu of %u chunks skipped by their summaries\n", 
+						   options.low, 
+						   options.high, 
+						   scan->skippedChunks, 
+						   FlowReader_getChunkCount(&scan->reader));
+				}
+				printTotals(&profile, &scan->images, "image", images, imageCount, options.count);
+				printTotals(&profile, &scan->images, "symbol", symbols, symbolCount, options.count);
+				printBlocks(&profile, &scan->images, options.count);
+				retVal = 0;
+			}
+			free(images);
+			free(symbols);
+		}
+		BlockDictionary_release(&profile.dictionary);
+		free(profile.blocks);
+		TraceScan_close(scan);
+	}
+	free(scan);
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void parseOptions(Options* options, int argc, char* argv[]) {
+	options->root = "";
+	options->count = kProfileDefaultCount;
+	
+	char* end = NULL;
+	int c = -1;
+	while ((c = getopt(argc, argv, "r:n:a:")) != -1) {
+		switch (c) {
+			case 'r':
+				options->root = optarg;
+				break;
+				
+			case 'n':
+				options->count = atoi(optarg);
+				break;
+				
+			case 'a':
+				options->hasRange = true;
+				options->low = strtoull(optarg, &end, 16);
+				options->high = (*end == '-') ? strtoull(end + 1, NULL, 16): options->low;
+				break;
+				
+			default:
+				usage();
+				break;
+		}
+	}
+	
+	if (optind != argc - 1) {
+		usage();
+	}
+	options->traceFilename = argv[optind];
+}
+
+
+static void usage(void) {
+	printf("Usage: flowtool profile [-r root] [-n count] [-a address|low-high] tracefile\n");
+	printf("    -r: where the traced process's root was; prefixed to image paths to read their symbols\n");
+	printf("    -n: how many of the hottest images, symbols and blocks to list; 0 for all (default %d)\n", kProfileDefaultCount);
+	printf("    -a: only the blocks which ran an address (hex), or anything in low to high (inclusive)\n");
+	exit(-1);
+}
+
+
+static bool addBlocks(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context) {
+	bool retVal = true;
+	Profile* self = context;
+	for (uint32_t i = 0; retVal && i < count; i++) {
+		// with a range the chunk might have run it without this block doing so
+		bool inRange = (self->hasRange == false) || (blocks[i].landed <= self->high && blocks[i].fc >= self->low);
+		if (inRange) {
+			self->count++;
+			self->bytes += blocks[i].fc - blocks[i].landed;
+			
+			ProfileBlock* last = &self->blocks[self->last];
+			if (	self->blockCount
+				 && last->entry == blocks[i].landed 
+				 && last->branch == blocks[i].fc 
+				 && last->type == blocks[i].fcType) {
+				last->count++;
+				
+			} else {
+				retVal = addBlock(self, scan, &blocks[i]);
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static bool addBlock(Profile* self, TraceScan* scan, const FlowReaderBlock* block) {
+	bool retVal = false;
+	Block key = {0};
+	key.entry = block->landed;
+	key.branch = block->fc;
+	key.type = block->fcType;
+	
+	uint32_t id = 0;
+	bool added = false;
+	if (BlockDictionary_lookup(&self->dictionary, &key, &id, &added)) {
+		if (added && self->blockCount == self->blockCapacity) {
+			uint32_t capacity = self->blockCapacity ? self->blockCapacity * 2: 4096;
+			ProfileBlock* blocks = realloc(self->blocks, capacity * sizeof(ProfileBlock));
+			if (blocks) {
+				self->blocks = blocks;
+				self->blockCapacity = capacity;
+			}
+		}
+		
+		if (added && self->blockCount == self->blockCapacity) {
+			Log_error("out of memory");
+			
+		} else {
+			if (added) {
+				ProfileBlock* b = &self->blocks[id];
+				b->entry = block->landed;
+				b->branch = block->fc;
+				b->type = block->fcType;
+				b->count = 0;
+				b->image = TraceImages_find(&scan->images, block->landed);
+				b->symbol = TraceImages_findSymbol(&scan->images, b->image, block->landed);
+				self->blockCount++;
+			}
+			self->blocks[id].count++;
+			self->last = id;
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+static bool totalSymbols(Profile* self, ProfileTotal** totals, uint32_t* count) {
+	bool retVal = false;
+	HashMap map = {0};
+	*totals = malloc((self->blockCount ? self->blockCount: 1) * sizeof(ProfileTotal));
+	*count = 0;
+	if (*totals == NULL) {
+		Log_error("out of memory");
+		
+	} else if (HashMap_create(&map, 0)) {
+		retVal = true;
+		for (uint32_t i = 0; retVal && i < self->blockCount; i++) {
+			// a symbol is unique within its image; blocks outside any symbol are lumped by image
+			ProfileBlock* b = &self->blocks[i];
+			uint64_t key = ((uint64_t) b->image << 32) | (b->symbol == kTraceImagesNone ? kProfileNoSymbol: b->symbol);
+			uint32_t t = 0;
+			if (HashMap_lookup(&map, key, &t) == false) {
+				t = (*count)++;
+				memset(&(*totals)[t], 0, sizeof(ProfileTotal));
+				(*totals)[t].image = b->image;
+				(*totals)[t].symbol = b->symbol;
+				retVal = HashMap_set(&map, key, t);
+			}
+			(*totals)[t].count += b->count;
+			(*totals)[t].bytes += (b->branch - b->entry) * b->count;
+			(*totals)[t].blocks++;
+		}
+		HashMap_release(&map);
+	}
+	return retVal;
+}
+
+
+static bool totalImages(Profile* self, TraceImages* images, ProfileTotal** totals, uint32_t* count) {
+	// the image count is small, and never goes down, so it can be indexed directly; the last is for none
+	bool retVal = false;
+	*count = images->count + 1;
+	*totals = calloc(*count, sizeof(ProfileTotal));
+	if (*totals == NULL) {
+		Log_error("out of memory");
+		
+	} else {
+		for (uint32_t i = 0; i < *count; i++) {
+			(*totals)[i].image = (i == images->count) ? kTraceImagesNone: i;
+			(*totals)[i].symbol = kTraceImagesNone;
+		}
+		
+		for (uint32_t i = 0; i < self->blockCount; i++) {
+			ProfileBlock* b = &self->blocks[i];
+			ProfileTotal* t = &(*totals)[b->image == kTraceImagesNone ? images->count: b->image];
+			t->count += b->count;
+			t->bytes += (b->branch - b->entry) * b->count;
+			t->blocks++;
+		}
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static int compareBlocks(const void* a, const void* b) {
+	const ProfileBlock* x = a;
+	const ProfileBlock* y = b;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+
+static int compareTotals(const void* a, const void* b) {
+	const ProfileTotal* x = a;
+	const ProfileTotal* y = b;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+
+static void printBlocks(Profile* self, TraceImages* images, uint32_t rows) {
+	// the blocks array isn't needed in id order any more; it's never allocated when -a matched nothing
+	if (self->blockCount > 0) {
+		qsort(self->blocks, self->blockCount, sizeof(ProfileBlock), compareBlocks);
+	}
+	
+	static const char* types[] = {"jump", "call", "ret", "syscall"};
+	printf("\n%12s %7s %14s  %-7s  %s\n", "count", "%", "bytes", "branch", "block");
+	for (uint32_t i = 0; i < self->blockCount && (rows == 0 || i < rows); i++) {
+		ProfileBlock* b = &self->blocks[i];
+		printf("%12llu %6.2f%% %14llu  %-7s  ",
+			   b->count,
+			   self->count ? (100.0 * b->count) / self->count: 0.0,
+			   (b->branch - b->entry) * b->count,
+			   types[b->type & 3]);
+		TraceImages_print(images, stdout, b->image, b->symbol, b->entry);
+		printf(" - %llx\n", b->branch);
+	}
+}
+
+
+static void printTotals(Profile* self, TraceImages* images, const char* title, ProfileTotal* totals, uint32_t count, uint32_t rows) {
+	qsort(totals, count, sizeof(ProfileTotal), compareTotals);
+	
+	printf("\n%12s %7s %14s %9s  %s\n", "count", "%", "bytes", "blocks", title);
+	for (uint32_t i = 0; i < count && totals[i].count && (rows == 0 || i < rows); i++) {
+		ProfileTotal* t = &totals[i];
+		printf("%12llu %6.2f%% %14llu %9u  ",
+			   t->count,
+			   self->count ? (100.0 * t->count) / self->count: 0.0,
+			   t->bytes,
+			   t->blocks);
+		if (t->symbol != kTraceImagesNone) {
+			uint64_t address = 0;
+			const char* name = NULL;
+			(void) TraceImages_getSymbol(images, t->image, t->symbol, &address, &name);
+			TraceImages_print(images, stdout, t->image, t->symbol, address);
+			
+		} else if (t->image != kTraceImagesNone) {
+			printf("%s", TraceImages_getPath(images, t->image));
+			
+		} else {
+			printf("?");
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,339 @@
+//
+//  Query.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "Query.h"
+#include "Columns.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kQueryBatch				(16384)		// rows filtered at a time; so the matches stay in the cache
+#define kQueryDefaultRows		(20)
+#define kQueryColumnsExtension	".cols"
+#define kQueryTypeCall			(1)			// FlowReaderBlock's fcType
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sOptions {
+	char		directory[PATH_MAX];
+	bool		rebuild;
+	bool		hasEntry;
+	uint64_t	entry;
+	bool		hasRange;
+	uint64_t	low;
+	uint64_t	high;				// exclusive
+	bool		hasType;
+	uint8_t		type;
+	bool		hasThread;
+	uint64_t	thread;
+	bool		hasCallee;
+	uint64_t	callee;
+	uint32_t	rows;				// to print; 0 for none
+	const char*	traceFilename;
+} Options;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void parseOptions(Options* options, int argc, char* argv[]);
+static void usage(void);
+static bool parseType(const char* name, uint8_t* type);
+static uint64_t query(Columns* columns, Options* options, uint64_t* counts);
+static bool calledFrom(Columns* columns, uint64_t row);
+static void filterEqual64(const uint64_t* restrict column, uint64_t value, uint8_t* restrict match, uint32_t count);
+static void filterRange64(const uint64_t* restrict column, uint64_t low, uint64_t high, uint8_t* restrict match, uint32_t count);
+static void filterEqual32(const uint32_t* restrict column, uint32_t value, uint8_t* restrict match, uint32_t count);
+static void filterEqual8(const uint8_t* restrict column, uint8_t value, uint8_t* restrict match, uint32_t count);
+static void printRow(Columns* columns, uint64_t row);
+
+
+
+
+/*
+ * Global variables
+ */
+static const char* gTypeNames[] = {"jump", "call", "ret", "syscall"};
+
+
+
+
+/*
+ * Exported function implementations
+ */
+int Query_main(int argc, char* argv[]) {
+	int retVal = -1;
+	Options options = {0};
+	parseOptions(&options, argc, argv);
+	
+	Columns columns = {0};
+	if (Columns_open(&columns, options.traceFilename, options.directory, options.rebuild)) {
+		uint64_t* counts = calloc(columns.threadCount ? columns.threadCount: 1, sizeof(uint64_t));
+		if (counts == NULL) {
+			Log_error("out of memory");
+			
+		} else {
+			uint64_t total = query(&columns, &options, counts);
+			printf("%s%llu of %llu blocks matched\n", (options.rows && total) ? "\n": "", total, columns.count);
+			if (total) {
+				printf("\n%12s %7s  %s\n", "count", "%", "thread");
+				for (uint32_t i = 0; i < columns.threadCount; i++) {
+					if (counts[i]) {
+						printf("%12llu %6.2f%%  %llx\n", counts[i], (100.0 * counts[i]) / total, columns.threads[i]);
+					}
+				}
+			}
+			retVal = 0;
+		}
+		free(counts);
+		Columns_close(&columns);
+	}
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void parseOptions(Options* options, int argc, char* argv[]) {
+	options->rows = kQueryDefaultRows;
+	
+	char* end = NULL;
+	int c = -1;
+	while ((c = getopt(argc, argv, "be:a:y:t:c:n:")) != -1) {
+		switch (c) {
+			case 'b':
+				options->rebuild = true;
+				break;
+				
+			case 'e':
+				options->hasEntry = true;
+				options->entry = strtoull(optarg, NULL, 16);
+				break;
+				
+			case 'a':
+				options->hasRange = true;
+				options->low = strtoull(optarg, &end, 16);
+				if (*end != '-') {
+					usage();
+				}
+				options->high = strtoull(end + 1, NULL, 16);
+				break;
+				
+			case 'y':
+				options->hasType = true;
+				if (parseType(optarg, &options->type) == false) {
+					usage();
+				}
+				break;
+				
+			case 't':
+				options->hasThread = true;
+				options->thread = strtoull(optarg, NULL, 16);
+				break;
+				
+			case 'c':
+				options->hasCallee = true;
+				options->callee = strtoull(optarg, NULL, 16);
+				break;
+				
+			case 'n':
+				options->rows = atoi(optarg);
+				break;
+				
+			default:
+				usage();
+				break;
+		}
+	}
+	
+	if (optind != argc - 1) {
+		usage();
+	}
+	options->traceFilename = argv[optind];
+	(void) snprintf(options->directory, sizeof(options->directory), "%s%s", options->traceFilename, kQueryColumnsExtension);
+}
+
+
+static void usage(void) {
+	printf("Usage: flowtool query [-b] [-e address] [-a low-high] [-y type] [-t thread] [-c address] [-n rows] tracefile\n");
+	printf("    -b: rebuild the columns (tracefile%s) even if they're up to date\n", kQueryColumnsExtension);
+	printf("    -e: blocks starting at address (hex)\n");
+	printf("    -a: blocks starting in low up to high (hex)\n");
+	printf("    -y: blocks ending in a jump, call, ret or syscall\n");
+	printf("    -t: blocks run by thread (hex)\n");
+	printf("    -c: calls to address (hex); the blocks starting there which a call led to\n");
+	printf("    -n: how many of the matching blocks to print (default %d)\n", kQueryDefaultRows);
+	printf("The filters given must all match; with none every block does\n");
+	exit(-1);
+}
+
+
+static bool parseType(const char* name, uint8_t* type) {
+	bool retVal = false;
+	for (uint8_t i = 0; i < sizeof(gTypeNames) / sizeof(gTypeNames[0]); i++) {
+		if (strcmp(name, gTypeNames[i]) == 0) {
+			*type = i;
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+static uint64_t query(Columns* columns, Options* options, uint64_t* counts) {
+	// each filter is a pass over one column's batch; no branches, so the compiler vectorises them
+	uint64_t retVal = 0;
+	uint8_t match[kQueryBatch] __attribute__((aligned(16)));
+	uint32_t thread = 0;
+	bool anyThread = true;
+	if (options->hasThread) {
+		anyThread = false;
+		for (uint32_t i = 0; i < columns->threadCount; i++) {
+			if (columns->threads[i] == options->thread) {
+				thread = i;
+				anyThread = true;
+			}
+		}
+	}
+	
+	uint32_t printed = 0;
+	for (uint64_t start = 0; anyThread && start < columns->count; start += kQueryBatch) {
+		uint32_t count = (columns->count - start < kQueryBatch) ? (uint32_t) (columns->count - start): kQueryBatch;
+		memset(match, 1, count);
+		if (options->hasEntry) {
+			filterEqual64(&columns->entry[start], options->entry, match, count);
+		}
+		if (options->hasCallee) {
+			filterEqual64(&columns->entry[start], options->callee, match, count);
+		}
+		if (options->hasRange) {
+			filterRange64(&columns->entry[start], options->low, options->high, match, count);
+		}
+		if (options->hasType) {
+			filterEqual8(&columns->type[start], options->type, match, count);
+		}
+		if (options->hasThread) {
+			filterEqual32(&columns->thread[start], thread, match, count);
+		}
+		
+		// matches are usually few and far between; so skip 8 at a time
+		memset(&match[count], 0, (kQueryBatch - count) & 7);
+		for (uint32_t i = 0; i < count; i += 8) {
+			uint64_t eight = 0;
+			memcpy(&eight, &match[i], sizeof(eight));
+			for (uint32_t j = i; eight && j < i + 8; j++) {
+				uint64_t row = start + j;
+				if (match[j] && (options->hasCallee == false || calledFrom(columns, row))) {
+					counts[columns->thread[row]]++;
+					retVal++;
+					if (printed < options->rows) {
+						if (printed++ == 0) {
+							printf("%12s  %-16s %-7s  %-16s %-16s  %s\n", "block", "thread", "type", "entry", "branch", "timestamp");
+						}
+						printRow(columns, row);
+					}
+				}
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static bool calledFrom(Columns* columns, uint64_t row) {
+	// whether the block its thread ran before this one was a call; it's usually the row before
+	bool retVal = false;
+	uint32_t thread = columns->thread[row];
+	uint64_t previous = row;
+	while (previous > 0 && columns->thread[--previous] != thread) {
+	}
+	if (previous < row && columns->thread[previous] == thread) {
+		retVal = (columns->type[previous] == kQueryTypeCall);
+	}
+	return retVal;
+}
+
+
+static void filterEqual64(const uint64_t* restrict column, uint64_t value, uint8_t* restrict match, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		match[i] &= (column[i] == value);
+	}
+}
+
+
+static void filterRange64(const uint64_t* restrict column, uint64_t low, uint64_t high, uint8_t* restrict match, uint32_t count) {
+	// one unsigned compare; anything below low wraps round to above the range
+	uint64_t size = high - low;
+	for (uint32_t i = 0; i < count; i++) {
+		match[i] &= (column[i] - low < size);
+	}
+}
+
+
+static void filterEqual32(const uint32_t* restrict column, uint32_t value, uint8_t* restrict match, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		match[i] &= (column[i] == value);
+	}
+}
+
+
+static void filterEqual8(const uint8_t* restrict column, uint8_t value, uint8_t* restrict match, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		match[i] &= (column[i] == value);
+	}
+}
+
+
+static void printRow(Columns* columns, uint64_t row) {
+	// the block's sequence number, like tree and diff; not the row, which is just where it is in the log
+	printf("%12llu  %-16llx %-7s  %-16llx %-16llx  %llu\n",
+		   columns->seq[row],
+		   columns->threads[columns->thread[row]],
+		   gTypeNames[columns->type[row] & 3],
+		   columns->entry[row],
+		   columns->branch[row],
+		   columns->timestamp[row]);
+}
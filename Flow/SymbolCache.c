@@ -0,0 +1,987 @@
+//
+//  SymbolCache.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#include <mach-o/fat.h>
+#include <libkern/OSByteOrder.h>
+
+#include "SymbolCache.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kSymbolCacheMaxStubSections	(8)
+
+#define kElfClass32				(1)
+#define kElfClass64				(2)
+#define kElfDataLittle			(1)
+#define kElfProgramLoad			(1)		// PT_LOAD
+#define kElfProgramNote			(4)		// PT_NOTE
+#define kElfSectionSymtab		(2)		// SHT_SYMTAB
+#define kElfSectionDynsym		(11)	// SHT_DYNSYM
+#define kElfSymbolFunction		(2)		// STT_FUNC
+#define kElfSymbolIndirect		(10)	// STT_GNU_IFUNC
+#define kElfSectionReserved		(0xFF00)	// SHN_LORESERVE; st_shndx's from here aren't sections
+#define kElfNoteBuildId			(3)		// NT_GNU_BUILD_ID
+
+
+
+
+/*
+ * Struct definitions
+ */
+typedef struct sStubSection {
+	uint64_t	addr;
+	uint64_t	size;
+	uint32_t	indirectIndex;	// reserved1
+	uint32_t	stubSize;		// reserved2
+} StubSection;
+
+
+/*
+ * We don't have elf.h on the Mac; these are the parts of it we need
+ */
+typedef struct sElfHeader {
+	uint8_t		ident[16];
+	uint16_t	type;
+	uint16_t	machine;
+	uint32_t	version;
+} ElfHeader;
+
+
+typedef struct sElf32Header {
+	ElfHeader	common;
+	uint32_t	entry;
+	uint32_t	phoff;
+	uint32_t	shoff;
+	uint32_t	flags;
+	uint16_t	ehsize;
+	uint16_t	phentsize;
+	uint16_t	phnum;
+	uint16_t	shentsize;
+	uint16_t	shnum;
+	uint16_t	shstrndx;
+} Elf32Header;
+
+
+typedef struct sElf64Header {
+	ElfHeader	common;
+	uint64_t	entry;
+	uint64_t	phoff;
+	uint64_t	shoff;
+	uint32_t	flags;
+	uint16_t	ehsize;
+	uint16_t	phentsize;
+	uint16_t	phnum;
+	uint16_t	shentsize;
+	uint16_t	shnum;
+	uint16_t	shstrndx;
+} Elf64Header;
+
+
+typedef struct sElf32Program {
+	uint32_t	type;
+	uint32_t	offset;
+	uint32_t	vaddr;
+	uint32_t	paddr;
+	uint32_t	filesz;
+	uint32_t	memsz;
+	uint32_t	flags;
+	uint32_t	align;
+} Elf32Program;
+
+
+typedef struct sElf64Program {
+	uint32_t	type;
+	uint32_t	flags;
+	uint64_t	offset;
+	uint64_t	vaddr;
+	uint64_t	paddr;
+	uint64_t	filesz;
+	uint64_t	memsz;
+	uint64_t	align;
+} Elf64Program;
+
+
+typedef struct sElf32Section {
+	uint32_t	name;
+	uint32_t	type;
+	uint32_t	flags;
+	uint32_t	addr;
+	uint32_t	offset;
+	uint32_t	size;
+	uint32_t	link;
+	uint32_t	info;
+	uint32_t	addralign;
+	uint32_t	entsize;
+} Elf32Section;
+
+
+typedef struct sElf64Section {
+	uint32_t	name;
+	uint32_t	type;
+	uint64_t	flags;
+	uint64_t	addr;
+	uint64_t	offset;
+	uint64_t	size;
+	uint32_t	link;
+	uint32_t	info;
+	uint64_t	addralign;
+	uint64_t	entsize;
+} Elf64Section;
+
+
+typedef struct sElf32Symbol {
+	uint32_t	name;
+	uint32_t	value;
+	uint32_t	size;
+	uint8_t		info;
+	uint8_t		other;
+	uint16_t	shndx;
+} Elf32Symbol;
+
+
+typedef struct sElf64Symbol {
+	uint32_t	name;
+	uint8_t		info;
+	uint8_t		other;
+	uint16_t	shndx;
+	uint64_t	value;
+	uint64_t	size;
+} Elf64Symbol;
+
+
+typedef struct sElfNote {
+	uint32_t	namesz;
+	uint32_t	descsz;
+	uint32_t	type;
+} ElfNote;
+
+
+/*
+ * What we build a cache from; symbols is NULL if we only want the header (to see if the
+ * cache we have is still good)
+ */
+typedef struct sSymbolCacheBuild {
+	SymbolCacheHeader	header;
+	TraceBuffer*		symbols;		// SymbolCacheEntry's
+	TraceBuffer*		strings;
+} SymbolCacheBuild;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static inline bool inFile(uint64_t size, uint64_t offset, uint64_t length);
+static bool readImage(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, uint32_t cpuType);
+static bool readMachO(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, uint32_t cpuType);
+static bool readMachOSymbols(SymbolCacheBuild* build,
+							 const uint8_t* image,
+							 uint64_t size,
+							 bool is64,
+							 const struct symtab_command* symtab,
+							 const struct dysymtab_command* dysymtab,
+							 const StubSection* stubs,
+							 uint32_t stubCount);
+static void readNlist(const uint8_t* nlists, uint32_t index, bool is64, uint32_t* strx, uint8_t* type, uint64_t* value);
+static bool readElf(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, uint32_t cpuType);
+static bool readElfSymbols(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, bool is64, uint64_t shoff, uint32_t shnum);
+static void readElfNotes(SymbolCacheBuild* build, const uint8_t* notes, uint64_t size);
+static bool addSymbol(SymbolCacheBuild* build, uint64_t offset, const char* name, uint64_t maxLength);
+static int compareSymbols(const void* a, const void* b);
+static void cachePath(char* out, const char* cacheDir, const char* path, uint32_t cpuType);
+static bool mapCache(SymbolCache* self, const char* cacheFile, const SymbolCacheHeader* header, const char* path);
+static bool buildCache(SymbolCache* self, SymbolCacheBuild* build, const char* path);
+static void writeCache(SymbolCache* self, const char* cacheDir, const char* cacheFile);
+static void setPointers(SymbolCache* self);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+uint64_t SymbolCache_getSize(void) {
+	// so bindings (which don't see the struct) can allocate one
+	return sizeof(SymbolCache);
+}
+
+
+bool SymbolCache_open(SymbolCache* self, const char* path, uint32_t cpuType, const char* cacheDir) {
+	bool retVal = false;
+	if (self == NULL || path == NULL) {
+		Log_invalidArgument("self: %p, path: %p", self, path);
+		
+	} else {
+		memset(self, 0, sizeof(*self));
+		int fd = open(path, O_RDONLY);
+		if (fd == -1) {
+			Log_errorPosix(errno, "open: %s", path);
+			
+		} else {
+			struct stat st = {0};
+			if (fstat(fd, &st) == -1) {
+				Log_errorPosix(errno, "fstat: %s", path);
+				
+			} else if (st.st_size < (off_t) sizeof(uint32_t)) {
+				Log_error("not an image: %s", path);
+				
+			} else {
+				void* image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (image == MAP_FAILED) {
+					Log_errorPosix(errno, "mmap: %s", path);
+					
+				} else {
+					// the load commands/headers are enough to tell if the cache is still good
+					SymbolCacheBuild build = {{0}};
+					build.header.magic = kSymbolCacheMagic;
+					build.header.version = kSymbolCacheVersion;
+					build.header.mtime = st.st_mtime;
+					build.header.fileSize = st.st_size;
+					if (readImage(&build, image, st.st_size, cpuType)) {
+						char cacheFile[PATH_MAX] = "";
+						if (cacheDir) {
+							cachePath(cacheFile, cacheDir, path, build.header.cpuType);
+						}
+						
+						if (cacheDir && mapCache(self, cacheFile, &build.header, path)) {
+							retVal = true;
+							
+						} else {
+							// parse the symbols this time, and keep them for next time
+							TraceBuffer symbols = {0};
+							TraceBuffer strings = {0};
+							build.symbols = &symbols;
+							build.strings = &strings;
+							if (	TraceBuffer_create(&symbols, 0) 
+								 && TraceBuffer_create(&strings, 0)
+								 && TraceBuffer_append(&strings, "", 1)
+								 && readImage(&build, image, st.st_size, cpuType)
+								 && buildCache(self, &build, path)) {
+								if (cacheDir) {
+									writeCache(self, cacheDir, cacheFile);
+								}
+								retVal = true;
+							}
+							TraceBuffer_release(&symbols);
+							TraceBuffer_release(&strings);
+						}
+					}
+					(void) munmap(image, st.st_size);
+				}
+			}
+			(void) close(fd);
+		}
+		
+		if (retVal == false) {
+			SymbolCache_close(self);
+		}
+	}
+	return retVal;
+}
+
+
+const SymbolCacheHeader* SymbolCache_getHeader(SymbolCache* self) {
+	const SymbolCacheHeader* retVal = NULL;
+	if (self == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		retVal = self->header;
+	}
+	return retVal;
+}
+
+
+bool SymbolCache_getSymbol(SymbolCache* self, uint32_t index, uint64_t* offset, const char** name) {
+	bool retVal = false;
+	if (self == NULL || self->header == NULL || index >= self->header->count || offset == NULL || name == NULL) {
+		Log_invalidArgument("self: %p, index: %u, offset: %p, name: %p", self, index, offset, name);
+		
+	} else {
+		*offset = self->symbols[index].offset;
+		*name = &self->strings[self->symbols[index].name];
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+uint32_t SymbolCache_find(SymbolCache* self, uint64_t offset) {
+	// the last symbol at or before offset
+	uint32_t retVal = kSymbolCacheNone;
+	if (self == NULL || self->header == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		uint32_t low = 0;
+		uint32_t high = self->header->count;
+		while (low < high) {
+			uint32_t mid = low + ((high - low) / 2);
+			if (self->symbols[mid].offset <= offset) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		if (low > 0) {
+			retVal = low - 1;
+		}
+	}
+	return retVal;
+}
+
+
+void SymbolCache_close(SymbolCache* self) {
+	if (self) {
+		if (self->map && self->map != self->built.data) {
+			(void) munmap((void*) self->map, self->mapSize);
+		}
+		TraceBuffer_release(&self->built);
+		memset(self, 0, sizeof(*self));
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static inline bool inFile(uint64_t size, uint64_t offset, uint64_t length) {
+	return (offset <= size) && (length <= size - offset);
+}
+
+
+static bool readImage(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, uint32_t cpuType) {
+	bool retVal = false;
+	uint32_t magic = 0;
+	(void) memcpy(&magic, image, sizeof(magic));
+	if (magic == MH_MAGIC || magic == MH_MAGIC_64) {
+		retVal = readMachO(build, image, size, cpuType);
+		
+	} else if (OSSwapBigToHostInt32(magic) == FAT_MAGIC) {
+		// a universal binary; find our slice (fat headers are big endian)
+		struct fat_header fat = {0};
+		if (inFile(size, 0, sizeof(fat))) {
+			(void) memcpy(&fat, image, sizeof(fat));
+		}
+		uint32_t count = OSSwapBigToHostInt32(fat.nfat_arch);
+		bool found = false;
+		for (uint32_t i = 0; i < count && inFile(size, sizeof(fat), (i + 1) * (uint64_t) sizeof(struct fat_arch)); i++) {
+			struct fat_arch arch = {0};
+			(void) memcpy(&arch, &image[sizeof(fat) + (i * sizeof(arch))], sizeof(arch));
+			uint64_t offset = OSSwapBigToHostInt32(arch.offset);
+			uint64_t length = OSSwapBigToHostInt32(arch.size);
+			if (	((uint32_t) OSSwapBigToHostInt32(arch.cputype) == cpuType || cpuType == 0)
+				 && inFile(size, offset, length)) {
+				retVal = readMachO(build, &image[offset], length, cpuType);
+				found = true;
+				break;
+			}
+		}
+		if (found == false) {
+			Log_error("no slice for cpu type: %x", cpuType);
+		}
+		
+	} else if (memcmp(image, "\x7f" "ELF", 4) == 0) {
+		retVal = readElf(build, image, size, cpuType);
+		
+	} else {
+		Log_error("not a Mach-O or ELF image");
+	}
+	return retVal;
+}
+
+
+static bool readMachO(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, uint32_t cpuType) {
+	bool retVal = true;
+	struct mach_header_64 header = {0};
+	(void) memcpy(&header, image, size < sizeof(header) ? size: sizeof(header));
+	bool is64 = (header.magic == MH_MAGIC_64);
+	uint64_t headerSize = is64 ? sizeof(struct mach_header_64): sizeof(struct mach_header);
+	if (inFile(size, headerSize, header.sizeofcmds) == false) {
+		Log_error("truncated load commands");
+		retVal = false;
+		
+	} else if (cpuType != 0 && (uint32_t) header.cputype != cpuType) {
+		Log_error("cpu type: %x; expected: %x", header.cputype, cpuType);
+		retVal = false;
+	}
+	
+	uint64_t textVmaddr = 0;
+	uint64_t end = 0;
+	struct symtab_command symtab = {0};
+	struct dysymtab_command dysymtab = {0};
+	StubSection stubs[kSymbolCacheMaxStubSections];
+	uint32_t stubCount = 0;
+	const uint8_t* commands = &image[headerSize];
+	uint64_t offset = 0;
+	for (uint32_t i = 0; retVal && i < header.ncmds; i++) {
+		struct load_command cmd = {0};
+		if (offset + sizeof(cmd) <= header.sizeofcmds) {
+			(void) memcpy(&cmd, &commands[offset], sizeof(cmd));
+		}
+		if (	(offset + sizeof(cmd) > header.sizeofcmds)
+			 || (cmd.cmdsize < sizeof(cmd))
+			 || (offset + cmd.cmdsize > header.sizeofcmds)) {
+			Log_error("bad load command %u", i);
+			retVal = false;
+			break;
+		}
+		
+		const uint8_t* command = &commands[offset];
+		if (cmd.cmd == LC_SEGMENT_64 || cmd.cmd == LC_SEGMENT) {
+			char segname[sizeof(((struct segment_command*) 0)->segname)] = "";
+			uint64_t vmaddr = 0;
+			uint64_t vmsize = 0;
+			uint32_t nsects = 0;
+			uint64_t sectionSize = 0;
+			if (cmd.cmd == LC_SEGMENT_64 && cmd.cmdsize >= sizeof(struct segment_command_64)) {
+				struct segment_command_64 seg = {0};
+				(void) memcpy(&seg, command, sizeof(seg));
+				(void) memcpy(segname, seg.segname, sizeof(segname));
+				vmaddr = seg.vmaddr;
+				vmsize = seg.vmsize;
+				nsects = seg.nsects;
+				sectionSize = sizeof(struct section_64);
+				
+			} else if (cmd.cmd == LC_SEGMENT && cmd.cmdsize >= sizeof(struct segment_command)) {
+				struct segment_command seg = {0};
+				(void) memcpy(&seg, command, sizeof(seg));
+				(void) memcpy(segname, seg.segname, sizeof(segname));
+				vmaddr = seg.vmaddr;
+				vmsize = seg.vmsize;
+				nsects = seg.nsects;
+				sectionSize = sizeof(struct section);
+			}
+			
+			if (strncmp(segname, SEG_TEXT, sizeof(segname)) == 0) {
+				textVmaddr = vmaddr;
+			}
+			if (vmaddr + vmsize > end) {
+				end = vmaddr + vmsize;
+			}
+			
+			// stubs are what calls to imported functions actually land on
+			uint64_t segSize = is64 ? sizeof(struct segment_command_64): sizeof(struct segment_command);
+			for (uint32_t j = 0; j < nsects && segSize + ((j + 1) * sectionSize) <= cmd.cmdsize; j++) {
+				uint32_t flags = 0;
+				StubSection stub = {0};
+				if (is64) {
+					struct section_64 sect = {{0}};
+					(void) memcpy(&sect, command + segSize + (j * sectionSize), sizeof(sect));
+					flags = sect.flags;
+					stub.addr = sect.addr;
+					stub.size = sect.size;
+					stub.indirectIndex = sect.reserved1;
+					stub.stubSize = sect.reserved2;
+					
+				} else {
+					struct section sect = {{0}};
+					(void) memcpy(&sect, command + segSize + (j * sectionSize), sizeof(sect));
+					flags = sect.flags;
+					stub.addr = sect.addr;
+					stub.size = sect.size;
+					stub.indirectIndex = sect.reserved1;
+					stub.stubSize = sect.reserved2;
+				}
+				if (	((flags & SECTION_TYPE) == S_SYMBOL_STUBS)
+					 && (stub.stubSize != 0)
+					 && (stubCount < kSymbolCacheMaxStubSections)) {
+					stubs[stubCount++] = stub;
+				}
+			}
+			
+		} else if (cmd.cmd == LC_SYMTAB && cmd.cmdsize >= sizeof(symtab)) {
+			(void) memcpy(&symtab, command, sizeof(symtab));
+			
+		} else if (cmd.cmd == LC_DYSYMTAB && cmd.cmdsize >= sizeof(dysymtab)) {
+			(void) memcpy(&dysymtab, command, sizeof(dysymtab));
+			
+		} else if (cmd.cmd == LC_UUID && cmd.cmdsize >= sizeof(struct uuid_command)) {
+			struct uuid_command uuid = {0};
+			(void) memcpy(&uuid, command, sizeof(uuid));
+			(void) memcpy(build->header.uuid, uuid.uuid, sizeof(uuid.uuid));
+			build->header.uuidSize = sizeof(uuid.uuid);
+		}
+		offset += cmd.cmdsize;
+	}
+	
+	if (retVal) {
+		build->header.format = eSymbolCacheFormat_macho;
+		build->header.cpuType = header.cputype;
+		build->header.base = textVmaddr;
+		build->header.size = end - textVmaddr;
+		if (build->symbols) {
+			retVal = readMachOSymbols(build, image, size, is64, &symtab, &dysymtab, stubs, stubCount);
+		}
+	}
+	return retVal;
+}
+
+
+static bool readMachOSymbols(SymbolCacheBuild* build,
+							 const uint8_t* image,
+							 uint64_t size,
+							 bool is64,
+							 const struct symtab_command* symtab,
+							 const struct dysymtab_command* dysymtab,
+							 const StubSection* stubs,
+							 uint32_t stubCount) {
+	bool retVal = true;
+	uint64_t nlistSize = is64 ? sizeof(struct nlist_64): sizeof(struct nlist);
+	if (	(inFile(size, symtab->symoff, symtab->nsyms * nlistSize) == false)
+		 || (inFile(size, symtab->stroff, symtab->strsize) == false)
+		 || (inFile(size, dysymtab->indirectsymoff, dysymtab->nindirectsyms * (uint64_t) sizeof(uint32_t)) == false)) {
+		Log_error("symbol table outside the image");
+		retVal = false;
+		
+	} else {
+		const uint8_t* nlists = &image[symtab->symoff];
+		const char* strings = (const char*) &image[symtab->stroff];
+		uint64_t base = build->header.base;
+		
+		// the defined symbols
+		for (uint32_t i = 0; retVal && i < symtab->nsyms; i++) {
+			uint32_t strx = 0;
+			uint8_t type = 0;
+			uint64_t value = 0;
+			readNlist(nlists, i, is64, &strx, &type, &value);
+			if (	((type & N_STAB) == 0)
+				 && ((type & N_TYPE) == N_SECT)
+				 && (strx != 0 && strx < symtab->strsize)) {
+				retVal = addSymbol(build, value - base, &strings[strx], symtab->strsize - strx);
+			}
+		}
+		
+		// and the stubs, named after the symbol they call through to
+		const uint8_t* indirect = &image[dysymtab->indirectsymoff];
+		for (uint32_t i = 0; retVal && i < stubCount; i++) {
+			const StubSection* stub = &stubs[i];
+			uint64_t count = stub->size / stub->stubSize;
+			for (uint64_t j = 0; retVal && j < count && stub->indirectIndex + j < dysymtab->nindirectsyms; j++) {
+				uint32_t sym = 0;
+				(void) memcpy(&sym, &indirect[(stub->indirectIndex + j) * sizeof(sym)], sizeof(sym));
+				if (	((sym & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS)) == 0)
+					 && (sym < symtab->nsyms)) {
+					uint32_t strx = 0;
+					uint8_t type = 0;
+					uint64_t value = 0;
+					readNlist(nlists, sym, is64, &strx, &type, &value);
+					if (strx != 0 && strx < symtab->strsize) {
+						retVal = addSymbol(build, 
+										   stub->addr + (j * stub->stubSize) - base, 
+										   &strings[strx], 
+										   symtab->strsize - strx);
+					}
+				}
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static void readNlist(const uint8_t* nlists, uint32_t index, bool is64, uint32_t* strx, uint8_t* type, uint64_t* value) {
+	// copied out; the image can put the symbol table anywhere, aligned or not
+	if (is64) {
+		struct nlist_64 nl = {{0}};
+		(void) memcpy(&nl, &nlists[index * sizeof(nl)], sizeof(nl));
+		*strx = nl.n_un.n_strx;
+		*type = nl.n_type;
+		*value = nl.n_value;
+		
+	} else {
+		struct nlist nl = {{0}};
+		(void) memcpy(&nl, &nlists[index * sizeof(nl)], sizeof(nl));
+		*strx = nl.n_un.n_strx;
+		*type = nl.n_type;
+		*value = nl.n_value;
+	}
+}
+
+
+static bool readElf(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, uint32_t cpuType) {
+	bool retVal = true;
+	Elf64Header header = {{{0}}};
+	(void) memcpy(&header, image, size < sizeof(header) ? size: sizeof(header));
+	bool is64 = (header.common.ident[4] == kElfClass64);
+	uint64_t phoff = header.phoff;
+	uint64_t shoff = header.shoff;
+	uint32_t phnum = header.phnum;
+	uint32_t shnum = header.shnum;
+	if (is64 == false) {
+		Elf32Header header32 = {{{0}}};
+		(void) memcpy(&header32, image, size < sizeof(header32) ? size: sizeof(header32));
+		phoff = header32.phoff;
+		shoff = header32.shoff;
+		phnum = header32.phnum;
+		shnum = header32.shnum;
+	}
+	
+	// the mach cpu type; so it can be checked like a Mach-O's
+	uint32_t imageCpuType = 0;
+	switch (header.common.machine) {
+		case 3:		imageCpuType = 0x7;			break;	// EM_386; CPU_TYPE_X86
+		case 62:	imageCpuType = 0x01000007;	break;	// EM_X86_64; CPU_TYPE_X86_64
+		case 40:	imageCpuType = 0xC;			break;	// EM_ARM; CPU_TYPE_ARM
+		case 183:	imageCpuType = 0x0100000C;	break;	// EM_AARCH64; CPU_TYPE_ARM64
+	}
+	
+	uint64_t programSize = is64 ? sizeof(Elf64Program): sizeof(Elf32Program);
+	if (	(header.common.ident[5] != kElfDataLittle)
+		 || (is64 == false && header.common.ident[4] != kElfClass32)) {
+		Log_error("only little endian ELF's are supported");
+		retVal = false;
+		
+	} else if (cpuType != 0 && imageCpuType != cpuType) {
+		Log_error("cpu type: %x; expected: %x", imageCpuType, cpuType);
+		retVal = false;
+		
+	} else if (inFile(size, phoff, phnum * programSize) == false) {
+		Log_error("truncated program headers");
+		retVal = false;
+	}
+	
+	// its extent is from the segment with the headers in to the end of the last
+	uint64_t base = UINT64_MAX;
+	uint64_t end = 0;
+	for (uint32_t i = 0; retVal && i < phnum; i++) {
+		Elf64Program program = {0};
+		if (is64) {
+			(void) memcpy(&program, &image[phoff + (i * programSize)], sizeof(program));
+			
+		} else {
+			Elf32Program program32 = {0};
+			(void) memcpy(&program32, &image[phoff + (i * programSize)], sizeof(program32));
+			program.type = program32.type;
+			program.offset = program32.offset;
+			program.vaddr = program32.vaddr;
+			program.filesz = program32.filesz;
+			program.memsz = program32.memsz;
+		}
+		
+		if (program.type == kElfProgramLoad) {
+			if (program.vaddr - program.offset < base) {
+				base = program.vaddr - program.offset;
+			}
+			if (program.vaddr + program.memsz > end) {
+				end = program.vaddr + program.memsz;
+			}
+			
+		} else if (program.type == kElfProgramNote && inFile(size, program.offset, program.filesz)) {
+			readElfNotes(build, &image[program.offset], program.filesz);
+		}
+	}
+	
+	if (retVal) {
+		if (base == UINT64_MAX) {
+			base = 0;
+			end = 0;
+		}
+		build->header.format = eSymbolCacheFormat_elf;
+		build->header.cpuType = imageCpuType;
+		build->header.base = base;
+		build->header.size = end - base;
+		if (build->symbols) {
+			retVal = readElfSymbols(build, image, size, is64, shoff, shnum);
+		}
+	}
+	return retVal;
+}
+
+
+static bool readElfSymbols(SymbolCacheBuild* build, const uint8_t* image, uint64_t size, bool is64, uint64_t shoff, uint32_t shnum) {
+	bool retVal = true;
+	uint64_t sectionSize = is64 ? sizeof(Elf64Section): sizeof(Elf32Section);
+	if (inFile(size, shoff, shnum * sectionSize) == false) {
+		Log_error("truncated section headers");
+		retVal = false;
+	}
+	
+	// .symtab if it's not been stripped; else .dynsym
+	Elf64Section symtab = {0};
+	Elf64Section strtab = {0};
+	for (uint32_t pass = 0; retVal && pass < 2 && symtab.type == 0; pass++) {
+		uint32_t wanted = pass == 0 ? kElfSectionSymtab: kElfSectionDynsym;
+		for (uint32_t i = 0; i < shnum; i++) {
+			Elf64Section section = {0};
+			if (is64) {
+				(void) memcpy(&section, &image[shoff + (i * sectionSize)], sizeof(section));
+				
+			} else {
+				Elf32Section section32 = {0};
+				(void) memcpy(&section32, &image[shoff + (i * sectionSize)], sizeof(section32));
+				section.type = section32.type;
+				section.offset = section32.offset;
+				section.size = section32.size;
+				section.link = section32.link;
+			}
+			
+			if (section.type == wanted && section.link < shnum) {
+				symtab = section;
+				if (is64) {
+					(void) memcpy(&strtab, &image[shoff + (section.link * sectionSize)], sizeof(strtab));
+					
+				} else {
+					Elf32Section section32 = {0};
+					(void) memcpy(&section32, &image[shoff + (section.link * sectionSize)], sizeof(section32));
+					strtab.offset = section32.offset;
+					strtab.size = section32.size;
+				}
+				break;
+			}
+		}
+	}
+	
+	if (retVal && symtab.type != 0) {
+		uint64_t symbolSize = is64 ? sizeof(Elf64Symbol): sizeof(Elf32Symbol);
+		if (	(inFile(size, symtab.offset, symtab.size) == false)
+			 || (inFile(size, strtab.offset, strtab.size) == false)) {
+			Log_error("symbol table outside the image");
+			retVal = false;
+			
+		} else {
+			const char* strings = (const char*) &image[strtab.offset];
+			for (uint64_t i = 0; retVal && i < symtab.size / symbolSize; i++) {
+				Elf64Symbol symbol = {0};
+				if (is64) {
+					(void) memcpy(&symbol, &image[symtab.offset + (i * symbolSize)], sizeof(symbol));
+					
+				} else {
+					Elf32Symbol symbol32 = {0};
+					(void) memcpy(&symbol32, &image[symtab.offset + (i * symbolSize)], sizeof(symbol32));
+					symbol.name = symbol32.name;
+					symbol.info = symbol32.info;
+					symbol.shndx = symbol32.shndx;
+					symbol.value = symbol32.value;
+				}
+				
+				uint8_t type = symbol.info & 0xF;
+				if (	(type == kElfSymbolFunction || type == kElfSymbolIndirect)
+					 && (symbol.shndx != 0 && symbol.shndx < kElfSectionReserved)
+					 && (symbol.name != 0 && symbol.name < strtab.size)) {
+					retVal = addSymbol(build, symbol.value - build->header.base, &strings[symbol.name], strtab.size - symbol.name);
+				}
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static void readElfNotes(SymbolCacheBuild* build, const uint8_t* notes, uint64_t size) {
+	// we only want the build id; it's our UUID
+	uint64_t offset = 0;
+	while (inFile(size, offset, sizeof(ElfNote))) {
+		ElfNote note = {0};
+		(void) memcpy(&note, &notes[offset], sizeof(note));
+		uint64_t name = offset + sizeof(note);
+		uint64_t desc = name + (((uint64_t) note.namesz + 3) & ~3ULL);
+		if (inFile(size, desc, note.descsz) == false) {
+			break;
+		}
+		
+		if (	(note.type == kElfNoteBuildId)
+			 && (note.namesz == 4 && memcmp(&notes[name], "GNU", 4) == 0)) {
+			build->header.uuidSize = note.descsz < sizeof(build->header.uuid) ? note.descsz: sizeof(build->header.uuid);
+			(void) memcpy(build->header.uuid, &notes[desc], build->header.uuidSize);
+			break;
+		}
+		offset = desc + (((uint64_t) note.descsz + 3) & ~3ULL);
+	}
+}
+
+
+static bool addSymbol(SymbolCacheBuild* build, uint64_t offset, const char* name, uint64_t maxLength) {
+	SymbolCacheEntry entry = {0};
+	entry.offset = offset;
+	entry.name = (uint32_t) build->strings->size;
+	uint64_t length = strnlen(name, maxLength);
+	bool retVal = (	   TraceBuffer_append(build->symbols, &entry, sizeof(entry))
+					&& TraceBuffer_append(build->strings, name, length)
+					&& TraceBuffer_append(build->strings, "", 1));
+	return retVal;
+}
+
+
+static int compareSymbols(const void* a, const void* b) {
+	const SymbolCacheEntry* symA = a;
+	const SymbolCacheEntry* symB = b;
+	int retVal = 0;
+	if (symA->offset < symB->offset) {
+		retVal = -1;
+	} else if (symA->offset > symB->offset) {
+		retVal = 1;
+	} else if (symA->name < symB->name) {
+		retVal = -1;
+	} else if (symA->name > symB->name) {
+		retVal = 1;
+	}
+	return retVal;
+}
+
+
+static void cachePath(char* out, const char* cacheDir, const char* path, uint32_t cpuType) {
+	// named after a hash of the path (FNV-1a); the header has the path in full
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (const char* p = path; *p; p++) {
+		hash = (hash ^ (uint8_t) *p) * 0x100000001B3ULL;
+	}
+	(void) snprintf(out, PATH_MAX, "%s/%016llx-%x.sym", cacheDir, (unsigned long long) hash, cpuType);
+}
+
+
+static bool mapCache(SymbolCache* self, const char* cacheFile, const SymbolCacheHeader* header, const char* path) {
+	// false if there's no cache, or it's for a different build of the image; that's not an error
+	bool retVal = false;
+	int fd = open(cacheFile, O_RDONLY);
+	if (fd != -1) {
+		struct stat st = {0};
+		if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(SymbolCacheHeader)) {
+			void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				const SymbolCacheHeader* cached = map;
+				uint64_t pathLength = strlen(path);
+				uint64_t expected = sizeof(*cached) 
+								  + cached->pathSize 
+								  + ((uint64_t) cached->count * sizeof(SymbolCacheEntry)) 
+								  + cached->stringsSize;
+				if (	(cached->magic == header->magic)
+					 && (cached->version == header->version)
+					 && (cached->format == header->format)
+					 && (cached->cpuType == header->cpuType)
+					 && (cached->mtime == header->mtime)
+					 && (cached->fileSize == header->fileSize)
+					 && (cached->uuidSize == header->uuidSize)
+					 && (memcmp(cached->uuid, header->uuid, sizeof(header->uuid)) == 0)
+					 && (cached->pathSize > pathLength && cached->pathSize <= (uint64_t) st.st_size - sizeof(*cached))
+					 && (memcmp(cached + 1, path, pathLength + 1) == 0)
+					 && (cached->stringsSize > 0 && expected == (uint64_t) st.st_size)
+					 && (((const char*) map)[st.st_size - 1] == '\0')) {
+					self->map = map;
+					self->mapSize = st.st_size;
+					setPointers(self);
+					retVal = true;
+					
+				} else {
+					(void) munmap(map, st.st_size);
+				}
+			}
+		}
+		(void) close(fd);
+	}
+	return retVal;
+}
+
+
+static bool buildCache(SymbolCache* self, SymbolCacheBuild* build, const char* path) {
+	// laid out just like the file; so it's used the same way whether or not we write it
+	bool retVal = false;
+	uint64_t pathLength = strlen(path) + 1;
+	uint8_t padding[8] = {0};
+	SymbolCacheHeader* header = &build->header;
+	header->count = (uint32_t) (build->symbols->size / sizeof(SymbolCacheEntry));
+	header->pathSize = (uint32_t) ((pathLength + 7) & ~7ULL);
+	header->stringsSize = build->strings->size;
+	qsort(build->symbols->data, header->count, sizeof(SymbolCacheEntry), compareSymbols);
+	
+	uint64_t size = sizeof(*header) + header->pathSize + build->symbols->size + build->strings->size;
+	if (	TraceBuffer_create(&self->built, size)
+		 && TraceBuffer_append(&self->built, header, sizeof(*header))
+		 && TraceBuffer_append(&self->built, path, pathLength)
+		 && TraceBuffer_append(&self->built, padding, header->pathSize - pathLength)
+		 && TraceBuffer_append(&self->built, build->symbols->data, build->symbols->size)
+		 && TraceBuffer_append(&self->built, build->strings->data, build->strings->size)) {
+		self->map = self->built.data;
+		self->mapSize = self->built.size;
+		setPointers(self);
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static void writeCache(SymbolCache* self, const char* cacheDir, const char* cacheFile) {
+	// written to a temporary file then renamed; so another run never maps half of one
+	char tempFile[PATH_MAX] = "";
+	(void) snprintf(tempFile, sizeof(tempFile), "%s.%d", cacheFile, (int) getpid());
+	(void) mkdir(cacheDir, 0755);
+	int fd = open(tempFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		Log_errorPosix(errno, "open: %s", tempFile);
+		
+	} else {
+		bool written = true;
+		uint64_t offset = 0;
+		while (written && offset < self->mapSize) {
+			ssize_t n = write(fd, &self->map[offset], self->mapSize - offset);
+			if (n < 0 && errno == EINTR) {
+				continue;
+				
+			} else if (n <= 0) {
+				Log_errorPosix(errno, "write: %s", tempFile);
+				written = false;
+				
+			} else {
+				offset += n;
+			}
+		}
+		(void) close(fd);
+		
+		if (written && rename(tempFile, cacheFile) == -1) {
+			Log_errorPosix(errno, "rename: %s", cacheFile);
+			written = false;
+		}
+		if (written == false) {
+			(void) unlink(tempFile);
+		}
+	}
+}
+
+
+static void setPointers(SymbolCache* self) {
+	self->header = (const SymbolCacheHeader*) self->map;
+	self->symbols = (const SymbolCacheEntry*) (self->map + sizeof(SymbolCacheHeader) + self->header->pathSize);
+	self->strings = (const char*) (self->symbols + self->header->count);
+}
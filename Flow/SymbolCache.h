@@ -0,0 +1,117 @@
+//
+//  SymbolCache.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_SymbolCache_h
+#define Flow_SymbolCache_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "TraceBuffer.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kSymbolCacheMagic		(0x4D595346)	// 'FSYM'
+#define kSymbolCacheVersion		(1)
+#define kSymbolCacheNone		(UINT32_MAX)	// SymbolCache_find; there's no symbol before it
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef enum eSymbolCacheFormat {
+	eSymbolCacheFormat_macho = 0,
+	eSymbolCacheFormat_elf = 1
+} SymbolCacheFormat;
+
+
+/*
+ * A cache file is a SymbolCacheHeader, the image's path (null terminated, padded to 8 
+ * bytes), count SymbolCacheEntry's sorted by offset then the names.  It's only used
+ * if the path, cpuType, mtime, file size and UUID all still match the image.
+ */
+typedef struct sSymbolCacheHeader {
+	uint32_t	magic;			// kSymbolCacheMagic
+	uint32_t	version;		// kSymbolCacheVersion
+	uint32_t	format;			// SymbolCacheFormat
+	uint32_t	cpuType;		// of the image (or the fat slice) the symbols came from
+	uint64_t	mtime;
+	uint64_t	fileSize;
+	uint8_t		uuid[20];		// LC_UUID, or an ELF's GNU build-id
+	uint32_t	uuidSize;
+	uint64_t	base;			// the address the offsets are from; __TEXT or the first PT_LOAD
+	uint64_t	size;			// from base to the end of the last segment
+	uint32_t	count;			// of SymbolCacheEntry's
+	uint32_t	pathSize;		// with its null and padding
+	uint64_t	stringsSize;
+} SymbolCacheHeader;
+
+
+typedef struct sSymbolCacheEntry {
+	uint64_t	offset;			// from base
+	uint32_t	name;			// offset into the strings
+	uint32_t	reserved;
+} SymbolCacheEntry;
+
+
+/*
+ * An image's symbols; its defined (function) symbols and, for Mach-O, its stubs named 
+ * after the symbols they call through to (like otool -I).  SymbolCache_open parses the
+ * image the first time and writes what it found to a file in cacheDir; after that it's
+ * mapped straight in.  With no cacheDir (or if the file can't be written) the symbols
+ * are just kept in memory.  Only little endian ELF's are read.
+ */
+typedef struct sSymbolCache {
+	const uint8_t*				map;			// the cache file; or built, if we're not using one
+	uint64_t					mapSize;
+	TraceBuffer					built;
+	const SymbolCacheHeader*	header;
+	const SymbolCacheEntry*		symbols;
+	const char*					strings;
+} SymbolCache;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+uint64_t SymbolCache_getSize(void);
+bool SymbolCache_open(SymbolCache* self, const char* path, uint32_t cpuType, const char* cacheDir);
+const SymbolCacheHeader* SymbolCache_getHeader(SymbolCache* self);
+bool SymbolCache_getSymbol(SymbolCache* self, uint32_t index, uint64_t* offset, const char** name);
+uint32_t SymbolCache_find(SymbolCache* self, uint64_t offset);
+void SymbolCache_close(SymbolCache* self);
+
+
+#endif
@@ -30,6 +30,7 @@
 #include <mach/mach.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <string.h>
 #include <mach/vm_map.h>
 
 #include "Task.h"
@@ -41,6 +42,14 @@
 
 
 
+/*
+ * Defines
+ */
+#define kTaskPageSize	(4096)	// the smallest page size; a read within one of these can't half fail
+
+
+
+
 /*
  * Static function predefinitions
  */
@@ -161,26 +170,30 @@ kern_return_t Task_readMemory(Task* self, VMAddr addr, void* data, vm_size_t len
 
 kern_return_t Task_readString(Task* self, VMAddr addr, char* path, uint64_t size) {
 	kern_return_t retVal = KERN_INVALID_ARGUMENT;
-	if (self == NULL || path == NULL) {
-		Log_invalidArgument("self: %p, path: %p", self, path);
+	if (self == NULL || path == NULL || size == 0) {
+		Log_invalidArgument("self: %p, path: %p, size: %llu", self, path, size);
 		
 	} else {
 		uint64_t i = 0;
+		bool terminated = false;
 		
-		// Note: this is terifyingly inefficient; but works
-		for (i = 0; i < size; i++) {
-			retVal = Task_readMemory(self, addr+i, (void*) &path[i], 1);
-			if (retVal != KERN_SUCCESS) {
-				break;
+		// read up to the end of each page at a time; the next might not be mapped
+		while (terminated == false && i < size) {
+			uint64_t length = kTaskPageSize - ((addr + i) & (kTaskPageSize - 1));
+			if (length > size - i) {
+				length = size - i;
 			}
 			
-			if (path[i] == '\0') {
-				break; // done
+			retVal = Task_readMemory(self, addr + i, (void*) &path[i], length);
+			if (retVal != KERN_SUCCESS) {
+				break;
 			}
+			terminated = memchr(&path[i], '\0', length) != NULL;
+			i += length;
 		}
 		
-		if (i == size) {
-			path[size-1] = '\0';
+		if (terminated == false) {
+			path[(i < size) ? i: size-1] = '\0';
 		}
 	}
 	return retVal;
@@ -284,6 +297,31 @@ kern_return_t Thread_findNextBranch(Thread* self, Block* block) {
 }
 
 
+uint64_t Thread_getId(Thread* self) {
+	uint64_t retVal = 0;
+	if (self == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		// the system wide id; unlike the port name it isn't reused when a thread dies
+		thread_identifier_info_data_t info = {0};
+		mach_msg_type_number_t count = THREAD_IDENTIFIER_INFO_COUNT;
+		kern_return_t ret = thread_info(self->thread, 
+										THREAD_IDENTIFIER_INFO, 
+										(thread_info_t) &info, 
+										&count);
+		if (ret != KERN_SUCCESS) {
+			Log_errorMach(ret, "thread_info");
+			retVal = self->thread;
+			
+		} else {
+			retVal = info.thread_id;
+		}
+	}
+	return retVal;
+}
+
+
 
 void FunctionArgs_initialize(FunctionArgs* self, Thread* thread, bool stackCookie) {
 	if (self == NULL || thread == NULL) {
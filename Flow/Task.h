@@ -113,6 +113,10 @@ struct sBlock {
 	VMAddr		entry;
 	VMAddr		branch;
 	BranchType	type;
+	
+	VMAddr		next;			// the instruction after the branch
+	VMAddr		target;			// where the branch goes, if the code says; 0 if indirect (ret, jmp *%eax etc)
+	bool		conditional;	// if set we go to either target or next
 };
 
 
@@ -149,6 +153,7 @@ inline kern_return_t Thread_setBreakpoint(Thread* self, VMAddr pc);
 inline kern_return_t Thread_clearBreakpoint(Thread* self);
 
 kern_return_t Thread_findNextBranch(Thread* self, Block* block);
+uint64_t Thread_getId(Thread* self);
 
 
 inline void FunctionArgs_initialize(FunctionArgs* self, Thread* thread, bool stackCookie);
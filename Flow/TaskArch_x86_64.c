@@ -31,6 +31,7 @@
 #include <distorm.h>
 
 #include "TaskArch_x86_64.h"
+#include "BranchSearch.h"
 #include "Log.h"
 
 
@@ -40,7 +41,6 @@
  * Defines
  */
 #define kTraceBit			(0x100u)
-#define kBranchReadAhead	(4096)
 
 
 
@@ -171,42 +171,11 @@ static kern_return_t findNextBranch(Thread* self, Block* block) {
 	kern_return_t retVal = KERN_FAILURE;
 	
 	// search forward from pc until we find next branch
-	char data[kBranchReadAhead] = {0};
+	uint8_t data[kBranchReadAhead] = {0};
 	VMAddr pc = getPC(self);
-	if (Task_readMemory(self->task, pc, &data, sizeof(data)) == KERN_SUCCESS) {
-		_DInst result = {0};
-		unsigned int ic = 0;
-		
-		_CodeInfo ci = {0};
-		ci.code = (uint8_t*) data;
-		ci.codeLen = sizeof(data);
-		ci.dt = Decode64Bits;
-		ci.codeOffset = pc;
-		while (1) {
-			distorm_decompose64(&ci, &result, 1, &ic);
-			if (result.flags == FLAG_NOT_DECODABLE) {
-				Log_error("Unable to decode instruction at: %llx, offset: %llx", pc, ci.codeOffset-pc);
-				break;
-				
-			} else {
-				int fc = META_GET_FC(result.meta);
-				if (fc != FC_NONE){
-					block->entry = pc;
-					block->branch = ci.codeOffset;
-					switch (fc) {
-						case FC_CALL:	block->type = eBranchType_call;		break;
-						case FC_RET:	block->type = eBranchType_ret;		break;
-						case FC_SYS:	block->type = eBranchType_sys;		break;								
-						default:		block->type = eBranchType_other;	break;
-					}
-					retVal = KERN_SUCCESS;
-					break;
-				}
-			}
-			ci.code += result.size;
-			ci.codeLen -= result.size;
-			ci.codeOffset += result.size;
-		}
+	if (	(Task_readMemory(self->task, pc, &data, sizeof(data)) == KERN_SUCCESS)
+		 && BranchSearch_findNextBranch(data, sizeof(data), pc, Decode64Bits, block)) {
+		retVal = KERN_SUCCESS;
 	}
 	return retVal;
 }
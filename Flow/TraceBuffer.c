@@ -0,0 +1,118 @@
+//
+//  TraceBuffer.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "TraceBuffer.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceBufferMinCapacity	(4096)
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool TraceBuffer_create(TraceBuffer* self, uint64_t capacity) {
+	bool retVal = false;
+	if (self == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		if (capacity < kTraceBufferMinCapacity) {
+			capacity = kTraceBufferMinCapacity;
+		}
+		
+		self->data = malloc(capacity);
+		if (self->data == NULL) {
+			Log_error("malloc");
+			
+		} else {
+			self->size = 0;
+			self->capacity = capacity;
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+bool TraceBuffer_reserve(TraceBuffer* self, uint64_t capacity) {
+	bool retVal = true;
+	if (capacity > self->capacity) {
+		uint64_t size = self->capacity ? self->capacity: kTraceBufferMinCapacity;
+		while (size < capacity) {
+			size *= 2;
+		}
+		
+		uint8_t* grown = realloc(self->data, size);
+		if (grown == NULL) {
+			Log_error("realloc");
+			retVal = false;
+			
+		} else {
+			self->data = grown;
+			self->capacity = size;
+		}
+	}
+	return retVal;
+}
+
+
+bool TraceBuffer_append(TraceBuffer* self, const void* data, uint64_t length) {
+	// records are tiny compared to a chunk; so we rarely grow
+	bool retVal = TraceBuffer_reserve(self, self->size + length);
+	if (retVal) {
+		(void) memcpy(&self->data[self->size], data, length);
+		self->size += length;
+	}
+	return retVal;
+}
+
+
+void TraceBuffer_reset(TraceBuffer* self) {
+	if (self) {
+		self->size = 0;
+	}
+}
+
+
+void TraceBuffer_release(TraceBuffer* self) {
+	if (self) {
+		free(self->data);
+		self->data = NULL;
+		self->size = 0;
+		self->capacity = 0;
+	}
+}
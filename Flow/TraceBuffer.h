@@ -0,0 +1,64 @@
+//
+//  TraceBuffer.h
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_TraceBuffer_h
+#define Flow_TraceBuffer_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+
+/*
+ * A growable byte buffer; the trace log builds each chunk in one of these before
+ * it's written out.
+ */
+typedef struct sTraceBuffer {
+	uint8_t*	data;
+	uint64_t	size;		// bytes used
+	uint64_t	capacity;
+} TraceBuffer;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool TraceBuffer_create(TraceBuffer* self, uint64_t capacity);
+bool TraceBuffer_reserve(TraceBuffer* self, uint64_t capacity);
+bool TraceBuffer_append(TraceBuffer* self, const void* data, uint64_t length);
+void TraceBuffer_reset(TraceBuffer* self);
+void TraceBuffer_release(TraceBuffer* self);
+
+
+#endif
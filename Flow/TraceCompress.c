@@ -0,0 +1,236 @@
+//
+//  TraceCompress.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <string.h>
+
+#include "TraceCompress.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceCompressHashBits		(14)
+#define kTraceCompressMinMatch		(4)
+#define kTraceCompressMaxOffset		(0xFFFF)
+#define kTraceCompressSkipTrigger	(6)		// the more we miss the faster we skip
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static inline uint32_t read32(const uint8_t* p);
+static inline uint32_t hash32(uint32_t value);
+static uint8_t* writeLength(uint8_t* dst, uint64_t length);
+static uint8_t* writeSequence(uint8_t* dst,
+							  const uint8_t* literals,
+							  uint64_t literalLength,
+							  uint64_t offset,
+							  uint64_t matchLength);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+uint64_t TraceCompress_bound(uint64_t length) {
+	// worst case is all literals; one extra length byte every 255 plus the token
+	return length + (length / 255) + 16;
+}
+
+
+uint64_t TraceCompress_compress(const uint8_t* src, uint64_t length, uint8_t* dst, uint64_t capacity) {
+	uint64_t retVal = 0;
+	if (src == NULL || dst == NULL) {
+		Log_invalidArgument("src: %p, dst: %p", src, dst);
+		
+	} else if (capacity < TraceCompress_bound(length)) {
+		Log_invalidArgument("capacity: %llu, length: %llu", capacity, length);
+		
+	} else {
+		uint32_t table[1 << kTraceCompressHashBits] = {0};
+		uint8_t* out = dst;
+		uint64_t anchor = 0;
+		uint64_t pos = 0;
+		uint32_t misses = 0;
+		while (pos + kTraceCompressMinMatch <= length) {
+			uint32_t value = read32(&src[pos]);
+			uint32_t h = hash32(value);
+			uint64_t ref = table[h];
+			table[h] = (uint32_t) pos;
+			
+			if (	(ref < pos)
+				 && (pos - ref <= kTraceCompressMaxOffset)
+				 && (read32(&src[ref]) == value)) {
+				uint64_t matchLength = kTraceCompressMinMatch;
+				while (pos + matchLength < length && src[ref + matchLength] == src[pos + matchLength]) {
+					matchLength++;
+				}
+				
+				out = writeSequence(out, &src[anchor], pos - anchor, pos - ref, matchLength);
+				pos += matchLength;
+				anchor = pos;
+				misses = 0;
+				
+			} else {
+				pos += 1 + (misses++ >> kTraceCompressSkipTrigger);
+			}
+		}
+		
+		// whatever's left is literals
+		out = writeSequence(out, &src[anchor], length - anchor, 0, 0);
+		retVal = out - dst;
+	}
+	return retVal;
+}
+
+
+bool TraceCompress_decompress(const uint8_t* src, uint64_t length, uint8_t* dst, uint64_t capacity) {
+	bool retVal = true;
+	const uint8_t* in = src;
+	const uint8_t* end = src + length;
+	uint64_t out = 0;
+	while (retVal && in < end) {
+		uint8_t token = *in++;
+		
+		uint64_t literalLength = token >> 4;
+		if (literalLength == 15) {
+			uint8_t b = 255;
+			while (b == 255 && in < end) {
+				b = *in++;
+				literalLength += b;
+			}
+		}
+		if ((uint64_t) (end - in) < literalLength || capacity - out < literalLength) {
+			Log_error("literals overrun");
+			retVal = false;
+			break;
+		}
+		(void) memcpy(&dst[out], in, literalLength);
+		in += literalLength;
+		out += literalLength;
+		
+		if (in == end) {
+			break; // the last sequence; just literals
+		}
+		
+		if (end - in < 2) {
+			Log_error("truncated offset");
+			retVal = false;
+			break;
+		}
+		uint64_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		
+		uint64_t matchLength = token & 0xF;
+		if (matchLength == 15) {
+			uint8_t b = 255;
+			while (b == 255 && in < end) {
+				b = *in++;
+				matchLength += b;
+			}
+		}
+		matchLength += kTraceCompressMinMatch;
+		
+		if (offset == 0 || offset > out || capacity - out < matchLength) {
+			Log_error("bad match; offset: %llu, length: %llu", offset, matchLength);
+			retVal = false;
+			
+		} else {
+			// byte by byte as the match can overlap what its writing
+			for (uint64_t i = 0; i < matchLength; i++) {
+				dst[out + i] = dst[out + i - offset];
+			}
+			out += matchLength;
+		}
+	}
+	
+	if (retVal && out != capacity) {
+		Log_error("decompressed %llu bytes; expected %llu", out, capacity);
+		retVal = false;
+	}
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static inline uint32_t read32(const uint8_t* p) {
+	uint32_t value = 0;
+	(void) memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+
+static inline uint32_t hash32(uint32_t value) {
+	return (value * 2654435761u) >> (32 - kTraceCompressHashBits);
+}
+
+
+static uint8_t* writeLength(uint8_t* dst, uint64_t length) {
+	// only called for the part of a length over 15
+	while (length >= 255) {
+		*dst++ = 255;
+		length -= 255;
+	}
+	*dst++ = (uint8_t) length;
+	return dst;
+}
+
+
+static uint8_t* writeSequence(uint8_t* dst,
+							  const uint8_t* literals,
+							  uint64_t literalLength,
+							  uint64_t offset,
+							  uint64_t matchLength) {
+	uint8_t* token = dst++;
+	*token = (literalLength < 15 ? literalLength: 15) << 4;
+	if (literalLength >= 15) {
+		dst = writeLength(dst, literalLength - 15);
+	}
+	(void) memcpy(dst, literals, literalLength);
+	dst += literalLength;
+	
+	if (matchLength) {
+		*dst++ = offset & 0xFF;
+		*dst++ = (offset >> 8) & 0xFF;
+		
+		matchLength -= kTraceCompressMinMatch;
+		*token |= matchLength < 15 ? matchLength: 15;
+		if (matchLength >= 15) {
+			dst = writeLength(dst, matchLength - 15);
+		}
+	}
+	return dst;
+}
@@ -0,0 +1,58 @@
+//
+//  TraceCompress.h
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_TraceCompress_h
+#define Flow_TraceCompress_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/*
+ * A small LZ77 codec in the style of LZ4; it's about speed rather than ratio (the trace
+ * is mostly repeated addresses so even this does well).
+ *
+ * The output is a series of sequences; a token byte |llllmmmm|, l literal bytes, then
+ * a 16bit offset back into the output and a match of m+4 bytes.  If l or m is 15 its
+ * extended by the bytes which follow (each added on; 255 means another follows).  The
+ * last sequence is only literals; there's no offset or match after it.
+ */
+
+
+
+
+/*
+ * Exported function definitions
+ */
+uint64_t TraceCompress_bound(uint64_t length);
+uint64_t TraceCompress_compress(const uint8_t* src, uint64_t length, uint8_t* dst, uint64_t capacity);
+bool TraceCompress_decompress(const uint8_t* src, uint64_t length, uint8_t* dst, uint64_t capacity);
+
+
+#endif
@@ -0,0 +1,567 @@
+//
+//  TraceImages.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "TraceImages.h"
+#include "TraceLog.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceImagesDyldPath	"/usr/lib/dyld"
+#define kTraceImagesAdding		(0)		// dyld_image_adding; anything else is removing
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static bool readLibraryNotification(TraceImages* self, const uint8_t* p, const uint8_t* end);
+static bool readImageNotification(TraceImages* self, const uint8_t* p, const uint8_t* end);
+static bool readPathDefinition(TraceImages* self, const uint8_t* p, const uint8_t* end);
+static bool readImageSymbols(TraceImages* self, const uint8_t* p, const uint8_t* end);
+static bool addString(TraceImages* self, const void* data, uint64_t length, uint32_t* offset);
+static bool addImage(TraceImages* self, uint64_t base, uint32_t path);
+static void removeImage(TraceImages* self, uint64_t base);
+static uint32_t findLoaded(TraceImages* self, uint64_t address);
+static void readBinary(TraceImages* self, TraceImage* image);
+static void releaseImage(TraceImage* image);
+static const char* baseName(const char* path);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool TraceImages_create(TraceImages* self, uint32_t cpuType, const char* root) {
+	bool retVal = false;
+	if (self == NULL) {
+		Log_invalidArgument("self: %p", self);
+		
+	} else {
+		memset(self, 0, sizeof(*self));
+		self->cpuType = cpuType;
+		
+		// where SymbolCache keeps what it parses; the same place as FlowCalls.py
+		char cacheDir[PATH_MAX] = {0};
+		const char* env = getenv("FLOWSYMBOLS");
+		const char* home = getenv("HOME");
+		if (env) {
+			(void) snprintf(cacheDir, sizeof(cacheDir), "%s", env);
+			
+		} else if (home) {
+			(void) snprintf(cacheDir, sizeof(cacheDir), "%s/.flow/symbols", home);
+		}
+		
+		self->root = strdup(root ? root: "");
+		self->cacheDir = cacheDir[0] ? strdup(cacheDir): NULL;
+		if (self->root == NULL || (cacheDir[0] && self->cacheDir == NULL)) {
+			Log_error("out of memory");
+			
+		} else {
+			retVal = TraceBuffer_create(&self->strings, 0);
+		}
+		
+		if (retVal == false) {
+			TraceImages_release(self);
+		}
+	}
+	return retVal;
+}
+
+
+bool TraceImages_record(TraceImages* self, const FlowReaderMeta* meta) {
+	bool retVal = true;
+	if (self == NULL || meta == NULL) {
+		Log_invalidArgument("self: %p, meta: %p", self, meta);
+		retVal = false;
+		
+	} else {
+		const uint8_t* p = meta->data;
+		const uint8_t* end = &meta->data[meta->size];
+		if (meta->type == eTraceLogRecord_dyldLoadAddress) {
+			uint64_t base = 0;
+			uint32_t path = 0;
+			if (end - p >= (long) sizeof(base)) {
+				(void) memcpy(&base, p, sizeof(base));
+				retVal = addString(self, kTraceImagesDyldPath, strlen(kTraceImagesDyldPath), &path) && addImage(self, base, path);
+			}
+			
+		} else if (meta->type == eTraceLogRecord_libraryNotification) {
+			retVal = readLibraryNotification(self, p, end);
+			
+		} else if (meta->type == eTraceLogRecord_imageNotification) {
+			retVal = readImageNotification(self, p, end);
+			
+		} else if (meta->type == eTraceLogRecord_pathDefinition) {
+			retVal = readPathDefinition(self, p, end);
+			
+		} else if (meta->type == eTraceLogRecord_imageSymbols) {
+			retVal = readImageSymbols(self, p, end);
+		}
+	}
+	return retVal;
+}
+
+
+uint32_t TraceImages_find(TraceImages* self, uint64_t address) {
+	uint32_t retVal = kTraceImagesNone;
+	uint32_t i = kTraceImagesNone;
+	if (	(self->last < self->count) 
+		 && (self->images[self->last].loaded)
+		 && (address - self->images[self->last].base < self->images[self->last].size)) {
+		retVal = self->last;
+		
+	} else {
+		i = findLoaded(self, address);
+	}
+	
+	if (i != kTraceImagesNone) {
+		TraceImage* image = &self->images[self->loaded[i]];
+		if (image->read == false) {
+			// only the images the trace actually runs in are worth reading
+			readBinary(self, image);
+		}
+		if (address - image->base < image->size) {
+			retVal = self->loaded[i];
+			self->last = retVal;
+		}
+	}
+	return retVal;
+}
+
+
+uint32_t TraceImages_findSymbol(TraceImages* self, uint32_t image, uint64_t address) {
+	uint32_t retVal = kTraceImagesNone;
+	if (image < self->count) {
+		TraceImage* i = &self->images[image];
+		uint64_t offset = address - i->base;
+		if (i->cache) {
+			retVal = SymbolCache_find(i->cache, offset);
+			
+		} else if (i->count && offset >= i->offsets[0]) {
+			// the last symbol at or before it
+			uint32_t low = 0;
+			uint32_t high = i->count;
+			while (high - low > 1) {
+				uint32_t mid = low + (high - low) / 2;
+				if (i->offsets[mid] <= offset) {
+					low = mid;
+					
+				} else {
+					high = mid;
+				}
+			}
+			retVal = low;
+		}
+	}
+	return retVal;
+}
+
+
+const char* TraceImages_getPath(TraceImages* self, uint32_t image) {
+	const char* retVal = NULL;
+	if (image < self->count) {
+		retVal = (const char*) &self->strings.data[self->images[image].path];
+	}
+	return retVal;
+}
+
+
+bool TraceImages_getSymbol(TraceImages* self, uint32_t image, uint32_t symbol, uint64_t* address, const char** name) {
+	bool retVal = false;
+	if (image < self->count) {
+		TraceImage* i = &self->images[image];
+		uint64_t offset = 0;
+		if (i->cache) {
+			retVal = SymbolCache_getSymbol(i->cache, symbol, &offset, name);
+			
+		} else if (symbol < i->count) {
+			offset = i->offsets[symbol];
+			*name = (const char*) &self->strings.data[i->names[symbol]];
+			retVal = true;
+		}
+		*address = i->base + offset;
+	}
+	return retVal;
+}
+
+
+uint32_t TraceImages_format(TraceImages* self, char* buffer, uint32_t size, uint32_t image, uint32_t symbol, uint64_t address) {
+	// like FlowCalls.py; image::symbol+offset, image:offset or just the address
+	int retVal = 0;
+	uint64_t start = 0;
+	const char* name = NULL;
+	if (image >= self->count) {
+		retVal = snprintf(buffer, size, "%llx", address);
+		
+	} else if (	   symbol != kTraceImagesNone 
+				&& TraceImages_getSymbol(self, image, symbol, &start, &name)) {
+		if (address != start) {
+			retVal = snprintf(buffer, size, "%s::%s+%llx", baseName(TraceImages_getPath(self, image)), name, address - start);
+			
+		} else {
+			retVal = snprintf(buffer, size, "%s::%s", baseName(TraceImages_getPath(self, image)), name);
+		}
+		
+	} else {
+		retVal = snprintf(buffer, size, "%s:%llx", baseName(TraceImages_getPath(self, image)), address - self->images[image].base);
+	}
+	
+	// truncated, if it didn't fit
+	if (retVal < 0) {
+		retVal = 0;
+		
+	} else if ((uint32_t) retVal >= size) {
+		retVal = size ? size - 1: 0;
+	}
+	return (uint32_t) retVal;
+}
+
+
+void TraceImages_print(TraceImages* self, FILE* file, uint32_t image, uint32_t symbol, uint64_t address) {
+	char buffer[kTraceImagesNameSize] = {0};
+	(void) TraceImages_format(self, buffer, sizeof(buffer), image, symbol, address);
+	fputs(buffer, file);
+}
+
+
+void TraceImages_release(TraceImages* self) {
+	if (self) {
+		for (uint32_t i = 0; i < self->count; i++) {
+			releaseImage(&self->images[i]);
+		}
+		free(self->images);
+		free(self->loaded);
+		free(self->paths);
+		free(self->root);
+		free(self->cacheDir);
+		TraceBuffer_release(&self->strings);
+		memset(self, 0, sizeof(*self));
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static bool readLibraryNotification(TraceImages* self, const uint8_t* p, const uint8_t* end) {
+	// uint64_t mode, uint32_t count, then a uint64_t base and uint16_t length path each
+	bool retVal = true;
+	uint64_t mode = 0;
+	uint32_t count = 0;
+	if (end - p >= (long) (sizeof(mode) + sizeof(count))) {
+		(void) memcpy(&mode, p, sizeof(mode));
+		(void) memcpy(&count, p + sizeof(mode), sizeof(count));
+		p += sizeof(mode) + sizeof(count);
+		for (uint32_t i = 0; retVal && i < count && end - p >= (long) (sizeof(uint64_t) + sizeof(uint16_t)); i++) {
+			uint64_t base = 0;
+			uint16_t length = 0;
+			(void) memcpy(&base, p, sizeof(base));
+			(void) memcpy(&length, p + sizeof(base), sizeof(length));
+			p += sizeof(base) + sizeof(length);
+			if (end - p < length) {
+				break;
+			}
+			
+			if (mode == kTraceImagesAdding) {
+				uint32_t path = 0;
+				retVal = addString(self, p, strnlen((const char*) p, length), &path) && addImage(self, base, path);
+				
+			} else {
+				removeImage(self, base);
+			}
+			p += length;
+		}
+	}
+	return retVal;
+}
+
+
+static bool readImageNotification(TraceImages* self, const uint8_t* p, const uint8_t* end) {
+	// varint mode, varint count, then a uint64_t base and varint path id each
+	bool retVal = true;
+	uint64_t mode = 0;
+	uint64_t count = 0;
+	if (FlowReader_readVarint(&p, end, &mode) && FlowReader_readVarint(&p, end, &count)) {
+		for (uint64_t i = 0; retVal && i < count && end - p >= (long) sizeof(uint64_t); i++) {
+			uint64_t base = 0;
+			uint64_t id = 0;
+			(void) memcpy(&base, p, sizeof(base));
+			p += sizeof(base);
+			if (FlowReader_readVarint(&p, end, &id) == false) {
+				break;
+			}
+			
+			if (mode != kTraceImagesAdding) {
+				removeImage(self, base);
+				
+			} else if (id >= self->pathCount) {
+				Log_error("undefined path: %llu", id);
+				
+			} else {
+				retVal = addImage(self, base, self->paths[id]);
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static bool readPathDefinition(TraceImages* self, const uint8_t* p, const uint8_t* end) {
+	// varint id, varint length then the path; each segment (or dump) defines them all again
+	bool retVal = true;
+	uint64_t id = 0;
+	uint64_t length = 0;
+	if (	FlowReader_readVarint(&p, end, &id) 
+		 && FlowReader_readVarint(&p, end, &length)
+		 && length <= (uint64_t) (end - p)
+		 && id < UINT32_MAX) {
+		if (id >= self->pathCount) {
+			uint32_t* paths = realloc(self->paths, (id + 1) * sizeof(uint32_t));
+			if (paths == NULL) {
+				Log_error("out of memory");
+				retVal = false;
+				
+			} else {
+				memset(&paths[self->pathCount], 0, (id + 1 - self->pathCount) * sizeof(uint32_t));
+				self->paths = paths;
+				self->pathCount = (uint32_t) id + 1;
+			}
+		}
+		if (retVal) {
+			retVal = addString(self, p, length, &self->paths[id]);
+		}
+	}
+	return retVal;
+}
+
+
+static bool readImageSymbols(TraceImages* self, const uint8_t* p, const uint8_t* end) {
+	// base, size, uuid, then a varint count of (varint offset delta, varint length, name)
+	bool retVal = true;
+	uint64_t base = 0;
+	uint64_t size = 0;
+	uint64_t count = 0;
+	if (end - p >= (long) (2 * sizeof(uint64_t) + 16)) {
+		(void) memcpy(&base, p, sizeof(base));
+		(void) memcpy(&size, p + sizeof(base), sizeof(size));
+		p += 2 * sizeof(uint64_t) + 16;
+		
+		uint32_t i = findLoaded(self, base);
+		if (	(i != kTraceImagesNone) 
+			 && (self->images[self->loaded[i]].base == base)
+			 && FlowReader_readVarint(&p, end, &count)
+			 && (count <= (uint64_t) (end - p))) {	// each takes at least a byte
+			TraceImage* image = &self->images[self->loaded[i]];
+			releaseImage(image);
+			image->read = true;
+			image->size = size;
+			image->offsets = malloc(count * sizeof(uint64_t));
+			image->names = malloc(count * sizeof(uint32_t));
+			if (count && (image->offsets == NULL || image->names == NULL)) {
+				Log_error("out of memory");
+				retVal = false;
+				
+			} else {
+				uint64_t offset = 0;
+				for (uint64_t j = 0; retVal && j < count; j++) {
+					uint64_t delta = 0;
+					uint64_t length = 0;
+					if (	(FlowReader_readVarint(&p, end, &delta) == false)
+						 || (FlowReader_readVarint(&p, end, &length) == false)
+						 || (length > (uint64_t) (end - p))) {
+						break;
+					}
+					offset += delta;
+					retVal = addString(self, p, length, &image->names[image->count]);
+					image->offsets[image->count++] = offset;
+					p += length;
+				}
+			}
+		}
+	}
+	return retVal;
+}
+
+
+static bool addString(TraceImages* self, const void* data, uint64_t length, uint32_t* offset) {
+	bool retVal = false;
+	if (self->strings.size + length + 1 > UINT32_MAX) {
+		Log_error("too many strings");
+		
+	} else {
+		*offset = (uint32_t) self->strings.size;
+		retVal = TraceBuffer_append(&self->strings, data, length) && TraceBuffer_append(&self->strings, "", 1);
+	}
+	return retVal;
+}
+
+
+static bool addImage(TraceImages* self, uint64_t base, uint32_t path) {
+	bool retVal = true;
+	bool add = true;
+	uint32_t i = findLoaded(self, base);
+	if (i != kTraceImagesNone && self->images[self->loaded[i]].base == base) {
+		const char* loaded = (const char*) &self->strings.data[self->images[self->loaded[i]].path];
+		if (strcmp(loaded, (const char*) &self->strings.data[path]) == 0) {
+			// every segment (and dump) starts by listing what's loaded
+			add = false;
+			
+		} else {
+			// something else is there now
+			removeImage(self, base);
+		}
+	}
+	
+	if (add && self->count == self->capacity) {
+		uint32_t capacity = self->capacity ? self->capacity * 2: 256;
+		TraceImage* images = realloc(self->images, capacity * sizeof(TraceImage));
+		uint32_t* loaded = realloc(self->loaded, capacity * sizeof(uint32_t));
+		if (images) {
+			self->images = images;
+		}
+		if (loaded) {
+			self->loaded = loaded;
+		}
+		if (images == NULL || loaded == NULL) {
+			Log_error("out of memory");
+			retVal = false;
+			
+		} else {
+			self->capacity = capacity;
+		}
+	}
+	
+	if (add && retVal) {
+		TraceImage* image = &self->images[self->count];
+		memset(image, 0, sizeof(*image));
+		image->base = base;
+		image->path = path;
+		image->loaded = true;
+		
+		// FNV-1a
+		image->hash = 0xCBF29CE484222325ull;
+		for (const uint8_t* p = &self->strings.data[path]; *p; p++) {
+			image->hash = (image->hash ^ *p) * 0x100000001B3ull;
+		}
+		
+		// keep the loaded ones sorted; there's only ever a few hundred
+		uint32_t j = self->loadedCount;
+		while (j && self->images[self->loaded[j - 1]].base > base) {
+			self->loaded[j] = self->loaded[j - 1];
+			j--;
+		}
+		self->loaded[j] = self->count++;
+		self->loadedCount++;
+	}
+	return retVal;
+}
+
+
+static void removeImage(TraceImages* self, uint64_t base) {
+	// a flight recorder dump can start after the image was added
+	uint32_t i = findLoaded(self, base);
+	if (i != kTraceImagesNone && self->images[self->loaded[i]].base == base) {
+		self->images[self->loaded[i]].loaded = false;
+		memmove(&self->loaded[i], &self->loaded[i + 1], (self->loadedCount - i - 1) * sizeof(uint32_t));
+		self->loadedCount--;
+	}
+}
+
+
+static uint32_t findLoaded(TraceImages* self, uint64_t address) {
+	// index (into loaded) of the image with the highest base at or below address
+	uint32_t retVal = kTraceImagesNone;
+	uint32_t low = 0;
+	uint32_t high = self->loadedCount;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		if (self->images[self->loaded[mid]].base <= address) {
+			retVal = mid;
+			low = mid + 1;
+			
+		} else {
+			high = mid;
+		}
+	}
+	return retVal;
+}
+
+
+static void readBinary(TraceImages* self, TraceImage* image) {
+	char path[PATH_MAX] = {0};
+	image->read = true;
+	(void) snprintf(path, sizeof(path), "%s%s", self->root, &self->strings.data[image->path]);
+	
+	// plenty of traces are read away from the machine that made them; so missing isn't an error
+	if (access(path, R_OK) == 0) {
+		image->cache = malloc(sizeof(SymbolCache));
+		if (image->cache == NULL) {
+			Log_error("out of memory");
+			
+		} else if (SymbolCache_open(image->cache, path, self->cpuType, self->cacheDir) == false) {
+			free(image->cache);
+			image->cache = NULL;
+			
+		} else {
+			image->size = SymbolCache_getHeader(image->cache)->size;
+		}
+	}
+}
+
+
+static void releaseImage(TraceImage* image) {
+	if (image->cache) {
+		SymbolCache_close(image->cache);
+		free(image->cache);
+	}
+	free(image->offsets);
+	free(image->names);
+	image->cache = NULL;
+	image->offsets = NULL;
+	image->names = NULL;
+	image->count = 0;
+}
+
+
+static const char* baseName(const char* path) {
+	const char* retVal = strrchr(path, '/');
+	return retVal ? retVal + 1: path;
+}
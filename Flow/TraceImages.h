@@ -0,0 +1,112 @@
+//
+//  TraceImages.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_TraceImages_h
+#define Flow_TraceImages_h
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "TraceBuffer.h"
+#include "SymbolCache.h"
+#include "FlowReader.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceImagesNone		(UINT32_MAX)	// no image (or symbol) contains the address
+#define kTraceImagesNameSize	(1024)		// what TraceImages_print allows for a name
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sTraceImage {
+	uint64_t		base;
+	uint64_t		size;			// 0 if we've neither the binary nor embedded symbols
+	uint32_t		path;			// offset into strings
+	uint64_t		hash;			// of the path; the same in every trace, unlike base
+	bool			loaded;
+	bool			read;			// we've looked for its symbols
+	SymbolCache*	cache;			// its symbols, from the binary; NULL if it's embedded or unreadable
+	uint64_t*		offsets;		// or those embedded in the log, sorted
+	uint32_t*		names;			// offsets into strings
+	uint32_t		count;
+} TraceImage;
+
+
+/*
+ * The images a log's process had loaded, from its meta records; give it every 
+ * FlowReaderMeta as it's read and it can say which image (and symbol) an address is
+ * in at that point in the trace.  Images are never removed, only marked unloaded, so
+ * an image index stays valid for the whole trace and can be kept with the blocks.
+ * Symbols come from the log (eTraceLogRecord_imageSymbols) if it has them, otherwise
+ * from the binary under root via SymbolCache.  TraceImages_print writes an address
+ * the way FlowCalls.py does; image::symbol+offset.  TraceImages_format does the same
+ * into a buffer, returning its length.
+ */
+typedef struct sTraceImages {
+	uint32_t		cpuType;
+	char*			root;			// prefixed to every image path; "" for none
+	char*			cacheDir;
+	TraceBuffer		strings;		// paths and embedded symbol names
+	uint32_t*		paths;			// offsets into strings; indexed by path id
+	uint32_t		pathCount;
+	
+	TraceImage*		images;			// in the order we saw them
+	uint32_t		count;
+	uint32_t		capacity;
+	uint32_t*		loaded;			// indexes of the loaded images, sorted by base
+	uint32_t		loadedCount;
+	uint32_t		last;			// TraceImages_find's last answer; most addresses are in the same one
+} TraceImages;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool TraceImages_create(TraceImages* self, uint32_t cpuType, const char* root);
+bool TraceImages_record(TraceImages* self, const FlowReaderMeta* meta);
+uint32_t TraceImages_find(TraceImages* self, uint64_t address);
+uint32_t TraceImages_findSymbol(TraceImages* self, uint32_t image, uint64_t address);
+const char* TraceImages_getPath(TraceImages* self, uint32_t image);
+bool TraceImages_getSymbol(TraceImages* self, uint32_t image, uint32_t symbol, uint64_t* address, const char** name);
+uint32_t TraceImages_format(TraceImages* self, char* buffer, uint32_t size, uint32_t image, uint32_t symbol, uint64_t address);
+void TraceImages_print(TraceImages* self, FILE* file, uint32_t image, uint32_t symbol, uint64_t address);
+void TraceImages_release(TraceImages* self);
+
+
+#endif
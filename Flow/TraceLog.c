@@ -25,25 +25,85 @@
 //
 
 #include "TraceLog.h"
+#include "TraceSummary.h"
+#include "Image.h"
 #include "Log.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <limits.h>
+#include <mach/mach_time.h>
 #include <mach-o/dyld_images.h>
 
 
 
 
+/*
+ * Struct/Enum definitions
+ */
+/*
+ * Architecture independent versions of struct dyld_image_info
+ * (basically pointers are uitn32_t or uint64_t) we only include 
+ * the fields we need as we're lazy
+ */
+typedef struct sDyldImageInfo32 {
+	uint32_t	imageLoadAddress;	/* base address image is mapped into */
+	uint32_t	imageFilePath;		/* path dyld used to load the image */
+	uint32_t	imageFileModDate;	/* time_t of image file */
+	/* if stat().st_mtime of imageFilePath does not match imageFileModDate, */
+	/* then file has been modified since dyld loaded it */
+} DyldImageInfo32;
+
+
+typedef struct sDyldImageInfo64 {
+	uint64_t	imageLoadAddress;	/* base address image is mapped into */
+	uint64_t	imageFilePath;		/* path dyld used to load the image */
+	uint64_t	imageFileModDate;	/* time_t of image file */
+	/* if stat().st_mtime of imageFilePath does not match imageFileModDate, */
+	/* then file has been modified since dyld loaded it */
+} DyldImageInfo64;
+
+
+
+
 /*
  * Static function definitions
  */
-static kern_return_t getDyldImageInfo32(Task* task, 
-										uint64_t* infoPtr, 
-										uint64_t* baseAddr, 
-										char* path);
-static kern_return_t getDyldImageInfo64(Task* task, 
-										uint64_t* infoPtr, 
-										uint64_t* baseAddr, 
-										char* path);
+static kern_return_t readDyldImageInfos(Task* task, 
+										VMAddr info, 
+										uint32_t infoCount, 
+										DyldImageInfo64* infos);
+static TraceStream* createStream(TraceLog* self, thread_t thread, uint64_t threadId);
+static TraceStream* findStream(TraceLog* self, Thread* thread);
+static void releaseStream(TraceStream* stream);
+static bool writeData(TraceLog* self, const void* data, uint64_t length);
+static bool endChunk(TraceLog* self);
+static bool endChunks(TraceLog* self);
+static bool startSegment(TraceLog* self);
+static bool writeDyld(TraceLog* self, VMAddr dyldImageLoadAddress);
+static bool encodeBlock(TraceLog* self, Block* block);
+static bool writeDictionaryBlock(TraceLog* self, Block* block);
+static bool writeBlock(TraceLog* self, Block* block);
+static bool foldBlock(TraceLog* self, Block* block);
+static bool flushFold(TraceLog* self);
+static inline bool sameBlock(Block* a, Block* b);
+static bool writeBranchBlock(TraceLog* self, Block* block);
+static void updateReturns(TraceLog* self, Block* block);
+static bool writeBranchAddress(TraceLog* self, TraceLogRecord record, VMAddr address);
+static bool addTakenBit(TraceLog* self, bool taken);
+static bool flushTakenBits(TraceLog* self);
+static bool writeBranchEnd(TraceLog* self);
+static bool writeImage(TraceLog* self, VMAddr base);
+static bool writeImages(TraceLog* self);
+static bool addImage(TraceLog* self, VMAddr base, uint32_t path);
+static void removeImage(TraceLog* self, VMAddr base);
+static bool writeCodePages(TraceLog* self, Block* block);
+static bool writeRecordType(TraceLog* self, TraceLogRecord record);
+static bool writeVarint(TraceLog* self, uint64_t value);
+static bool internPath(TraceLog* self, const char* path, uint32_t* id);
+static bool writePathDefinition(TraceLog* self, uint32_t id);
+static uint64_t hashPage(const uint8_t* data, uint64_t length);
+static uint64_t hashPath(const char* path);
 
 
 
@@ -51,25 +111,54 @@ static kern_return_t getDyldImageInfo64(Task* task,
 /*
  * Exported functions
  */
-bool TraceLog_open(TraceLog* self, Task* task, const char* path) {
+bool TraceLog_open(TraceLog* self, Task* task, const char* path, TraceLogOptions* options) {
 	bool retVal = false;
-	if (self == NULL || path == NULL) {
-		Log_invalidArgument("self: %p, path: %p", self, path);
+	if (self == NULL || path == NULL || options == NULL) {
+		Log_invalidArgument("self: %p, path: %p, options: %p", self, path, options);
 		
 	} else {
-		self->log = fopen(path, "wb");
-		if (self->log == NULL) {
-			Log_invalidArgument("fopen");
+		self->format = options->format;
+		self->flags = options->flags;
+		self->triggerPC = options->triggerPC;
+		self->trackImages = options->ringChunks != 0;
+		if (TraceWriter_open(&self->writer, 
+							 path, 
+							 options->output, 
+							 options->compressThreads, 
+							 options->ringChunks, 
+							 options->dropWhenFull) == false) {
+			Log_error("TraceWriter_open");
+			
+		} else if (createStream(self, MACH_PORT_NULL, 0) == NULL) {
+			Log_error("createStream");
 			
 		} else {
-			// write out the cpuType
-			uint32_t type = Task_getCpuType(task);
-			if (fwrite(&type, sizeof(type), 1, self->log) != 1) {
-				Log_error("fwrite");
+			// write out the header; this includes the cpuType
+			TraceLogHeader header = {0};
+			header.magic = kTraceLogMagic;
+			header.version = kTraceLogVersion;
+			header.format = self->format;
+			header.cpuType = Task_getCpuType(task);
+			header.flags = self->flags;
+			if (TraceWriter_write(&self->writer, &header, sizeof(header)) == false) {
+				Log_error("TraceWriter_write");
 				
 			} else {
 				self->task = task;
+				self->logOpen = true;
 				retVal = true;
+				
+				// a flight recorder's dumps, or a stream, can't be split up
+				if (	(options->ringChunks == 0)
+					 && (self->writer.output.type != eTraceOutputType_stream)
+					 && (options->segmentSize || options->segmentSeconds)) {
+					mach_timebase_info_data_t timebase = {0};
+					(void) mach_timebase_info(&timebase);
+					self->segmentSize = options->segmentSize;
+					self->segmentTicks = (options->segmentSeconds * 1000000000ull * timebase.denom) / timebase.numer;
+					self->segmentStart = mach_absolute_time();
+					self->trackImages = true;
+				}
 			}
 		}
 		
@@ -82,16 +171,8 @@ bool TraceLog_open(TraceLog* self, Task* task, const char* path) {
 
 
 bool TraceLog_dyldLoadAddress(TraceLog* self, VMAddr dyldImageLoadAddress) {
-	bool retVal = false;
-	uint8_t type = eTraceLogRecord_dyldLoadAddress;
-	if (	(fwrite(&type, sizeof(type), 1, self->log) != 1)
-		 || (fwrite(&dyldImageLoadAddress, sizeof(dyldImageLoadAddress), 1, self->log) != 1)) {
-		Log_error("fwrite");
-		
-	 } else {
-		 retVal = true;	
-	}	
-	return retVal;
+	self->stream = self->streams[0];
+	return writeDyld(self, dyldImageLoadAddress) && endChunk(self);
 }
 
 
@@ -114,45 +195,450 @@ bool TraceLog_libraryNotification(TraceLog* self, Thread* thread) {
 		 && (FunctionArgs_get(&args, sizeof(uint32_t), &infoCount) == KERN_SUCCESS)
 		 && (FunctionArgs_get(&args, wordSize, &info) == KERN_SUCCESS)) {
 		
-		// we've got the args, now write out them
-		uint8_t type = eTraceLogRecord_libraryNotification;
-		if (	(fwrite(&type, sizeof(type), 1, self->log) != 1)
-			 || (fwrite(&mode, sizeof(mode), 1, self->log) != 1)
-			 || (fwrite(&infoCount, sizeof(infoCount), 1, self->log) != 1)) {
-			Log_error("fwrite params");
+		// blocks run in what's being removed must be in the file before the removal
+		bool ended = (mode == dyld_image_adding || endChunks(self));
+		
+		/*
+		 * Read the whole info array at once, then each path (a page at a time).  Any 
+		 * path we've not seen before gets a eTraceLogRecord_pathDefinition and the
+		 * eTraceLogRecord_imageNotification (a varint mode and count, then a uint64_t 
+		 * base and varint path id per image) follows them.
+		 */
+		self->stream = self->streams[0];
+		DyldImageInfo64* infos = calloc(infoCount ? infoCount: 1, sizeof(DyldImageInfo64));
+		uint32_t* ids = calloc(infoCount ? infoCount: 1, sizeof(uint32_t));
+		if (ended == false) {
+			Log_error("endChunks");
+			
+		} else if (infos == NULL || ids == NULL) {
+			Log_error("out of memory; infoCount: %u", infoCount);
+			
+		} else if (readDyldImageInfos(self->task, info, infoCount, infos) != KERN_SUCCESS) {
+			Log_error("readDyldImageInfos: %llx", info);
 			
 		} else {
 			retVal = true;
-			
-			// now read all the info structures and log them out
 			for (uint32_t i = 0; retVal && i < infoCount; i++) {
-				uint64_t baseAddress = 0;
 				char path[PATH_MAX] = {0};
-				
-				if (wordSize == sizeof(uint32_t)) {
-					retVal = getDyldImageInfo32(self->task, &info, &baseAddress, path) == KERN_SUCCESS;
+				if (Task_readString(self->task, infos[i].imageFilePath, path, sizeof(path)) != KERN_SUCCESS) {
+					Log_error("Task_readString: %llx", infos[i].imageFilePath);
+					retVal = false;
 					
 				} else {
-					retVal = getDyldImageInfo64(self->task, &info, &baseAddress, path) == KERN_SUCCESS;
+					printf("%s %llx, path: %s\n", mode == dyld_image_adding ? "+": "-", infos[i].imageLoadAddress, path);
+					retVal = internPath(self, path, &ids[i]);
 				}
 				
-				printf("%s %llx, path: %s\n", mode == dyld_image_adding ? "+": "-", baseAddress, path);
+				if (self->trackImages && retVal) {
+					// a dump or segment has to describe whatever's loaded; the chunk that said so may be long gone
+					if (mode == dyld_image_adding) {
+						retVal = addImage(self, infos[i].imageLoadAddress, ids[i]);
+					} else {
+						removeImage(self, infos[i].imageLoadAddress);
+					}
+				}
+			}
+			
+			if (	(retVal == false)
+				 || (writeRecordType(self, eTraceLogRecord_imageNotification) == false)
+				 || (writeVarint(self, mode) == false)
+				 || (writeVarint(self, infoCount) == false)) {
+				Log_error("write params");
+				retVal = false;
 				
-				uint16_t length = strlen(path);
-				if (	(fwrite(&baseAddress, sizeof(baseAddress), 1, self->log) != 1)
-					 || (fwrite(&length, sizeof(length), 1, self->log) != 1)
-					 || (fwrite(&path, length, 1, self->log) != 1)) {
-					Log_error("fwrite imageInfo: %u", i);
-					retVal = false;
+			} else {
+				self->stream->current.flags |= eTraceLogChunkFlag_images;
+				for (uint32_t i = 0; retVal && i < infoCount; i++) {
+					if (	(writeData(self, &infos[i].imageLoadAddress, sizeof(infos[i].imageLoadAddress)) == false)
+						 || (writeVarint(self, ids[i]) == false)) {
+						Log_error("write imageInfo: %u", i);
+						retVal = false;
+					}
 				}
 			}
+			
+			// the images symbols go after the notification so they don't split it up
+			for (uint32_t i = 0; retVal && (self->flags & eTraceLogFlag_embedImages) && mode == dyld_image_adding && i < infoCount; i++) {
+				retVal = writeImage(self, infos[i].imageLoadAddress);
+			}
+			
+			// write it now; the threads chunks which use these images are written after it
+			retVal = retVal && endChunk(self);
+		}
+		free(infos);
+		free(ids);
+	}
+	return retVal;
+}
+
+
+bool TraceLog_block(TraceLog* self, Thread* thread, Block* block) {
+	bool retVal = true;
+	if (self->stream == NULL || self->stream->thread != thread->thread) {
+		self->stream = findStream(self, thread);
+	}
+	
+	TraceStream* stream = self->stream;
+	if (stream == NULL) {
+		retVal = false; // error already logged
+		
+	} else if (stream->chunk.size == 0) {
+		/*
+		 * The chunk header says which thread and block we're at; this adds the call depth.
+		 * With it a reader can decode the chunks separately (on as many threads as it 
+		 * likes) and still put the calls back together.
+		 */
+		retVal = (	   writeRecordType(self, eTraceLogRecord_sync)
+					&& writeVarint(self, stream->depth));
+		
+	} else if (stream->nextBlock != self->blockCount) {
+		/*
+		 * Another thread has run since our last block; so say which block this is.  The 
+		 * chunk header has the first block's number and they count up from there until a
+		 * eTraceLogRecord_sequence (a varint) says otherwise.  In branch format we end the 
+		 * run first so the reader knows exactly which block it applies to.
+		 */
+		retVal = (	   flushFold(self)
+					&& writeBranchEnd(self)
+					&& writeRecordType(self, eTraceLogRecord_sequence)
+					&& writeVarint(self, self->blockCount));
+	}
+	
+	if (stream) {
+		if (retVal == false) {
+			Log_error("write sync/sequence");
+			
+		} else if (	   (self->flags & eTraceLogFlag_embedImages)
+					&& (writeCodePages(self, block) == false)) {
+			retVal = false; // error already logged
+			
+		} else if (self->format == eTraceLogFormat_branch) {
+			retVal = writeBranchBlock(self, block);
+			
+		} else {
+			retVal = foldBlock(self, block);
+		}
+		
+		// whichever way it's written, it's in this chunk
+		TraceSummary_add(&stream->summary, block->entry, block->branch);
+		if (block->type == eBranchType_call) {
+			stream->depth++;
+			
+		} else if (block->type == eBranchType_ret && stream->depth) {
+			stream->depth--;
+		}
+		
+		self->blockCount++;
+		stream->nextBlock = self->blockCount;
+	}
+	
+	if (retVal && stream->chunk.size >= kTraceLogChunkSize) {
+		retVal = endChunk(self);
+	}
+	
+	if (retVal && self->triggerPC && block->entry <= self->triggerPC && self->triggerPC <= block->branch) {
+		// only the first time; in a loop we'd just be dumping the same few blocks
+		VMAddr pc = self->triggerPC;
+		self->triggerPC = 0;
+		retVal = TraceLog_trigger(self, eTraceLogTrigger_pc, 0, pc);
+	}
+	
+	if (	(retVal)
+		 && (	(self->segmentSize && self->segmentBytes >= self->segmentSize)
+			 || (self->segmentTicks && mach_absolute_time() - self->segmentStart >= self->segmentTicks))) {
+		retVal = startSegment(self);
+	}
+	return retVal;
+}
+
+
+bool TraceLog_trigger(TraceLog* self, TraceLogTrigger trigger, uint32_t code, VMAddr pc) {
+	bool retVal = false;
+	
+	/*
+	 * The trigger record is a uint8_t reason, a uint32_t code (the signal for 
+	 * eTraceLogTrigger_signal) and the pc it happened at (0 if we don't know).
+	 *
+	 * In flight recorder mode we then write out the ring.  As the chunks which described
+	 * the loaded images have probably been dropped we first write a chunk which repeats
+	 * them; the dyld address and a single notification adding everything loaded.
+	 */
+	uint8_t reason = trigger;
+	self->stream = self->streams[0];
+	if (	(writeRecordType(self, eTraceLogRecord_trigger) == false)
+		 || (writeData(self, &reason, sizeof(reason)) == false)
+		 || (writeData(self, &code, sizeof(code)) == false)
+		 || (writeData(self, &pc, sizeof(pc)) == false)) {
+		Log_error("write trigger");
+		
+	} else if (self->writer.ringSize == 0) {
+		retVal = endChunk(self); // we're writing everything anyway
+		
+	} else if (endChunks(self) == false) {
+		Log_error("endChunks");
+		
+	} else if (writeImages(self) == false) {
+		Log_error("writeImages");
+		
+	} else {
+		retVal = TraceWriter_dump(&self->writer, &self->stream->chunk, &self->stream->current, &self->stream->summary);
+		TraceBuffer_reset(&self->stream->chunk);
+		bzero(&self->stream->current, sizeof(self->stream->current));
+		bzero(&self->stream->summary, sizeof(self->stream->summary));
+	}
+	return retVal;
+}
+
+
+void TraceLog_close(TraceLog* self) {
+	if (self && self->logOpen) {
+		(void) endChunks(self);
+		self->logOpen = false;
+	}
+	if (self) {
+		TraceWriter_close(&self->writer);
+		for (uint32_t i = 0; i < self->streamCount; i++) {
+			releaseStream(self->streams[i]);
+		}
+		free(self->streams);
+		self->streams = NULL;
+		self->streamCount = 0;
+		self->streamCapacity = 0;
+		self->stream = NULL;
+		
+		free(self->images);
+		self->images = NULL;
+		self->imageCount = 0;
+		self->imageCapacity = 0;
+		
+		for (uint32_t i = 0; i < self->pathCount; i++) {
+			free(self->paths[i].path);
+		}
+		free(self->paths);
+		self->paths = NULL;
+		self->pathCount = 0;
+		self->pathCapacity = 0;
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static TraceStream* createStream(TraceLog* self, thread_t thread, uint64_t threadId) {
+	TraceStream* retVal = NULL;
+	if (self->streamCount == self->streamCapacity) {
+		uint32_t capacity = self->streamCapacity ? self->streamCapacity * 2: 16;
+		TraceStream** streams = realloc(self->streams, capacity * sizeof(TraceStream*));
+		if (streams) {
+			self->streams = streams;
+			self->streamCapacity = capacity;
+		}
+	}
+	
+	TraceStream* stream = calloc(1, sizeof(TraceStream));
+	if (self->streamCount == self->streamCapacity || stream == NULL) {
+		Log_error("out of memory");
+		free(stream);
+		
+	} else if (	   (self->format == eTraceLogFormat_dictionary)
+				&& (BlockDictionary_create(&stream->dictionary, 0) == false)) {
+		Log_error("BlockDictionary_create");
+		releaseStream(stream);
+		
+	} else if (	   (self->flags & eTraceLogFlag_embedImages)
+				&& (	(HashSet_create(&stream->pages, 0) == false)
+					 || (HashSet_create(&stream->pageContents, 0) == false))) {
+		Log_error("HashSet_create");
+		releaseStream(stream);
+		
+	} else if (TraceBuffer_create(&stream->chunk, kTraceLogChunkSize + (kTraceLogChunkSize / 4)) == false) {
+		Log_error("TraceBuffer_create");
+		releaseStream(stream);
+		
+	} else {
+		stream->thread = thread;
+		stream->threadId = threadId;
+		self->streams[self->streamCount++] = stream;
+		retVal = stream;
+	}
+	return retVal;
+}
+
+
+static TraceStream* findStream(TraceLog* self, Thread* thread) {
+	TraceStream* retVal = NULL;
+	
+	// there aren't normally many threads; so we just search
+	for (uint32_t i = 1; retVal == NULL && i < self->streamCount; i++) {
+		if (self->streams[i]->thread == thread->thread) {
+			retVal = self->streams[i];
+		}
+	}
+	
+	if (retVal == NULL) {
+		retVal = createStream(self, thread->thread, Thread_getId(thread));
+	}
+	return retVal;
+}
+
+
+static void releaseStream(TraceStream* stream) {
+	TraceBuffer_release(&stream->chunk);
+	BlockDictionary_release(&stream->dictionary);
+	HashSet_release(&stream->pages);
+	HashSet_release(&stream->pageContents);
+	free(stream);
+}
+
+
+static bool writeData(TraceLog* self, const void* data, uint64_t length) {
+	if (self->stream->chunk.size == 0) {
+		// first record in the chunk; note where we are for its header
+		self->stream->current.firstBlock = self->blockCount;
+		self->stream->current.timestamp = mach_absolute_time();
+		self->stream->current.thread = self->stream->threadId;
+	}
+	return TraceBuffer_append(&self->stream->chunk, data, length);
+}
+
+
+static bool endChunk(TraceLog* self) {
+	bool retVal = true;
+	
+	// whatever comes next has to be decodable without this chunk; so finish off its state
+	if (flushFold(self) == false || writeBranchEnd(self) == false) {
+		retVal = false;
+		
+	} else if (self->stream->chunk.size) {
+		// this takes the chunk's buffer; leaving us an empty one
+		self->segmentBytes += self->stream->chunk.size;
+		retVal = TraceWriter_submit(&self->writer, &self->stream->chunk, &self->stream->current, &self->stream->summary);
+	}
+	
+	TraceBuffer_reset(&self->stream->chunk);
+	bzero(&self->stream->current, sizeof(self->stream->current));
+	bzero(&self->stream->summary, sizeof(self->stream->summary));
+	BlockDictionary_reset(&self->stream->dictionary);
+	HashSet_reset(&self->stream->pages);
+	HashSet_reset(&self->stream->pageContents);
+	self->stream->lastPage = 0;
+	self->stream->silentCount = 0;
+	self->stream->returnTop = 0;
+	self->stream->returnCount = 0;
+	self->stream->returnValid = false;
+	self->stream->historyCount = 0;
+	bzero(self->stream->foldLast, sizeof(self->stream->foldLast));
+	return retVal;
+}
+
+
+static bool endChunks(TraceLog* self) {
+	bool retVal = true;
+	
+	// the thread streams first; so the metadata stream can't end up ahead of anything
+	for (uint32_t i = self->streamCount; i > 0; i--) {
+		self->stream = self->streams[i - 1];
+		if (endChunk(self) == false) {
+			retVal = false;
+		}
+	}
+	return retVal;
+}
+
+
+static bool startSegment(TraceLog* self) {
+	bool retVal = false;
+	
+	/*
+	 * Each segment has to be readable on its own; every stream's chunk ends here (so
+	 * each thread starts the next segment with fresh decode state and its sequence 
+	 * number in the chunk header), then the first chunk in it repeats what's loaded.
+	 */
+	if (endChunks(self) == false) {
+		Log_error("endChunks");
+		
+	} else if (TraceWriter_rotate(&self->writer) == false) {
+		Log_error("TraceWriter_rotate");
+		
+	} else if (writeImages(self) == false || endChunk(self) == false) {
+		Log_error("writeImages");
+		
+	} else {
+		self->segmentBytes = 0;
+		self->segmentStart = mach_absolute_time();
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static bool writeDyld(TraceLog* self, VMAddr dyldImageLoadAddress) {
+	bool retVal = false;
+	uint8_t type = eTraceLogRecord_dyldLoadAddress;
+	if (	(writeData(self, &type, sizeof(type)) == false)
+		 || (writeData(self, &dyldImageLoadAddress, sizeof(dyldImageLoadAddress)) == false)) {
+		Log_error("write");
+		
+	} else {
+		self->dyldAddress = dyldImageLoadAddress;
+		self->stream->current.flags |= eTraceLogChunkFlag_images;
+		retVal = true;	
+		if (self->flags & eTraceLogFlag_embedImages) {
+			retVal = writeImage(self, dyldImageLoadAddress);
+		}
+	}	
+	return retVal;
+}
+
+
+static bool encodeBlock(TraceLog* self, Block* block) {
+	bool retVal = false;
+	if (self->format == eTraceLogFormat_dictionary) {
+		retVal = writeDictionaryBlock(self, block);
+		
+	} else {
+		retVal = writeBlock(self, block);
+	}
+	return retVal;
+}
+
+
+static bool writeDictionaryBlock(TraceLog* self, Block* block) {
+	bool retVal = false;
+	
+	/*
+	 * In dictionary format the first time we see a block we write out a definition 
+	 * record (a normal block record with a eTraceLogRecord_blockDefinition prefix); 
+	 * after that we just write the block's id.  The ids are allocated in definition 
+	 * order so the reader can rebuild the table as it goes.
+	 *
+	 * The id is a varint whose first byte is |0cxxxxxx| (the top bit is always 
+	 * clear so it can't be confused with a meta record); any following bytes are 
+	 * |cxxxxxxx|.  c is set if another byte follows.
+	 */
+	uint32_t id = 0;
+	bool added = false;
+	if (BlockDictionary_lookup(&self->stream->dictionary, block, &id, &added)) {
+		if (added) {
+			uint8_t type = eTraceLogRecord_blockDefinition;
+			if (writeData(self, &type, sizeof(type)) == false) {
+				Log_error("write definition");
+				
+			} else {
+				retVal = writeBlock(self, block);
+			}
+		} else {
+			retVal = writeVarint(self, id);
 		}
 	}
 	return retVal;
 }
 
 
-bool TraceLog_block(TraceLog* self, Block* block) {
+static bool writeBlock(TraceLog* self, Block* block) {
 	bool retVal = false;
 	
 	/*
@@ -183,98 +669,587 @@ bool TraceLog_block(TraceLog* self, Block* block) {
 		deltaBits = delta & 0x1F;
 	}
 	uint8_t type = 0x00 | fcBits | deltaBits;
-	if (	(fwrite(&type, sizeof(type), 1, self->log) != 1)
-		 || (fwrite(&block->entry, sizeof(block->entry), 1, self->log) != 1)) {
-		Log_error("fwrite type/entry");
+	
+	/*
+	 * In raw format, if we've landed where the shadow stack says the last ret should 
+	 * have, we write a eTraceLogRecord_return instead of the entry; the length of the 
+	 * call instruction (the reader has the call's branch address) then the type.
+	 */
+	bool returned = (	   (self->format == eTraceLogFormat_raw)
+					  && self->stream->returnValid
+					  && (block->entry == self->stream->returnAddress));
+	uint8_t record = eTraceLogRecord_return;
+	if (	returned
+		 && (	(writeData(self, &record, sizeof(record)) == false)
+			 || (writeData(self, &self->stream->returnCallLength, sizeof(uint8_t)) == false)
+			 || (writeData(self, &type, sizeof(type)) == false))) {
+		Log_error("write return");
+		
+	} else if (	   (returned == false)
+				&& (	(writeData(self, &type, sizeof(type)) == false)
+					 || (writeData(self, &block->entry, sizeof(block->entry)) == false))) {
+		Log_error("write type/entry");
 		
 	} else {
 		retVal = true;
 		if (deltaBits == 0x1F) {
-			if (fwrite(&block->branch, sizeof(block->branch), 1, self->log) != 1) {
-				Log_error("fwrite offset");
+			if (writeData(self, &block->branch, sizeof(block->branch)) == false) {
+				Log_error("write offset");
 				retVal = false;
 			}
 		}
+		
+		if (self->format == eTraceLogFormat_raw) {
+			updateReturns(self, block);
+		}
 	}
 	return retVal;	
 }
 
 
-void TraceLog_close(TraceLog* self) {
-	if (self && self->log) {
-		fclose(self->log);
-		self->log = NULL;
+static bool foldBlock(TraceLog* self, Block* block) {
+	bool retVal = true;
+	TraceStream* stream = self->stream;
+	
+	/*
+	 * Loops mean the same few blocks over and over.  So when the last time we saw this 
+	 * block (found through a small hash of entries) is within kTraceLogFoldWindow we hold
+	 * back the blocks which follow for as long as they repeat the ones before it.  Once 
+	 * they stop flushFold writes the whole repeats as one eTraceLogRecord_fold and the 
+	 * remainder normally.  All this state is reset with the chunk.
+	 */
+	bool held = false;
+	if (stream->foldPeriod) {
+		if (sameBlock(block, &stream->pattern[stream->foldMatched % stream->foldPeriod])) {
+			stream->foldMatched++;
+			held = true;
+			
+		} else {
+			retVal = flushFold(self);
+		}
 	}
+	
+	uint32_t hash = (uint32_t) ((block->entry * 0x9E3779B97F4A7C15ull) >> (64 - kTraceLogFoldHashBits));
+	uint64_t last = stream->foldLast[hash];
+	uint64_t period = stream->historyCount + 1 - last;
+	if (held || retVal == false) {
+		// nothing to do
+		
+	} else if (	   (last != 0)
+				&& (period <= kTraceLogFoldWindow)
+				&& sameBlock(block, &stream->history[(last - 1) % kTraceLogFoldWindow])) {
+		// the start of a repeat; the pattern is the blocks since we last saw this one
+		for (uint64_t i = 0; i < period; i++) {
+			stream->pattern[i] = stream->history[(stream->historyCount - period + i) % kTraceLogFoldWindow];
+		}
+		stream->foldPeriod = period;
+		stream->foldMatched = 1;
+		
+	} else {
+		retVal = encodeBlock(self, block);
+	}
+	
+	stream->history[stream->historyCount % kTraceLogFoldWindow] = *block;
+	stream->historyCount++;
+	stream->foldLast[hash] = stream->historyCount;
+	return retVal;
 }
 
 
+static bool flushFold(TraceLog* self) {
+	bool retVal = true;
+	TraceStream* stream = self->stream;
+	if (stream->foldPeriod) {
+		// a eTraceLogRecord_fold is two varints; the reader repeats its previous period blocks count times
+		uint64_t count = stream->foldMatched / stream->foldPeriod;
+		uint64_t folded = count * stream->foldPeriod;
+		if (folded < kTraceLogFoldMinBlocks) {
+			folded = 0;
+			
+		} else if (	   (writeRecordType(self, eTraceLogRecord_fold) == false)
+					|| (writeVarint(self, stream->foldPeriod) == false)
+					|| (writeVarint(self, count) == false)) {
+			Log_error("write fold");
+			retVal = false;
+			
+		} else if (self->format == eTraceLogFormat_raw) {
+			// the reader's shadow stack sees the repeated blocks; so ours has to
+			for (uint64_t i = 0; i < folded; i++) {
+				updateReturns(self, &stream->pattern[i % stream->foldPeriod]);
+			}
+		}
+		
+		for (uint64_t i = folded; retVal && i < stream->foldMatched; i++) {
+			retVal = encodeBlock(self, &stream->pattern[i % stream->foldPeriod]);
+		}
+		stream->foldPeriod = 0;
+		stream->foldMatched = 0;
+	}
+	return retVal;
+}
 
 
-/*
- * Static function implementations
- */
+static inline bool sameBlock(Block* a, Block* b) {
+	return a->entry == b->entry && a->branch == b->branch && a->type == b->type;
+}
 
-/*
- * architecture independent versions of struct dyld_image_info
- * (basically pointers are uitn32_t or uint64_t) we only include 
- * the fields we need as we're lazy
- */
-typedef struct sDyldImageInfo32 {
-	uint32_t	imageLoadAddress;	/* base address image is mapped into */
-	uint32_t	imageFilePath;		/* path dyld used to load the image */
-	uint32_t	imageFileModDate;	/* time_t of image file */
-	/* if stat().st_mtime of imageFilePath does not match imageFileModDate, */
-	/* then file has been modified since dyld loaded it */
-} DyldImageInfo32;
 
+static bool writeBranchBlock(TraceLog* self, Block* block) {
+	bool retVal = true;
+	
+	/*
+	 * In branch format we don't write the block at all; we write just enough for a 
+	 * reader to work out where the previous block's branch went.  Given that, it can 
+	 * find this block's branch itself by decoding the code from entry, exactly as 
+	 * findNextBranch did.  So:
+	 *  - direct jmp/call/syscall: the code says where we went; nothing is written
+	 *  - conditional: one taken/not-taken bit, packed 6 to a byte
+	 *  - indirect and ret: a eTraceLogRecord_branchTarget with the full address
+	 *  - ret to where the shadow stack says (see updateReturns): a eTraceLogRecord_return
+	 *
+	 * If we end up somewhere the code can't explain (a signal, exception etc) we write a 
+	 * eTraceLogRecord_branchResync.  As direct branches write nothing the resync includes 
+	 * how many of them the reader should follow before applying it; the same goes for the 
+	 * eTraceLogRecord_branchEnd we finish with.
+	 *
+	 * Taken bits are written as |0sxxxxxx|; s being the highest set bit (the stop bit) and 
+	 * the outcomes below it, oldest in bit 0.  Pending bits are always flushed before any 
+	 * other record so a reader never has to look past a partial byte.
+	 */
+	if (self->stream->lastBlockValid == false) {
+		retVal = writeBranchAddress(self, eTraceLogRecord_branchTarget, block->entry);
+		
+	} else {
+		Block* last = &self->stream->lastBlock;
+		if (	   (last->type == eBranchType_ret)
+			&& self->stream->returnValid
+			&& (block->entry == self->stream->returnAddress)) {
+			// the reader has the same shadow stack; so it knows where we went
+			retVal = writeRecordType(self, eTraceLogRecord_return);
+			self->stream->silentCount = 0;
+			
+		} else if (last->target == 0) {
+			retVal = writeBranchAddress(self, eTraceLogRecord_branchTarget, block->entry);
+			
+		} else if (	   last->conditional 
+					&& (block->entry == last->target || block->entry == last->next)) {
+			retVal = addTakenBit(self, block->entry == last->target);
+			
+		} else if (last->conditional == false && block->entry == last->target) {
+			self->stream->silentCount++;
+			
+		} else {
+			retVal = writeBranchAddress(self, eTraceLogRecord_branchResync, block->entry);
+		}
+	}
+	self->stream->lastBlock = *block;
+	self->stream->lastBlockValid = true;
+	updateReturns(self, block);
+	return retVal;
+}
 
-typedef struct sDyldImageInfo64 {
-	uint64_t	imageLoadAddress;	/* base address image is mapped into */
-	uint64_t	imageFilePath;		/* path dyld used to load the image */
-	uint64_t	imageFileModDate;	/* time_t of image file */
-	/* if stat().st_mtime of imageFilePath does not match imageFileModDate, */
-	/* then file has been modified since dyld loaded it */
-} DyldImageInfo64;
+
+static void updateReturns(TraceLog* self, Block* block) {
+	TraceStream* stream = self->stream;
+	
+	/*
+	 * The shadow stack; calls push where they'll return to and rets pop it, so we know 
+	 * where the next block should be.  The reader keeps exactly the same stack (it's
+	 * reset with each chunk) so when we're right (anything but longjmp, exceptions and 
+	 * the like) it doesn't need the address.  If it overflows we lose the oldest entries.
+	 */
+	stream->returnValid = false;
+	if (block->type == eBranchType_call) {
+		stream->returns[stream->returnTop] = block->next;
+		stream->callLengths[stream->returnTop] = block->next - block->branch;
+		stream->returnTop = (stream->returnTop + 1) % kTraceLogReturnStackSize;
+		if (stream->returnCount < kTraceLogReturnStackSize) {
+			stream->returnCount++;
+		}
+		
+	} else if (block->type == eBranchType_ret && stream->returnCount) {
+		stream->returnTop = (stream->returnTop + kTraceLogReturnStackSize - 1) % kTraceLogReturnStackSize;
+		stream->returnCount--;
+		stream->returnAddress = stream->returns[stream->returnTop];
+		stream->returnCallLength = stream->callLengths[stream->returnTop];
+		stream->returnValid = true;
+	}
+}
 
 
+static bool writeBranchAddress(TraceLog* self, TraceLogRecord record, VMAddr address) {
+	bool retVal = false;
+	uint8_t type = record;
+	if (	(flushTakenBits(self) == false)
+		 || (writeData(self, &type, sizeof(type)) == false)
+		 || (	(record == eTraceLogRecord_branchResync)
+			 && (writeVarint(self, self->stream->silentCount) == false))
+		 || (writeData(self, &address, sizeof(address)) == false)) {
+		Log_error("write branch address");
+		
+	} else {
+		self->stream->silentCount = 0;
+		retVal = true;
+	}
+	return retVal;
+}
 
 
-static kern_return_t getDyldImageInfo32(Task* task, 
-										uint64_t* infoPtr, 
-										uint64_t* baseAddr, 
-										char* path) {
-	DyldImageInfo32 imageInfo = {0};
-	kern_return_t retVal = Task_readMemory(task, 
-										   *infoPtr, 
-										   &imageInfo, 
-										   sizeof(imageInfo));
-	if (retVal == KERN_SUCCESS) {
-		retVal = Task_readString(task, imageInfo.imageFilePath, path, PATH_MAX);
-		if (retVal == KERN_SUCCESS) {
-			*baseAddr = imageInfo.imageLoadAddress;
-			*infoPtr += sizeof(imageInfo);
-		}		
+static bool addTakenBit(TraceLog* self, bool taken) {
+	bool retVal = true;
+	if (taken) {
+		self->stream->takenBits |= 1 << self->stream->takenCount;
+	}
+	self->stream->takenCount++;
+	self->stream->silentCount = 0;
+	if (self->stream->takenCount == 6) {
+		retVal = flushTakenBits(self);
 	}
 	return retVal;
 }
 
 
-static kern_return_t getDyldImageInfo64(Task* task, 
-										uint64_t* infoPtr, 
-										uint64_t* baseAddr, 
-										char* path) {
-	DyldImageInfo64 imageInfo = {0};
-	kern_return_t retVal = Task_readMemory(task, 
-										   *infoPtr, 
-										   &imageInfo, 
-										   sizeof(imageInfo));
-	if (retVal == KERN_SUCCESS) {
-		retVal = Task_readString(task, imageInfo.imageFilePath, path, PATH_MAX);
-		if (retVal == KERN_SUCCESS) {
-			*baseAddr = imageInfo.imageLoadAddress;
-			*infoPtr += sizeof(imageInfo);
-		}		
+static bool flushTakenBits(TraceLog* self) {
+	bool retVal = true;
+	if (self->stream->takenCount) {
+		uint8_t type = (1 << self->stream->takenCount) | self->stream->takenBits;
+		if (writeData(self, &type, sizeof(type)) == false) {
+			Log_error("write taken bits");
+			retVal = false;
+		}
+		self->stream->takenBits = 0;
+		self->stream->takenCount = 0;
 	}
-	return retVal;	
+	return retVal;
+}
+
+
+static bool writeBranchEnd(TraceLog* self) {
+	bool retVal = true;
+	
+	// without this a reader can't tell how many direct branches to follow after the last record
+	if (self->format == eTraceLogFormat_branch && self->stream->lastBlockValid) {
+		uint8_t type = eTraceLogRecord_branchEnd;
+		if (	(flushTakenBits(self) == false)
+			 || (writeData(self, &type, sizeof(type)) == false)
+			 || (writeVarint(self, self->stream->silentCount) == false)) {
+			Log_error("write branch end");
+			retVal = false;
+		}
+		self->stream->lastBlockValid = false;
+	}
+	return retVal;
+}
+
+
+static bool writeImage(TraceLog* self, VMAddr base) {
+	bool retVal = false;
+	
+	/*
+	 * So the log can be analysed without the original binaries we write out each images 
+	 * symbols; base, size, uuid then a varint count of symbols.  Each symbol is a varint
+	 * offset delta (they're sorted), a varint length and the name.
+	 */
+	Image image = {0};
+	if (Image_read(&image, self->task, base) != KERN_SUCCESS) {
+		// not fatal; we just wont have symbols for it
+		Log_error("Image_read: %llx", base);
+		retVal = true;
+		
+	} else if (	   (writeRecordType(self, eTraceLogRecord_imageSymbols) == false)
+				|| (writeData(self, &image.base, sizeof(image.base)) == false)
+				|| (writeData(self, &image.size, sizeof(image.size)) == false)
+				|| (writeData(self, image.uuid, sizeof(image.uuid)) == false)
+				|| (writeVarint(self, image.count) == false)) {
+		Log_error("write image");
+		
+	} else {
+		retVal = true;
+		uint64_t offset = 0;
+		for (uint32_t i = 0; retVal && i < image.count; i++) {
+			const char* name = &image.strings[image.symbols[i].name];
+			size_t length = strlen(name);
+			if (	(writeVarint(self, image.symbols[i].offset - offset) == false)
+				 || (writeVarint(self, length) == false)
+				 || (writeData(self, name, length) == false)) {
+				Log_error("write symbol: %u", i);
+				retVal = false;
+			}
+			offset = image.symbols[i].offset;
+		}
+	}
+	Image_release(&image);
+	return retVal;
+}
+
+
+static bool writeImages(TraceLog* self) {
+	bool retVal = true;
+	if (self->dyldAddress) {
+		retVal = writeDyld(self, self->dyldAddress);
+	}
+	
+	// all the paths; notifications still in the ring may refer to ones dropped with their chunks
+	for (uint32_t i = 0; retVal && i < self->pathCount; i++) {
+		retVal = writePathDefinition(self, i);
+	}
+	
+	if (	(retVal == false)
+		 || (writeRecordType(self, eTraceLogRecord_imageNotification) == false)
+		 || (writeVarint(self, dyld_image_adding) == false)
+		 || (writeVarint(self, self->imageCount) == false)) {
+		Log_error("write images");
+		retVal = false;
+		
+	} else {
+		self->stream->current.flags |= eTraceLogChunkFlag_images;
+		for (uint32_t i = 0; retVal && i < self->imageCount; i++) {
+			if (	(writeData(self, &self->images[i].base, sizeof(self->images[i].base)) == false)
+				 || (writeVarint(self, self->images[i].path) == false)) {
+				Log_error("write image: %u", i);
+				retVal = false;
+			}
+		}
+		
+		for (uint32_t i = 0; retVal && (self->flags & eTraceLogFlag_embedImages) && i < self->imageCount; i++) {
+			retVal = writeImage(self, self->images[i].base);
+		}
+	}
+	return retVal;
+}
+
+
+static bool addImage(TraceLog* self, VMAddr base, uint32_t path) {
+	bool retVal = false;
+	if (self->imageCount == self->imageCapacity) {
+		uint32_t capacity = self->imageCapacity ? self->imageCapacity * 2: 64;
+		TraceLogImage* images = realloc(self->images, capacity * sizeof(TraceLogImage));
+		if (images) {
+			self->images = images;
+			self->imageCapacity = capacity;
+		}
+	}
+	
+	if (self->imageCount == self->imageCapacity) {
+		Log_error("out of memory");
+		
+	} else {
+		self->images[self->imageCount].base = base;
+		self->images[self->imageCount].path = path;
+		self->imageCount++;
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static void removeImage(TraceLog* self, VMAddr base) {
+	for (uint32_t i = 0; i < self->imageCount; i++) {
+		if (self->images[i].base == base) {
+			self->images[i] = self->images[--self->imageCount];
+			break;
+		}
+	}
+}
+
+
+static bool writeCodePages(TraceLog* self, Block* block) {
+	bool retVal = true;
+	
+	/*
+	 * Make sure every page the block touches is in the log.  Page contents are written 
+	 * once (eTraceLogRecord_codePage), keyed by a hash of the contents; then each address 
+	 * its seen at is mapped to it (eTraceLogRecord_codePageMap).  We do this before the 
+	 * block so in branch format the reader has the code before it needs to decode it.
+	 */
+	VMAddr end = block->next > block->branch ? block->next: block->branch + 1;
+	for (VMAddr page = block->entry & ~((VMAddr) kTraceLogPageSize - 1); 
+		 retVal && page < end; 
+		 page += kTraceLogPageSize) {
+		bool added = false;
+		if (page == self->stream->lastPage) {
+			continue;
+			
+		} else if (HashSet_add(&self->stream->pages, page, &added) == false) {
+			retVal = false;
+			
+		} else if (added) {
+			uint8_t data[kTraceLogPageSize] = {0};
+			if (Task_readMemory(self->task, page, data, sizeof(data)) != KERN_SUCCESS) {
+				continue; // not fatal; the reader falls back to the binaries for this page
+			}
+			
+			uint64_t hash = hashPage(data, sizeof(data));
+			uint32_t size = sizeof(data);
+			retVal = HashSet_add(&self->stream->pageContents, hash, &added);
+			if (retVal && added) {
+				if (	(writeRecordType(self, eTraceLogRecord_codePage) == false)
+					 || (writeData(self, &hash, sizeof(hash)) == false)
+					 || (writeData(self, &size, sizeof(size)) == false)
+					 || (writeData(self, data, sizeof(data)) == false)) {
+					Log_error("write code page");
+					retVal = false;
+				}
+			}
+			
+			if (	retVal
+				 && (	(writeRecordType(self, eTraceLogRecord_codePageMap) == false)
+					 || (writeData(self, &page, sizeof(page)) == false)
+					 || (writeData(self, &hash, sizeof(hash)) == false))) {
+				Log_error("write code page map");
+				retVal = false;
+			}
+		}
+		self->stream->lastPage = page;
+	}
+	return retVal;
+}
+
+
+static bool writeRecordType(TraceLog* self, TraceLogRecord record) {
+	bool retVal = false;
+	uint8_t type = record;
+	
+	// any pending taken bits belong before this record
+	if (	(flushTakenBits(self) == false)
+		 || (writeData(self, &type, sizeof(type)) == false)) {
+		Log_error("write type");
+		
+	} else {
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static bool writeVarint(TraceLog* self, uint64_t value) {
+	bool retVal = true;
+	uint8_t data[11] = {0};
+	size_t length = 0;
+	
+	// first byte only carries 6 bits as bit 7 must stay clear
+	data[length] = value & 0x3F;
+	value >>= 6;
+	if (value) {
+		data[length++] |= 0x40;
+		while (1) {
+			data[length] = value & 0x7F;
+			value >>= 7;
+			if (value == 0) {
+				break;
+			}
+			data[length++] |= 0x80;
+		}
+	}
+	length++;
+	
+	if (writeData(self, data, length) == false) {
+		Log_error("write varint");
+		retVal = false;
+	}
+	return retVal;
+}
+
+
+static bool internPath(TraceLog* self, const char* path, uint32_t* id) {
+	bool retVal = true;
+	uint64_t hash = hashPath(path);
+	
+	// there's only a few hundred; and the hash means we hardly ever compare strings
+	uint32_t i = 0;
+	while (	   i < self->pathCount
+			&& (self->paths[i].hash != hash || strcmp(self->paths[i].path, path) != 0)) {
+		i++;
+	}
+	
+	if (i == self->pathCount) {
+		if (self->pathCount == self->pathCapacity) {
+			uint32_t capacity = self->pathCapacity ? self->pathCapacity * 2: 256;
+			TraceLogPath* paths = realloc(self->paths, capacity * sizeof(TraceLogPath));
+			if (paths) {
+				self->paths = paths;
+				self->pathCapacity = capacity;
+			}
+		}
+		
+		char* copy = strdup(path);
+		if (self->pathCount == self->pathCapacity || copy == NULL) {
+			Log_error("out of memory");
+			free(copy);
+			retVal = false;
+			
+		} else {
+			self->paths[i].hash = hash;
+			self->paths[i].path = copy;
+			self->pathCount++;
+			retVal = writePathDefinition(self, i);
+		}
+	}
+	*id = i;
+	return retVal;
+}
+
+
+static bool writePathDefinition(TraceLog* self, uint32_t id) {
+	bool retVal = true;
+	
+	// varint id, varint length then the path; without its nul
+	uint64_t length = strlen(self->paths[id].path);
+	if (	(writeRecordType(self, eTraceLogRecord_pathDefinition) == false)
+		 || (writeVarint(self, id) == false)
+		 || (writeVarint(self, length) == false)
+		 || (writeData(self, self->paths[id].path, length) == false)) {
+		Log_error("write path: %u", id);
+		retVal = false;
+	}
+	return retVal;
+}
+
+
+static uint64_t hashPage(const uint8_t* data, uint64_t length) {
+	// FNV-1a over 64bit words; pages are always a multiple of 8 bytes
+	uint64_t hash = 0xCBF29CE484222325ull;
+	const uint64_t* words = (const uint64_t*) data;
+	for (uint64_t i = 0; i < length / sizeof(uint64_t); i++) {
+		hash ^= words[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
 }
 
+
+static uint64_t hashPath(const char* path) {
+	// FNV-1a again; but a byte at a time
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (const char* c = path; *c; c++) {
+		hash ^= (uint8_t) *c;
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+
+static kern_return_t readDyldImageInfos(Task* task, 
+										VMAddr info, 
+										uint32_t infoCount, 
+										DyldImageInfo64* infos) {
+	kern_return_t retVal = KERN_SUCCESS;
+	if (infoCount == 0) {
+		// nothing to read
+		
+	} else if (Task_getWordSize(task) == sizeof(uint32_t)) {
+		// read them into the start of infos then widen them; from the end so we don't overwrite any
+		DyldImageInfo32* infos32 = (DyldImageInfo32*) infos;
+		retVal = Task_readMemory(task, info, infos32, infoCount * sizeof(DyldImageInfo32));
+		for (uint32_t i = infoCount; retVal == KERN_SUCCESS && i > 0; i--) {
+			DyldImageInfo32 imageInfo = infos32[i-1];
+			infos[i-1].imageLoadAddress = imageInfo.imageLoadAddress;
+			infos[i-1].imageFilePath = imageInfo.imageFilePath;
+			infos[i-1].imageFileModDate = imageInfo.imageFileModDate;
+		}
+		
+	} else {
+		retVal = Task_readMemory(task, info, infos, infoCount * sizeof(DyldImageInfo64));
+	}
+	return retVal;
+}
@@ -30,6 +30,26 @@
 #include <stdio.h>
 
 #include "Task.h"
+#include "BlockDictionary.h"
+#include "HashSet.h"
+#include "TraceBuffer.h"
+#include "TraceWriter.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceLogMagic		(0x574F4C46)	// 'FLOW' as it appears in the file
+#define kTraceLogVersion	(2)
+#define kTraceLogPageSize	(4096)
+
+#define kTraceLogChunkSize	(256 * 1024)	// we start a new chunk once one gets this big
+#define kTraceLogReturnStackSize	(64)	// calls deeper than this lose their oldest entries
+#define kTraceLogFoldWindow			(32)	// the longest repeating sequence of blocks we fold
+#define kTraceLogFoldHashBits		(6)
+#define kTraceLogFoldMinBlocks		(4)		// fewer than this aren't worth a fold record
 
 
 
@@ -37,16 +57,168 @@
 /*
  * Struct/Enum definitions
  */
+typedef enum eTraceLogFormat {
+	eTraceLogFormat_raw = 0,			// every block written out in full
+	eTraceLogFormat_dictionary = 1,		// blocks defined once, then referenced by id
+	eTraceLogFormat_branch = 2			// only branch outcomes; blocks are rebuilt from the code
+} TraceLogFormat;
+
+
+typedef enum eTraceLogFlag {
+	eTraceLogFlag_embedImages = 0x1		// code pages and image symbols are in the log
+} TraceLogFlag;
+
+
+typedef enum eTraceLogTrigger {
+	eTraceLogTrigger_crash = 1,			// the target got EXC_CRASH
+	eTraceLogTrigger_signal = 2,		// the target got a fatal signal; code is the signal
+	eTraceLogTrigger_request = 3,		// we were asked to (SIGUSR2 to flow)
+	eTraceLogTrigger_pc = 4				// the target ran TraceLogOptions.triggerPC
+} TraceLogTrigger;
+
+
+typedef struct sTraceLogOptions {
+	TraceLogFormat	format;
+	uint32_t		flags;			// TraceLogFlag's
+	uint32_t		compressThreads;	// 0 to write chunks uncompressed
+	uint32_t		ringChunks;		// if not 0, only keep this many chunks in memory until triggered
+	VMAddr			triggerPC;		// if not 0, trigger the first time this is run
+	TraceOutputType	output;
+	bool			dropWhenFull;	// a live consumer; drop chunks rather than wait for it
+	uint64_t		segmentSize;	// if not 0, start a new file (segment) once we've written this many bytes
+	uint32_t		segmentSeconds;	// or after this long
+} TraceLogOptions;
+
+
+typedef struct sTraceLogImage {
+	VMAddr			base;
+	uint32_t		path;			// its id in the path table
+} TraceLogImage;
+
+
+typedef struct sTraceLogPath {
+	uint64_t		hash;
+	char*			path;
+} TraceLogPath;
+
+
+/*
+ * Each traced thread has its own stream; its own chunk and encoder state, so its chunks
+ * only hold its blocks and decode on their own.  Dyld, image and trigger records go in
+ * stream 0 (thread id 0) whose chunks are written as soon as they're complete.
+ */
+typedef struct sTraceStream {
+	thread_t		thread;
+	uint64_t		threadId;		// 0 for the metadata stream
+	uint64_t		nextBlock;		// sequence number of our next block; if no other thread runs first
+	uint64_t		depth;			// calls less rets (never below 0); so each chunk can say where it starts
+	BlockDictionary	dictionary;
+	
+	// chunk state
+	TraceBuffer		chunk;			// the records of the chunk we're building
+	TraceLogIndexEntry	current;	// and its header
+	TraceLogChunkSummary	summary;	// and what its blocks ran
+	
+	// eTraceLogFlag_embedImages state
+	HashSet			pages;			// pages we've written a eTraceLogRecord_codePageMap for
+	HashSet			pageContents;	// hashes of the eTraceLogRecord_codePage's we've written
+	VMAddr			lastPage;
+	
+	// eTraceLogFormat_branch state
+	Block			lastBlock;		// the block whose branch outcome we've still to write
+	bool			lastBlockValid;
+	uint8_t			takenBits;		// pending conditional outcomes; oldest in bit 0
+	uint8_t			takenCount;
+	uint64_t		silentCount;	// direct branches followed since we last wrote anything
+	
+	// shadow call stack; eTraceLogFormat_raw and eTraceLogFormat_branch
+	VMAddr			returns[kTraceLogReturnStackSize];	// where each call will return to
+	uint8_t			callLengths[kTraceLogReturnStackSize];
+	uint32_t		returnTop;
+	uint32_t		returnCount;
+	bool			returnValid;	// the last block was a ret; and this is where we expect it went
+	VMAddr			returnAddress;
+	uint8_t			returnCallLength;
+	
+	// repetition folding; eTraceLogFormat_raw and eTraceLogFormat_dictionary
+	Block			history[kTraceLogFoldWindow];	// the last blocks; by position in the chunk
+	uint64_t		historyCount;
+	uint64_t		foldLast[1 << kTraceLogFoldHashBits];	// position+1 we last saw an entry at
+	Block			pattern[kTraceLogFoldWindow];	// the blocks we're matching against
+	uint64_t		foldPeriod;		// 0 if we're not in a repeat
+	uint64_t		foldMatched;	// blocks held back as they've matched the pattern
+} TraceStream;
+
+
 typedef struct sTraceLog {
-	FILE*	log;
-	Task*	task;
+	TraceWriter		writer;
+	bool			logOpen;
+	Task*			task;
+	
+	TraceLogFormat	format;
+	uint32_t		flags;
+	uint64_t		blockCount;		// across all the threads; its a block's sequence number
+	
+	TraceStream**	streams;		// streams[0] is the metadata stream
+	uint32_t		streamCount;
+	uint32_t		streamCapacity;
+	TraceStream*	stream;			// the one we're writing to
+	
+	/*
+	 * Every image path we've seen, indexed by id; each is written once, in a 
+	 * eTraceLogRecord_pathDefinition, and notifications then refer to it by id.
+	 */
+	TraceLogPath*	paths;
+	uint32_t		pathCount;
+	uint32_t		pathCapacity;
+	
+	// segment state; each one is a log on its own
+	uint64_t		segmentSize;	// 0 if we're not rotating
+	uint64_t		segmentTicks;	// mach_absolute_time
+	uint64_t		segmentBytes;	// submitted to the current one
+	uint64_t		segmentStart;
+	
+	// what's loaded; so a flight recorder dump or a new segment can say so before its chunks
+	bool			trackImages;
+	VMAddr			dyldAddress;
+	TraceLogImage*	images;
+	uint32_t		imageCount;
+	uint32_t		imageCapacity;
+	VMAddr			triggerPC;
 } TraceLog;
 
 
+/*
+ * The file starts with a TraceLogHeader; older logs (without the magic) start 
+ * directly with the uint32_t cpuType and are always eTraceLogFormat_raw.
+ */
+typedef struct sTraceLogHeader {
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	format;
+	uint32_t	cpuType;
+	uint32_t	flags;
+} TraceLogHeader;
+
+
 typedef enum eTraceLogRecord {
 	eTraceLogRecord_block = 0,
 	eTraceLogRecord_dyldLoadAddress = 0x80,
-	eTraceLogRecord_libraryNotification = 0x81
+	eTraceLogRecord_libraryNotification = 0x81,	// full paths; older logs, we now write eTraceLogRecord_imageNotification
+	eTraceLogRecord_blockDefinition = 0x82,
+	eTraceLogRecord_branchTarget = 0x83,
+	eTraceLogRecord_branchResync = 0x84,
+	eTraceLogRecord_branchEnd = 0x85,
+	eTraceLogRecord_imageSymbols = 0x86,
+	eTraceLogRecord_codePage = 0x87,
+	eTraceLogRecord_codePageMap = 0x88,
+	eTraceLogRecord_trigger = 0x89,
+	eTraceLogRecord_sequence = 0x8A,
+	eTraceLogRecord_return = 0x8B,
+	eTraceLogRecord_fold = 0x8C,
+	eTraceLogRecord_pathDefinition = 0x8D,
+	eTraceLogRecord_imageNotification = 0x8E,
+	eTraceLogRecord_sync = 0x8F				// a varint call depth; the first record of every thread's chunk
 } TraceLogRecord;
 
 
@@ -55,10 +227,11 @@ typedef enum eTraceLogRecord {
 /*
  * Exported function definitions
  */
-bool TraceLog_open(TraceLog* self, Task* task, const char* path);
+bool TraceLog_open(TraceLog* self, Task* task, const char* path, TraceLogOptions* options);
 bool TraceLog_dyldLoadAddress(TraceLog* self, VMAddr dyldImageLoadAddress);
 bool TraceLog_libraryNotification(TraceLog* self, Thread* thread);
-bool TraceLog_block(TraceLog* self, Block* block);
+bool TraceLog_block(TraceLog* self, Thread* thread, Block* block);
+bool TraceLog_trigger(TraceLog* self, TraceLogTrigger trigger, uint32_t code, VMAddr pc);
 void TraceLog_close(TraceLog* self);
 
 
@@ -0,0 +1,309 @@
+//
+//  TraceOutput.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "TraceOutput.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static int openStream(const char* path);
+static bool fileWrite(TraceOutput* self, const void* data, uint64_t length);
+static void fileClose(TraceOutput* self);
+static bool mmapWrite(TraceOutput* self, const void* data, uint64_t length);
+static void mmapClose(TraceOutput* self);
+static bool mapExtent(TraceOutput* self);
+static bool preallocate(TraceOutput* self);
+static void unmapExtent(TraceOutput* self);
+static bool streamWrite(TraceOutput* self, const void* data, uint64_t length);
+static void streamClose(TraceOutput* self);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool TraceOutput_open(TraceOutput* self, const char* path, TraceOutputType type) {
+	bool retVal = false;
+	if (self == NULL || path == NULL) {
+		Log_invalidArgument("self: %p, path: %p", self, path);
+		
+	} else {
+		bzero(self, sizeof(*self));
+		self->fd = -1;
+		if (strncmp(path, "unix:", 5) == 0 || strncmp(path, "fd:", 3) == 0) {
+			type = eTraceOutputType_stream; // it's not a file; whatever we were asked for
+		}
+		
+		self->type = type;
+		if (type == eTraceOutputType_stream) {
+			self->fd = openStream(path);
+			if (self->fd == -1) {
+				Log_error("openStream: %s", path);
+				
+			} else {
+				self->write = streamWrite;
+				self->close = streamClose;
+				retVal = true;
+			}
+			
+		} else if (type == eTraceOutputType_mmap) {
+			self->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (self->fd == -1) {
+				Log_errorPosix(errno, "open: %s", path);
+				
+			} else {
+				self->write = mmapWrite;
+				self->close = mmapClose;
+				retVal = true;
+			}
+			
+		} else {
+			self->file = fopen(path, "wb");
+			if (self->file == NULL) {
+				Log_errorPosix(errno, "fopen: %s", path);
+				
+			} else {
+				self->write = fileWrite;
+				self->close = fileClose;
+				retVal = true;
+			}
+		}
+	}
+	return retVal;
+}
+
+
+bool TraceOutput_write(TraceOutput* self, const void* data, uint64_t length) {
+	return self->write(self, data, length);
+}
+
+
+void TraceOutput_close(TraceOutput* self) {
+	if (self && self->close) {
+		self->close(self);
+		self->write = NULL;
+		self->close = NULL;
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static int openStream(const char* path) {
+	int retVal = -1;
+	if (strncmp(path, "fd:", 3) == 0) {
+		// inherited from whoever started us; a pipe to the consumer
+		retVal = atoi(&path[3]);
+		if (fcntl(retVal, F_GETFL) == -1) {
+			Log_errorPosix(errno, "fcntl F_GETFL: %d", retVal);
+			retVal = -1;
+		}
+		
+	} else {
+		// the consumer is listening on a unix socket
+		struct sockaddr_un addr = {0};
+		addr.sun_family = AF_UNIX;
+		if (strlen(&path[5]) >= sizeof(addr.sun_path)) {
+			Log_invalidArgument("path too long: %s", path);
+			
+		} else if ((retVal = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+			Log_errorPosix(errno, "socket");
+			
+		} else {
+			(void) strncpy(addr.sun_path, &path[5], sizeof(addr.sun_path) - 1);
+			if (connect(retVal, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+				Log_errorPosix(errno, "connect: %s", path);
+				close(retVal);
+				retVal = -1;
+			}
+		}
+	}
+	
+	// if the consumer goes away we want EPIPE from write; not to be killed
+	if (retVal != -1 && fcntl(retVal, F_SETNOSIGPIPE, 1) == -1) {
+		Log_errorPosix(errno, "fcntl F_SETNOSIGPIPE");
+	}
+	return retVal;
+}
+
+
+static bool fileWrite(TraceOutput* self, const void* data, uint64_t length) {
+	bool retVal = true;
+	if (length && fwrite(data, length, 1, self->file) != 1) {
+		Log_error("fwrite");
+		retVal = false;
+	}
+	return retVal;
+}
+
+
+static void fileClose(TraceOutput* self) {
+	fclose(self->file);
+	self->file = NULL;
+}
+
+
+static bool mmapWrite(TraceOutput* self, const void* data, uint64_t length) {
+	bool retVal = true;
+	const uint8_t* bytes = data;
+	while (retVal && length) {
+		if (self->map == NULL || self->mapUsed == kTraceOutputExtentSize) {
+			retVal = mapExtent(self);
+			
+		} else {
+			uint64_t size = kTraceOutputExtentSize - self->mapUsed;
+			if (size > length) {
+				size = length;
+			}
+			(void) memcpy(&self->map[self->mapUsed], bytes, size);
+			self->mapUsed += size;
+			self->size += size;
+			bytes += size;
+			length -= size;
+		}
+	}
+	return retVal;
+}
+
+
+static void mmapClose(TraceOutput* self) {
+	unmapExtent(self);
+	
+	// we grew the file an extent at a time; cut it back to what we actually wrote
+	if (ftruncate(self->fd, self->size) != 0) {
+		Log_errorPosix(errno, "ftruncate: %llu", self->size);
+	}
+	close(self->fd);
+	self->fd = -1;
+}
+
+
+static bool mapExtent(TraceOutput* self) {
+	bool retVal = false;
+	uint64_t offset = self->mapOffset + (self->map ? kTraceOutputExtentSize: 0);
+	unmapExtent(self);
+	
+	if (preallocate(self) == false) {
+		Log_error("preallocate: %llu", offset);
+		
+	} else if (ftruncate(self->fd, offset + kTraceOutputExtentSize) != 0) {
+		Log_errorPosix(errno, "ftruncate: %llu", offset + kTraceOutputExtentSize);
+		
+	} else {
+		void* map = mmap(NULL, kTraceOutputExtentSize, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, offset);
+		if (map == MAP_FAILED) {
+			Log_errorPosix(errno, "mmap: %llu", offset);
+			
+		} else {
+			self->map = map;
+			self->mapOffset = offset;
+			self->mapUsed = 0;
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+
+static bool preallocate(TraceOutput* self) {
+	bool retVal = true;
+	
+	/*
+	 * Reserve the space before we map it; if we just extended the file and the disk 
+	 * filled up we'd get a SIGBUS storing into the mapping rather than an error.  We'd
+	 * like it contiguous, but will take what we can get.
+	 */
+	fstore_t store = {0};
+	store.fst_flags = F_ALLOCATECONTIG;
+	store.fst_posmode = F_PEOFPOSMODE;
+	store.fst_offset = 0;
+	store.fst_length = kTraceOutputExtentSize;
+	if (fcntl(self->fd, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		if (fcntl(self->fd, F_PREALLOCATE, &store) == -1) {
+			Log_errorPosix(errno, "fcntl F_PREALLOCATE");
+			retVal = false;
+		}
+	}
+	return retVal;
+}
+
+
+static void unmapExtent(TraceOutput* self) {
+	if (self->map) {
+		// we're done with it; start it on its way to the disk but don't wait
+		if (msync(self->map, self->mapUsed, MS_ASYNC) != 0) {
+			Log_errorPosix(errno, "msync");
+		}
+		munmap(self->map, kTraceOutputExtentSize);
+		self->map = NULL;
+	}
+}
+
+
+static bool streamWrite(TraceOutput* self, const void* data, uint64_t length) {
+	bool retVal = true;
+	const uint8_t* bytes = data;
+	while (retVal && length) {
+		ssize_t written = write(self->fd, bytes, length);
+		if (written > 0) {
+			bytes += written;
+			length -= written;
+			self->size += written;
+			
+		} else if (written == -1 && errno == EINTR) {
+			// again
+			
+		} else {
+			Log_errorPosix(errno, "write: %llu", self->size);
+			retVal = false;
+		}
+	}
+	return retVal;
+}
+
+
+static void streamClose(TraceOutput* self) {
+	close(self->fd);
+	self->fd = -1;
+}
@@ -0,0 +1,92 @@
+//
+//  TraceOutput.h
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_TraceOutput_h
+#define Flow_TraceOutput_h
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceOutputExtentSize	(64 * 1024 * 1024)	// eTraceOutputType_mmap grows the file by this much at a time
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sTraceOutput TraceOutput;
+
+typedef bool (TraceOutputBackend_write)(TraceOutput* self, const void* data, uint64_t length);
+typedef void (TraceOutputBackend_close)(TraceOutput* self);
+
+
+typedef enum eTraceOutputType {
+	eTraceOutputType_file = 0,		// stdio
+	eTraceOutputType_mmap = 1,		// preallocated extents of the file mapped in; writes are just stores
+	eTraceOutputType_stream = 2		// a consumer reading it live; "unix:path" (a socket) or "fd:n" (a pipe)
+} TraceOutputType;
+
+
+/*
+ * Where the trace writer's bytes go; they're only ever appended.
+ */
+struct sTraceOutput {
+	TraceOutputType				type;
+	TraceOutputBackend_write*	write;
+	TraceOutputBackend_close*	close;
+	
+	// eTraceOutputType_file
+	FILE*			file;
+	
+	// eTraceOutputType_mmap and eTraceOutputType_stream
+	int				fd;
+	uint8_t*		map;			// the extent we're writing into; NULL before the first write
+	uint64_t		mapOffset;		// where it is in the file
+	uint64_t		mapUsed;
+	uint64_t		size;			// bytes written; what we truncate the file to on close
+};
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool TraceOutput_open(TraceOutput* self, const char* path, TraceOutputType type);
+bool TraceOutput_write(TraceOutput* self, const void* data, uint64_t length);
+void TraceOutput_close(TraceOutput* self);
+
+
+#endif
@@ -0,0 +1,147 @@
+//
+//  TraceScan.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "TraceScan.h"
+#include "TraceSummary.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool TraceScan_open(TraceScan* self, const char* path, const char* root) {
+	bool retVal = false;
+	if (self == NULL || path == NULL) {
+		Log_invalidArgument("self: %p, path: %p", self, path);
+		
+	} else {
+		memset(self, 0, sizeof(*self));
+		if (FlowReader_open(&self->reader, path)) {
+			if (self->reader.format == eTraceLogFormat_branch) {
+				// the blocks have to be rebuilt from the code
+				Log_error("branch format logs aren't supported; use FlowCalls.py: %s", path);
+				
+			} else {
+				retVal = TraceImages_create(&self->images, self->reader.cpuType, root);
+			}
+			
+			if (retVal == false) {
+				FlowReader_close(&self->reader);
+			}
+		}
+	}
+	return retVal;
+}
+
+
+bool TraceScan_run(TraceScan* self, TraceScan_blocksFunction* function, void* context) {
+	bool retVal = false;
+	if (self == NULL || function == NULL) {
+		Log_invalidArgument("self: %p, function: %p", self, function);
+		
+	} else {
+		uint32_t count = 0;
+		retVal = TraceScan_next(self, &count);
+		while (retVal && count) {
+			retVal = function(self, self->blocks, count, context) && TraceScan_next(self, &count);
+		}
+	}
+	return retVal;
+}
+
+
+bool TraceScan_next(TraceScan* self, uint32_t* count) {
+	bool retVal = true;
+	bool done = false;
+	*count = 0;
+	while (retVal && done == false && *count == 0) {
+		if (self->inChunk) {
+			FlowReaderMeta meta = {0};
+			*count = FlowReader_read(&self->reader, self->blocks, kTraceScanBlocks, &meta);
+			if (*count) {
+				self->blockCount += *count;
+				
+			} else if (meta.type == 0) {
+				self->inChunk = false;
+				
+			} else {
+				retVal = TraceImages_record(&self->images, &meta);
+			}
+			
+		} else if (self->reader.version < 2) {
+			// the whole log is one chunk
+			done = (self->nextChunk != 0);
+			if (done == false) {
+				memset(&self->chunk, 0, sizeof(self->chunk));
+				self->chunk.offset = self->reader.headerSize;
+				self->inChunk = retVal = FlowReader_startChunk(&self->reader, self->chunk.offset);
+				self->nextChunk++;
+			}
+			
+		} else {
+			done = (self->nextChunk == FlowReader_getChunkCount(&self->reader));
+			if (done == false) {
+				const TraceLogChunkSummary* summary = NULL;
+				retVal = FlowReader_getChunk(&self->reader, self->nextChunk++, &self->chunk);
+				if (retVal && (self->chunk.flags & eTraceLogChunkFlag_dropped)) {
+					self->droppedChunks++;
+					
+				} else if (		retVal
+							&& self->hasRange
+							&& (self->chunk.flags & eTraceLogChunkFlag_images) == 0
+							&& FlowReader_getSummary(&self->reader, self->nextChunk - 1, &summary)
+							&& TraceSummary_mayContain(summary, self->low, self->high) == false) {
+					self->skippedChunks++;
+					
+				} else if (retVal) {
+					self->inChunk = retVal = FlowReader_startChunk(&self->reader, self->chunk.offset);
+				}
+			}
+		}
+	}
+	return retVal;
+}
+
+
+void TraceScan_setRange(TraceScan* self, uint64_t low, uint64_t high) {
+	self->hasRange = true;
+	self->low = low;
+	self->high = high;
+}
+
+
+void TraceScan_close(TraceScan* self) {
+	if (self) {
+		TraceImages_release(&self->images);
+		FlowReader_close(&self->reader);
+	}
+}
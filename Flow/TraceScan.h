@@ -0,0 +1,99 @@
+//
+//  TraceScan.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_TraceScan_h
+#define Flow_TraceScan_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FlowReader.h"
+#include "TraceImages.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceScanBlocks	(4096)	// read at a time
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sTraceScan TraceScan;
+
+typedef bool (TraceScan_blocksFunction)(TraceScan* scan, const FlowReaderBlock* blocks, uint32_t count, void* context);
+
+
+/*
+ * Reads a log from start to end, in one pass, for the flowtool commands; the chunks in
+ * file order, so the meta records come before the blocks they describe.  Each run of
+ * blocks is given to function with chunk set to the chunk they're from (its thread) 
+ * and images up to date; so they can be resolved as they go.  A log from before
+ * version 2 is read as one chunk, on thread 0.
+ *
+ * TraceScan_next does the same a run at a time, into blocks, for when the caller is 
+ * reading more than one log in step; count is 0 at the end of the log.
+ *
+ * After TraceScan_setRange chunks whose summary says none of their blocks ran anything
+ * from low to high aren't read at all; so the caller still sees every block in that
+ * range (along with others).  Chunks with images are always read.
+ */
+struct sTraceScan {
+	FlowReader			reader;
+	TraceImages			images;
+	TraceLogIndexEntry	chunk;			// the one we're reading
+	uint64_t			blockCount;		// so far
+	uint64_t			droppedChunks;	// from eTraceLogChunkFlag_dropped markers
+	bool				hasRange;
+	uint64_t			low;
+	uint64_t			high;
+	uint64_t			skippedChunks;	// by their summaries
+	uint32_t			nextChunk;
+	bool				inChunk;
+	FlowReaderBlock		blocks[kTraceScanBlocks];
+};
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool TraceScan_open(TraceScan* self, const char* path, const char* root);
+bool TraceScan_run(TraceScan* self, TraceScan_blocksFunction* function, void* context);
+bool TraceScan_next(TraceScan* self, uint32_t* count);
+void TraceScan_setRange(TraceScan* self, uint64_t low, uint64_t high);
+void TraceScan_close(TraceScan* self);
+
+
+#endif
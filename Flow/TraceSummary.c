@@ -0,0 +1,125 @@
+//
+//  TraceSummary.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include "TraceSummary.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceSummaryBitMask	(kTraceLogSummaryWords * 64 - 1)
+#define kTraceSummaryBitShift	(10)		// bits of the hash each probe takes; log2 of the filter's size
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static inline uint64_t hashPage(uint64_t page);
+static inline void addPage(TraceLogChunkSummary* self, uint64_t page);
+static inline bool hasPage(const TraceLogChunkSummary* self, uint64_t page);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+void TraceSummary_add(TraceLogChunkSummary* self, uint64_t entry, uint64_t branch) {
+	if (self->blocks == 0 || entry < self->low) {
+		self->low = entry;
+	}
+	if (self->blocks == 0 || branch > self->high) {
+		self->high = branch;
+	}
+	self->blocks++;
+	
+	uint64_t first = entry >> kTraceSummaryPageShift;
+	uint64_t last = (branch > entry ? branch: entry) >> kTraceSummaryPageShift;
+	if (last - first >= kTraceSummaryMaxPages) {
+		// it can't really be that long; but a no is never wrong, so everything's a maybe
+		for (uint32_t i = 0; i < kTraceLogSummaryWords; i++) {
+			self->pages[i] = ~0ull;
+		}
+		
+	} else {
+		for (uint64_t page = first; page <= last; page++) {
+			addPage(self, page);
+		}
+	}
+}
+
+
+bool TraceSummary_mayContain(const TraceLogChunkSummary* self, uint64_t low, uint64_t high) {
+	bool retVal = false;
+	if (self->blocks && low <= self->high && high >= self->low) {
+		uint64_t first = (low > self->low ? low: self->low) >> kTraceSummaryPageShift;
+		uint64_t last = (high < self->high ? high: self->high) >> kTraceSummaryPageShift;
+		retVal = (last - first >= kTraceSummaryMaxPages);
+		for (uint64_t page = first; retVal == false && page <= last; page++) {
+			retVal = hasPage(self, page);
+		}
+	}
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static inline uint64_t hashPage(uint64_t page) {
+	// neighbouring pages should land well apart
+	page ^= page >> 33;
+	page *= 0xFF51AFD7ED558CCDull;
+	page ^= page >> 33;
+	return page;
+}
+
+
+static inline void addPage(TraceLogChunkSummary* self, uint64_t page) {
+	uint64_t h = hashPage(page);
+	for (uint32_t i = 0; i < 3; i++, h >>= kTraceSummaryBitShift) {
+		uint32_t bit = (uint32_t) (h & kTraceSummaryBitMask);
+		self->pages[bit / 64] |= 1ull << (bit % 64);
+	}
+}
+
+
+static inline bool hasPage(const TraceLogChunkSummary* self, uint64_t page) {
+	bool retVal = true;
+	uint64_t h = hashPage(page);
+	for (uint32_t i = 0; retVal && i < 3; i++, h >>= kTraceSummaryBitShift) {
+		uint32_t bit = (uint32_t) (h & kTraceSummaryBitMask);
+		retVal = (self->pages[bit / 64] & (1ull << (bit % 64))) != 0;
+	}
+	return retVal;
+}
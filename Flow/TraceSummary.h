@@ -0,0 +1,66 @@
+//
+//  TraceSummary.h
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#ifndef Flow_TraceSummary_h
+#define Flow_TraceSummary_h
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "TraceWriter.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceSummaryPageShift	(12)	// the filter's granularity; 4K pages
+#define kTraceSummaryMaxPages	(64)	// a block (or a query) over more than this many just uses low and high
+
+
+
+
+/*
+ * Build and test a TraceLogChunkSummary.  TraceLog adds every block in a chunk to its
+ * summary; a reader asks whether a chunk's blocks might have run anything from low 
+ * to high.  The pages are a Bloom filter (three bits each) so the answer is either 
+ * no, or maybe; never a wrong no.  A zeroed summary has no blocks.
+ */
+
+
+
+
+/*
+ * Exported function definitions
+ */
+void TraceSummary_add(TraceLogChunkSummary* self, uint64_t entry, uint64_t branch);
+bool TraceSummary_mayContain(const TraceLogChunkSummary* self, uint64_t low, uint64_t high);
+
+
+#endif
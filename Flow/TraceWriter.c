@@ -0,0 +1,651 @@
+//
+//  TraceWriter.c
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <mach/mach_time.h>
+
+#include "TraceWriter.h"
+#include "TraceCompress.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static TraceWriterJob* takeChunk(TraceWriter* self, TraceBuffer* chunk, TraceLogIndexEntry* entry, const TraceLogChunkSummary* summary);
+static bool enqueue(TraceWriter* self, TraceWriterJob* job, bool mayDrop);
+static void appendJob(TraceWriter* self, TraceWriterJob* job);
+static void appendDropped(TraceWriter* self);
+static bool rotateOutput(TraceWriter* self);
+static void freeJob(TraceWriter* self, TraceWriterJob* job);
+static void* compressorThread(void* arg);
+static void* writerThread(void* arg);
+static uint64_t compressJob(TraceWriterJob* job);
+static bool writeJob(TraceWriter* self, TraceWriterJob* job);
+static bool writeIndex(TraceWriter* self);
+static void printStats(TraceWriter* self);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+bool TraceWriter_open(TraceWriter* self, 
+					  const char* path, 
+					  TraceOutputType output, 
+					  uint32_t threads, 
+					  uint32_t ringSize, 
+					  bool dropWhenFull) {
+	bool retVal = false;
+	if (self == NULL || path == NULL) {
+		Log_invalidArgument("self: %p, path: %p", self, path);
+		
+	} else {
+		bzero(self, sizeof(*self));
+		if (TraceOutput_open(&self->output, path, output) == false) {
+			Log_error("TraceOutput_open: %s", path);
+			
+		} else if ((self->path = strdup(path)) == NULL) {
+			Log_error("strdup");
+			TraceOutput_close(&self->output);
+			
+		} else if (ringSize && (self->ring = calloc(ringSize, sizeof(TraceWriterJob*))) == NULL) {
+			Log_error("calloc");
+			TraceOutput_close(&self->output);
+			free(self->path);
+			self->path = NULL;
+			
+		} else if (	   (pthread_mutex_init(&self->lock, NULL) != 0)
+					|| (pthread_cond_init(&self->queued, NULL) != 0)
+					|| (pthread_cond_init(&self->ready, NULL) != 0)
+					|| (pthread_cond_init(&self->written, NULL) != 0)) {
+			Log_error("pthread_mutex_init/pthread_cond_init");
+			TraceOutput_close(&self->output);
+			free(self->ring);
+			self->ring = NULL;
+			free(self->path);
+			self->path = NULL;
+			
+		} else {
+			self->ringSize = ringSize;
+			retVal = true;
+			
+			// if we can't get the threads we want we just do less (or no) compression
+			bool stream = self->output.type == eTraceOutputType_stream;
+			if ((threads || stream) && pthread_create(&self->writer, NULL, writerThread, self) != 0) {
+				Log_error("pthread_create writer; not compressing");
+				threads = 0;
+				
+			} else if (threads || stream) {
+				// a slow disk holds chunks up just like a slow consumer; either way memory mustn't grow without limit
+				self->hasWriter = true;
+				self->maxPending = kTraceWriterMaxPending;
+				self->dropWhenFull = stream && dropWhenFull;
+			}
+			
+			if (threads > kTraceWriterMaxThreads) {
+				threads = kTraceWriterMaxThreads;
+			}
+			for (uint32_t i = 0; i < threads; i++) {
+				if (pthread_create(&self->compressors[i], NULL, compressorThread, self) != 0) {
+					Log_error("pthread_create compressor: %u", i);
+					break;
+				}
+				self->threads++;
+			}
+		}
+	}
+	return retVal;
+}
+
+
+bool TraceWriter_write(TraceWriter* self, const void* data, uint64_t length) {
+	// only for the file header; before any chunks are submitted
+	bool retVal = false;
+	if (TraceOutput_write(&self->output, data, length) == false) {
+		Log_error("TraceOutput_write");
+		
+	} else if (TraceBuffer_append(&self->header, data, length) == false) {
+		Log_error("TraceBuffer_append");
+		
+	} else {
+		self->offset += length;
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+bool TraceWriter_submit(TraceWriter* self, TraceBuffer* chunk, TraceLogIndexEntry* entry, const TraceLogChunkSummary* summary) {
+	bool retVal = false;
+	TraceWriterJob* job = takeChunk(self, chunk, entry, summary);
+	if (job && self->ringSize) {
+		// flight recorder; keep it in memory, dropping the oldest if we're full
+		if (self->ringCount == self->ringSize) {
+			freeJob(self, self->ring[self->ringStart]);
+			self->ringStart = (self->ringStart + 1) % self->ringSize;
+			self->ringCount--;
+		}
+		self->ring[(self->ringStart + self->ringCount) % self->ringSize] = job;
+		self->ringCount++;
+		retVal = true;
+		
+	} else if (job) {
+		retVal = enqueue(self, job, true);
+	}
+	return retVal;
+}
+
+
+bool TraceWriter_dump(TraceWriter* self, TraceBuffer* chunk, TraceLogIndexEntry* entry, const TraceLogChunkSummary* summary) {
+	bool retVal = false;
+	if (self->ringCount) {
+		// chunk is written first; so as far as the index is concerned it starts where the ring does
+		TraceLogIndexEntry* oldest = &self->ring[self->ringStart]->entry;
+		entry->firstBlock = oldest->firstBlock;
+		entry->timestamp = oldest->timestamp;
+	}
+	
+	TraceWriterJob* job = takeChunk(self, chunk, entry, summary);
+	if (job) {
+		self->dumps++;
+		self->dumpedChunks += self->ringCount;
+		retVal = enqueue(self, job, false);
+		for (uint32_t i = 0; i < self->ringCount; i++) {
+			job = self->ring[(self->ringStart + i) % self->ringSize];
+			if (retVal) {
+				retVal = enqueue(self, job, false);
+			} else {
+				freeJob(self, job);
+			}
+		}
+		self->ringStart = 0;
+		self->ringCount = 0;
+	}
+	return retVal;
+}
+
+
+bool TraceWriter_rotate(TraceWriter* self) {
+	bool retVal = false;
+	pthread_mutex_lock(&self->lock);
+	TraceWriterJob* job = self->free;
+	if (job) {
+		self->free = job->next;
+	}
+	pthread_mutex_unlock(&self->lock);
+	
+	if (job == NULL) {
+		job = calloc(1, sizeof(TraceWriterJob));
+	}
+	
+	if (job == NULL) {
+		Log_error("calloc");
+		
+	} else {
+		// it goes in the queue like a chunk; so everything before it ends up in this file
+		TraceBuffer_reset(&job->raw);
+		bzero(&job->entry, sizeof(job->entry));
+		bzero(&job->summary, sizeof(job->summary));
+		job->useCompressed = false;
+		job->rotate = true;
+		retVal = enqueue(self, job, false);
+	}
+	return retVal;
+}
+
+
+void TraceWriter_close(TraceWriter* self) {
+	if (self && self->path) {
+		if (self->hasWriter) {
+			// the compressors finish the queue before they exit; then the writer empties it
+			pthread_mutex_lock(&self->lock);
+			if (self->droppedChunks) {
+				appendDropped(self);
+			}
+			self->shutdown = true;
+			pthread_cond_broadcast(&self->queued);
+			pthread_cond_broadcast(&self->ready);
+			pthread_mutex_unlock(&self->lock);
+			
+			for (uint32_t i = 0; i < self->threads; i++) {
+				pthread_join(self->compressors[i], NULL);
+			}
+			pthread_join(self->writer, NULL);
+		}
+		
+		// anything left in the ring wasn't asked for
+		for (uint32_t i = 0; i < self->ringCount; i++) {
+			freeJob(self, self->ring[(self->ringStart + i) % self->ringSize]);
+		}
+		free(self->ring);
+		self->ring = NULL;
+		
+		if (self->failed == false) {
+			(void) writeIndex(self);
+		}
+		printStats(self);
+		TraceOutput_close(&self->output);
+		
+		while (self->free) {
+			TraceWriterJob* job = self->free;
+			self->free = job->next;
+			TraceBuffer_release(&job->raw);
+			TraceBuffer_release(&job->compressed);
+			free(job);
+		}
+		free(self->index);
+		self->index = NULL;
+		free(self->summaries);
+		self->summaries = NULL;
+		free(self->path);
+		self->path = NULL;
+		TraceBuffer_release(&self->header);
+		
+		pthread_cond_destroy(&self->written);
+		pthread_cond_destroy(&self->ready);
+		pthread_cond_destroy(&self->queued);
+		pthread_mutex_destroy(&self->lock);
+	}
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static TraceWriterJob* takeChunk(TraceWriter* self, TraceBuffer* chunk, TraceLogIndexEntry* entry, const TraceLogChunkSummary* summary) {
+	pthread_mutex_lock(&self->lock);
+	bool failed = self->failed;
+	TraceWriterJob* job = self->free;
+	if (job) {
+		self->free = job->next;
+	}
+	pthread_mutex_unlock(&self->lock);
+	
+	if (job == NULL) {
+		job = calloc(1, sizeof(TraceWriterJob));
+	}
+	
+	if (failed) {
+		Log_error("an earlier write failed");
+		if (job) {
+			freeJob(self, job);
+			job = NULL;
+		}
+		
+	} else if (job == NULL) {
+		Log_error("calloc");
+		
+	} else {
+		// the job takes the chunk; the caller carries on with the job's old (empty) buffer
+		TraceBuffer raw = job->raw;
+		job->raw = *chunk;
+		*chunk = raw;
+		TraceBuffer_reset(chunk);
+		
+		job->next = NULL;
+		job->entry = *entry;
+		job->summary = *summary;
+		job->useCompressed = false;
+		job->rotate = false;
+	}
+	return job;
+}
+
+
+static bool enqueue(TraceWriter* self, TraceWriterJob* job, bool mayDrop) {
+	bool retVal = true;
+	if (self->hasWriter == false) {
+		// no threads; just write it out now
+		job->state = eTraceWriterJobState_ready;
+		retVal = self->failed == false && (job->rotate ? rotateOutput(self): writeJob(self, job));
+		self->failed = (retVal == false);
+		freeJob(self, job);
+		
+	} else {
+		pthread_mutex_lock(&self->lock);
+		bool drop = false;
+		while (	   (self->maxPending && self->pendingCount >= self->maxPending)
+				&& (self->failed == false)
+				&& (drop == false)) {
+			// the consumer is behind; the images have to get through whatever
+			if (self->dropWhenFull && mayDrop && (job->entry.flags & eTraceLogChunkFlag_images) == 0) {
+				drop = true;
+			} else {
+				pthread_cond_wait(&self->written, &self->lock);
+			}
+		}
+		
+		if (drop) {
+			if (self->droppedChunks == 0) {
+				self->dropped = job->entry;
+			}
+			self->droppedChunks++;
+			self->droppedBytes += job->raw.size;
+			self->totalDropped++;
+			job->next = self->free;
+			self->free = job;
+			
+		} else {
+			if (self->droppedChunks) {
+				appendDropped(self);
+			}
+			
+			if (job->rotate == false && self->queuedCount < self->threads * 2) {
+				job->state = eTraceWriterJobState_queued;
+				self->queuedCount++;
+				pthread_cond_signal(&self->queued);
+				
+			} else {
+				// the compressors are behind; write it as is rather than wait for them
+				job->state = eTraceWriterJobState_ready;
+				pthread_cond_signal(&self->ready);
+			}
+			appendJob(self, job);
+		}
+		pthread_mutex_unlock(&self->lock);
+	}
+	return retVal;
+}
+
+
+static void appendJob(TraceWriter* self, TraceWriterJob* job) {
+	// the lock is held
+	job->next = NULL;
+	if (self->tail) {
+		self->tail->next = job;
+	} else {
+		self->head = job;
+	}
+	self->tail = job;
+	self->pendingCount++;
+}
+
+
+static void appendDropped(TraceWriter* self) {
+	// the lock is held; if we can't get a job we'll try again with the next chunk
+	TraceWriterJob* job = self->free;
+	if (job) {
+		self->free = job->next;
+	} else {
+		job = calloc(1, sizeof(TraceWriterJob));
+	}
+	
+	if (job == NULL) {
+		Log_error("calloc");
+		
+	} else {
+		TraceBuffer_reset(&job->raw);
+		if (	(TraceBuffer_append(&job->raw, &self->droppedChunks, sizeof(self->droppedChunks)) == false)
+			 || (TraceBuffer_append(&job->raw, &self->droppedBytes, sizeof(self->droppedBytes)) == false)) {
+			Log_error("TraceBuffer_append");
+			job->next = self->free;
+			self->free = job;
+			
+		} else {
+			bzero(&job->entry, sizeof(job->entry));
+			bzero(&job->summary, sizeof(job->summary));
+			job->entry.firstBlock = self->dropped.firstBlock;
+			job->entry.timestamp = self->dropped.timestamp;
+			job->entry.flags = eTraceLogChunkFlag_dropped;
+			job->useCompressed = false;
+			job->rotate = false;
+			job->state = eTraceWriterJobState_ready;
+			appendJob(self, job);
+			pthread_cond_signal(&self->ready);
+			
+			self->droppedChunks = 0;
+			self->droppedBytes = 0;
+		}
+	}
+}
+
+
+static void freeJob(TraceWriter* self, TraceWriterJob* job) {
+	pthread_mutex_lock(&self->lock);
+	job->next = self->free;
+	self->free = job;
+	pthread_mutex_unlock(&self->lock);
+}
+
+
+static void* compressorThread(void* arg) {
+	TraceWriter* self = arg;
+	pthread_mutex_lock(&self->lock);
+	while (1) {
+		TraceWriterJob* job = self->head;
+		while (job && job->state != eTraceWriterJobState_queued) {
+			job = job->next;
+		}
+		
+		if (job) {
+			job->state = eTraceWriterJobState_compressing;
+			self->queuedCount--;
+			pthread_mutex_unlock(&self->lock);
+			
+			uint64_t ticks = compressJob(job);
+			
+			pthread_mutex_lock(&self->lock);
+			self->compressTicks += ticks;
+			self->compressInput += job->raw.size;
+			job->state = eTraceWriterJobState_ready;
+			pthread_cond_signal(&self->ready);
+			
+		} else if (self->shutdown) {
+			break;
+			
+		} else {
+			pthread_cond_wait(&self->queued, &self->lock);
+		}
+	}
+	pthread_mutex_unlock(&self->lock);
+	return NULL;
+}
+
+
+static void* writerThread(void* arg) {
+	TraceWriter* self = arg;
+	pthread_mutex_lock(&self->lock);
+	while (1) {
+		// chunks have to go out in order; so we only ever write the head
+		TraceWriterJob* job = self->head;
+		if (job && job->state == eTraceWriterJobState_ready) {
+			self->head = job->next;
+			if (self->head == NULL) {
+				self->tail = NULL;
+			}
+			pthread_mutex_unlock(&self->lock);
+			
+			bool written = self->failed == false && (job->rotate ? rotateOutput(self): writeJob(self, job));
+			
+			pthread_mutex_lock(&self->lock);
+			self->failed = (written == false);
+			job->next = self->free;
+			self->free = job;
+			self->pendingCount--;
+			pthread_cond_broadcast(&self->written);
+			
+		} else if (job == NULL && self->shutdown) {
+			break;
+			
+		} else {
+			pthread_cond_wait(&self->ready, &self->lock);
+		}
+	}
+	pthread_mutex_unlock(&self->lock);
+	return NULL;
+}
+
+
+static uint64_t compressJob(TraceWriterJob* job) {
+	uint64_t start = mach_absolute_time();
+	if (TraceBuffer_reserve(&job->compressed, TraceCompress_bound(job->raw.size))) {
+		job->compressed.size = TraceCompress_compress(job->raw.data,
+													  job->raw.size,
+													  job->compressed.data,
+													  job->compressed.capacity);
+													
+		// if it didn't help (or failed) we store it as it is
+		job->useCompressed = job->compressed.size != 0 && job->compressed.size < job->raw.size;
+	}
+	return mach_absolute_time() - start;
+}
+
+
+static bool writeJob(TraceWriter* self, TraceWriterJob* job) {
+	bool retVal = false;
+	TraceBuffer* data = job->useCompressed ? &job->compressed: &job->raw;
+	
+	TraceLogChunkHeader header = {0};
+	header.magic = kTraceLogChunkMagic;
+	header.size = (uint32_t) data->size;
+	header.firstBlock = job->entry.firstBlock;
+	header.timestamp = job->entry.timestamp;
+	header.thread = job->entry.thread;
+	header.flags = job->entry.flags | (job->useCompressed ? eTraceLogChunkFlag_compressed: 0);
+	header.rawSize = (uint32_t) job->raw.size;
+	
+	if (self->indexCount == self->indexCapacity) {
+		uint32_t capacity = self->indexCapacity ? self->indexCapacity * 2: 64;
+		TraceLogIndexEntry* index = realloc(self->index, capacity * sizeof(TraceLogIndexEntry));
+		if (index) {
+			self->index = index;
+		}
+		TraceLogChunkSummary* summaries = realloc(self->summaries, capacity * sizeof(TraceLogChunkSummary));
+		if (summaries) {
+			self->summaries = summaries;
+		}
+		if (index && summaries) {
+			self->indexCapacity = capacity;
+		}
+	}
+	
+	if (self->indexCount == self->indexCapacity) {
+		Log_error("realloc");
+		
+	} else if (	   (TraceOutput_write(&self->output, &header, sizeof(header)) == false)
+				|| (TraceOutput_write(&self->output, data->data, data->size) == false)) {
+		Log_error("write chunk");
+		
+	} else {
+		self->summaries[self->indexCount] = job->summary;
+		TraceLogIndexEntry* entry = &self->index[self->indexCount++];
+		*entry = job->entry;
+		entry->offset = self->offset;
+		entry->size = header.size;
+		entry->flags = header.flags;
+		self->offset += sizeof(header) + data->size;
+		
+		self->chunks++;
+		self->rawBytes += job->raw.size;
+		self->storedBytes += data->size;
+		if (job->useCompressed == false) {
+			self->uncompressedChunks++;
+		}
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static bool rotateOutput(TraceWriter* self) {
+	bool retVal = false;
+	bool indexed = writeIndex(self);
+	TraceOutput_close(&self->output);
+	self->indexCount = 0;
+	self->offset = 0;
+	self->segment++;
+	
+	char path[PATH_MAX] = {0};
+	(void) snprintf(path, sizeof(path), "%s.%u", self->path, self->segment);
+	if (indexed == false) {
+		Log_error("writeIndex");
+		
+	} else if (TraceOutput_open(&self->output, path, self->output.type) == false) {
+		Log_error("TraceOutput_open: %s", path);
+		
+	} else if (TraceOutput_write(&self->output, self->header.data, self->header.size) == false) {
+		Log_error("TraceOutput_write");
+		
+	} else {
+		printf("trace: segment %s\n", path);
+		self->offset = self->header.size;
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static bool writeIndex(TraceWriter* self) {
+	bool retVal = false;
+	TraceLogFooter footer = {0};
+	footer.magic = kTraceLogFooterMagic;
+	footer.count = self->indexCount;
+	footer.indexOffset = self->offset;
+	if (	(TraceOutput_write(&self->output, self->index, self->indexCount * sizeof(TraceLogIndexEntry)) == false)
+		 || (TraceOutput_write(&self->output, self->summaries, self->indexCount * sizeof(TraceLogChunkSummary)) == false)
+		 || (TraceOutput_write(&self->output, &footer, sizeof(footer)) == false)) {
+		Log_error("write index");
+		
+	} else {
+		retVal = true;
+	}
+	return retVal;
+}
+
+
+static void printStats(TraceWriter* self) {
+	double ratio = self->storedBytes ? (double) self->rawBytes / self->storedBytes: 1.0;
+	printf("trace: %llu chunks, %llu bytes stored in %llu (%.2fx)",
+		   self->chunks,
+		   self->rawBytes,
+		   self->storedBytes,
+		   ratio);
+		
+	if (self->threads) {
+		mach_timebase_info_data_t timebase = {0};
+		(void) mach_timebase_info(&timebase);
+		double seconds = ((double) self->compressTicks * timebase.numer / timebase.denom) / 1000000000.0;
+		double mbPerSec = seconds > 0 ? (self->compressInput / seconds) / (1024 * 1024): 0;
+		printf(", compressing at %.1fMB/s per thread, %llu chunks stored uncompressed",
+			   mbPerSec,
+			   self->uncompressedChunks);
+	}
+	if (self->totalDropped) {
+		printf(", %llu chunks dropped as the consumer was behind", self->totalDropped);
+	}
+	if (self->dumps) {
+		printf(", %llu chunks written from the ring by %llu triggers", self->dumpedChunks, self->dumps);
+	}
+	printf("\n");
+}
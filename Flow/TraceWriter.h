@@ -0,0 +1,224 @@
+//
+//  TraceWriter.h
+//  Flow
+//
+//  Created by R J Cooper on 18/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Flow_TraceWriter_h
+#define Flow_TraceWriter_h
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "TraceBuffer.h"
+#include "TraceOutput.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTraceLogChunkMagic		(0x4B4E4843)	// 'CHNK'
+#define kTraceLogFooterMagic	(0x58444946)	// 'FIDX'
+#define kTraceWriterMaxThreads	(16)
+#define kTraceWriterMaxPending	(64)			// chunks waiting for the writer thread; a slow disk or stream consumer
+#define kTraceLogSummaryWords	(16)			// of TraceLogChunkSummary's page filter; 1024 bits
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef enum eTraceLogChunkFlag {
+	eTraceLogChunkFlag_images = 0x1,		// has dyld/library/image records; a reader seeking needs these
+	eTraceLogChunkFlag_compressed = 0x2,	// the records are TraceCompress'ed
+	eTraceLogChunkFlag_dropped = 0x4		// not records; a uint64_t count and size of chunks we dropped
+} TraceLogChunkFlag;
+
+
+/*
+ * From version 2 the records are written in chunks; each one starts with a
+ * TraceLogChunkHeader and can be decoded on its own (the block dictionary, branch
+ * state and embedded pages all start afresh).  The file ends with an index of the
+ * chunks, one TraceLogIndexEntry each, then a TraceLogChunkSummary for each chunk, 
+ * then a TraceLogFooter.  If the footer is missing (we crashed) a reader can still walk
+ * the chunk headers from the start.  Logs from before the summaries go straight from 
+ * the index to the footer; so a reader knows they're there from the space they take.
+ */
+typedef struct sTraceLogChunkHeader {
+	uint32_t	magic;			// kTraceLogChunkMagic
+	uint32_t	size;			// of the records which follow, as stored
+	uint64_t	firstBlock;		// sequence number of the first block in the chunk
+	uint64_t	timestamp;		// mach_absolute_time when the chunk was started
+	uint64_t	thread;			// id of the thread running when the chunk was started
+	uint32_t	flags;			// TraceLogChunkFlag's
+	uint32_t	rawSize;		// of the records once decompressed
+} TraceLogChunkHeader;
+
+
+typedef struct sTraceLogIndexEntry {
+	uint64_t	offset;			// of the TraceLogChunkHeader
+	uint64_t	firstBlock;
+	uint64_t	timestamp;
+	uint64_t	thread;
+	uint32_t	size;
+	uint32_t	flags;
+} TraceLogIndexEntry;
+
+
+/*
+ * What a chunk's blocks ran; so a reader looking for an address can skip the chunks 
+ * which can't have it without decompressing them.  TraceSummary adds to and tests it.
+ */
+typedef struct sTraceLogChunkSummary {
+	uint64_t	blocks;			// in the chunk; low and high are only set if there are some
+	uint64_t	low;			// lowest block entry
+	uint64_t	high;			// highest block branch
+	uint64_t	pages[kTraceLogSummaryWords];	// Bloom filter of the pages the blocks ran in
+} TraceLogChunkSummary;
+
+
+typedef struct sTraceLogFooter {
+	uint32_t	magic;			// kTraceLogFooterMagic
+	uint32_t	count;			// of TraceLogIndexEntry's
+	uint64_t	indexOffset;
+} TraceLogFooter;
+
+
+typedef enum eTraceWriterJobState {
+	eTraceWriterJobState_queued,		// waiting for a compression thread
+	eTraceWriterJobState_compressing,
+	eTraceWriterJobState_ready			// can be written out
+} TraceWriterJobState;
+
+
+typedef struct sTraceWriterJob {
+	struct sTraceWriterJob*	next;
+	TraceWriterJobState		state;
+	TraceLogIndexEntry		entry;
+	TraceLogChunkSummary	summary;
+	TraceBuffer				raw;
+	TraceBuffer				compressed;
+	bool					useCompressed;
+	bool					rotate;			// not a chunk; finish this file and start the next segment
+} TraceWriterJob;
+
+
+/*
+ * Takes finished chunks and gets them into the file.  With compression threads each
+ * chunk is queued for the pool and a writer thread writes them out, in order, as
+ * they finish; so the exception path only ever waits to take the lock.  If the pool
+ * falls behind chunks are written uncompressed rather than waiting for it.
+ *
+ * With a ring (flight recorder mode) submitted chunks are only kept in memory, the
+ * oldest being dropped when it's full, until TraceWriter_dump writes them all out.
+ *
+ * A consumer reading the trace live (eTraceOutputType_stream) always gets a writer
+ * thread, so we never block in write(2).  At most kTraceWriterMaxPending chunks wait
+ * for the writer thread, whatever the output.  When that many are waiting 
+ * TraceWriter_submit waits for it to catch up or, with dropWhenFull on a stream, 
+ * drops the chunk.  Runs of dropped
+ * chunks are replaced by a eTraceLogChunkFlag_dropped chunk so the consumer knows.
+ * Chunks with eTraceLogChunkFlag_images are never dropped.
+ *
+ * TraceWriter_rotate finishes the file (its index and footer) once the chunks before
+ * it are written and starts the next segment; path.1, path.2 etc, each starting with
+ * the same file header.
+ */
+typedef struct sTraceWriter {
+	TraceOutput			output;
+	char*				path;
+	TraceBuffer			header;			// what TraceWriter_write wrote; each segment starts with it
+	uint32_t			segment;
+	uint64_t			offset;			// where the next chunk goes
+	TraceLogIndexEntry*	index;
+	TraceLogChunkSummary*	summaries;	// one per index entry
+	uint32_t			indexCount;
+	uint32_t			indexCapacity;
+	
+	pthread_mutex_t		lock;
+	pthread_cond_t		queued;			// signalled when there's work for the compressors
+	pthread_cond_t		ready;			// and when there's something for the writer
+	pthread_t			compressors[kTraceWriterMaxThreads];
+	pthread_t			writer;
+	bool				hasWriter;		// false if we're not compressing; we write chunks as they come
+	uint32_t			threads;		// compressors
+	uint32_t			queuedCount;
+	bool				shutdown;
+	bool				failed;			// a write failed; everything after is dropped
+	TraceWriterJob*		head;			// jobs in chunk order; written from the head
+	TraceWriterJob*		tail;
+	TraceWriterJob*		free;
+	
+	// eTraceOutputType_stream flow control
+	uint32_t			maxPending;		// 0 for no limit
+	uint32_t			pendingCount;	// chunks enqueued but not yet written
+	pthread_cond_t		written;		// signalled when pendingCount goes down
+	bool				dropWhenFull;	// rather than wait
+	TraceLogIndexEntry	dropped;		// the first chunk dropped since the last eTraceLogChunkFlag_dropped
+	uint64_t			droppedChunks;	// and how many
+	uint64_t			droppedBytes;
+	
+	// flight recorder mode; chunks are kept here until TraceWriter_dump
+	TraceWriterJob**	ring;
+	uint32_t			ringSize;		// 0 if we're writing everything
+	uint32_t			ringStart;
+	uint32_t			ringCount;
+	
+	// stats
+	uint64_t			chunks;
+	uint64_t			uncompressedChunks;	// because the pool was behind, or it didn't help
+	uint64_t			rawBytes;
+	uint64_t			storedBytes;
+	uint64_t			compressInput;		// bytes given to the compressors
+	uint64_t			compressTicks;		// mach_absolute_time spent compressing
+	uint64_t			totalDropped;		// chunks
+	uint64_t			dumps;				// TraceWriter_dump calls
+	uint64_t			dumpedChunks;		// the ring chunks they wrote out
+} TraceWriter;
+
+
+
+
+/*
+ * Exported function definitions
+ */
+bool TraceWriter_open(TraceWriter* self, 
+					  const char* path, 
+					  TraceOutputType output, 
+					  uint32_t threads, 
+					  uint32_t ringSize, 
+					  bool dropWhenFull);
+bool TraceWriter_write(TraceWriter* self, const void* data, uint64_t length);
+bool TraceWriter_submit(TraceWriter* self, TraceBuffer* chunk, TraceLogIndexEntry* entry, const TraceLogChunkSummary* summary);
+bool TraceWriter_dump(TraceWriter* self, TraceBuffer* chunk, TraceLogIndexEntry* entry, const TraceLogChunkSummary* summary);
+bool TraceWriter_rotate(TraceWriter* self);
+void TraceWriter_close(TraceWriter* self);
+
+
+#endif
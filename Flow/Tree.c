@@ -0,0 +1,501 @@
+//
+//  Tree.c
+//  Flow
+//
+//  Created by R J Cooper on 19/10/2026.
+//  Copyright (c) 2012 Mountainstorm
+//  
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//  
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//  
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "Tree.h"
+#include "CallIndex.h"
+#include "Log.h"
+
+
+
+
+/*
+ * Defines
+ */
+#define kTreeDefaultDepth		(2)			// printed when it's not a terminal
+#define kTreeLineSize			(2048)
+#define kTreePageSize			(256)		// the most calls loaded at a time; a screen's worth when viewing
+#define kTreeIndexExtension		".calls"
+
+
+
+
+/*
+ * Struct/Enum definitions
+ */
+typedef struct sOptions {
+	const char*	root;
+	char		indexFilename[PATH_MAX];
+	bool		rebuild;
+	int32_t		depth;				// to print to; -1 to view it interactively
+	const char*	traceFilename;
+} Options;
+
+
+typedef enum eTreeKey {
+	eTreeKey_none,
+	eTreeKey_up,
+	eTreeKey_down,
+	eTreeKey_expand,
+	eTreeKey_collapse,
+	eTreeKey_toggle,
+	eTreeKey_pageUp,
+	eTreeKey_pageDown,
+	eTreeKey_top,
+	eTreeKey_bottom,
+	eTreeKey_quit
+} TreeKey;
+
+
+typedef struct sTreeRow {
+	uint64_t	node;
+	uint32_t	depth;
+	bool		expanded;
+	uint32_t	more;				// a "... more" row; the calls left to load, from node on
+} TreeRow;
+
+
+/*
+ * The rows are the nodes on show; expanding one inserts its calls after it and
+ * collapsing removes them again.  So memory goes with what's been expanded, not the
+ * size of the tree, and moving past a collapsed call doesn't read anything under it.
+ * Calls are inserted a page at a time, ending with a row which loads the next page;
+ * so expanding something which made millions of calls is no slower than any other.
+ */
+typedef struct sTree {
+	CallIndex	index;
+	TreeRow*	rows;
+	uint64_t	count;
+	uint64_t	capacity;
+	uint32_t	pageSize;			// calls loaded at a time
+	uint64_t	top;				// the first row on screen
+	uint64_t	cursor;
+} Tree;
+
+
+
+
+/*
+ * Static function predefinitions
+ */
+static void parseOptions(Options* options, int argc, char* argv[]);
+static void usage(void);
+static bool addRows(Tree* self, uint64_t at, uint64_t count);
+static bool expand(Tree* self, uint64_t row);
+static bool loadCalls(Tree* self, uint64_t at, uint64_t first, uint32_t remaining, uint32_t depth);
+static void collapse(Tree* self, uint64_t row);
+static void formatRow(Tree* self, char* line, uint32_t size, uint64_t row);
+static bool printTree(Tree* self, uint32_t depth);
+static bool view(Tree* self);
+static void draw(Tree* self);
+static TreeKey readKey(void);
+
+
+
+
+/*
+ * Exported function implementations
+ */
+int Tree_main(int argc, char* argv[]) {
+	int retVal = -1;
+	Options options = {0};
+	parseOptions(&options, argc, argv);
+	
+	Tree tree = {0};
+	tree.pageSize = kTreePageSize;
+	if (CallIndex_open(&tree.index, options.traceFilename, options.indexFilename, options.root, options.rebuild)) {
+		uint32_t threadCount = tree.index.header->threadCount;
+		if (addRows(&tree, 0, threadCount)) {
+			for (uint32_t i = 0; i < threadCount; i++) {
+				tree.rows[i].node = tree.index.threads[i];
+			}
+			
+			bool ok = false;
+			if (options.depth >= 0) {
+				ok = printTree(&tree, options.depth);
+				
+			} else {
+				ok = view(&tree);
+			}
+			retVal = ok ? 0: -1;
+		}
+		CallIndex_close(&tree.index);
+	}
+	free(tree.rows);
+	return retVal;
+}
+
+
+
+
+/*
+ * Static function implementations
+ */
+static void parseOptions(Options* options, int argc, char* argv[]) {
+	options->root = "";
+	options->depth = -1;
+	
+	int c = -1;
+	while ((c = getopt(argc, argv, "r:i:bd:")) != -1) {
+		switch (c) {
+			case 'r':
+				options->root = optarg;
+				break;
+				
+			case 'i':
+				(void) snprintf(options->indexFilename, sizeof(options->indexFilename), "%s", optarg);
+				break;
+				
+			case 'b':
+				options->rebuild = true;
+				break;
+				
+			case 'd':
+				options->depth = atoi(optarg);
+				break;
+				
+			default:
+				usage();
+				break;
+		}
+	}
+	
+	if (optind != argc - 1) {
+		usage();
+	}
+	options->traceFilename = argv[optind];
+	if (options->indexFilename[0] == '\0') {
+		(void) snprintf(options->indexFilename, sizeof(options->indexFilename), "%s%s", options->traceFilename, kTreeIndexExtension);
+	}
+	if (options->depth < 0 && (isatty(STDIN_FILENO) == false || isatty(STDOUT_FILENO) == false)) {
+		options->depth = kTreeDefaultDepth;
+	}
+}
+
+
+static void usage(void) {
+	printf("Usage: flowtool tree [-r root] [-i indexfile] [-b] [-d depth] tracefile\n");
+	printf("    -r: where the traced process's root was; prefixed to image paths to read their symbols\n");
+	printf("    -i: the index of its calls; built the first time (default tracefile%s)\n", kTreeIndexExtension);
+	printf("    -b: rebuild the index even if it's up to date\n");
+	printf("    -d: print the calls this deep rather than viewing them (default %d if it's not a terminal)\n", kTreeDefaultDepth);
+	printf("Viewing, j/k or the arrows move, l/h expand and collapse, return toggles, space/b page and q quits\n");
+	exit(-1);
+}
+
+
+static bool addRows(Tree* self, uint64_t at, uint64_t count) {
+	// makes room for count rows at at
+	bool retVal = true;
+	if (self->count + count > self->capacity) {
+		uint64_t capacity = self->capacity ? self->capacity: 1024;
+		while (capacity < self->count + count) {
+			capacity *= 2;
+		}
+		TreeRow* rows = realloc(self->rows, capacity * sizeof(TreeRow));
+		if (rows == NULL) {
+			Log_error("out of memory");
+			retVal = false;
+			
+		} else {
+			self->rows = rows;
+			self->capacity = capacity;
+		}
+	}
+	
+	if (retVal && count > 0) {
+		memmove(&self->rows[at + count], &self->rows[at], (self->count - at) * sizeof(TreeRow));
+		memset(&self->rows[at], 0, count * sizeof(TreeRow));
+		self->count += count;
+	}
+	return retVal;
+}
+
+
+static bool expand(Tree* self, uint64_t row) {
+	bool retVal = true;
+	TreeRow r = self->rows[row];
+	const CallIndexNode* node = CallIndex_getNode(&self->index, r.node);
+	if (r.more) {
+		// the next page replaces it
+		memmove(&self->rows[row], &self->rows[row + 1], (self->count - (row + 1)) * sizeof(TreeRow));
+		self->count--;
+		retVal = loadCalls(self, row, r.node, r.more, r.depth);
+		
+	} else if (node && node->children && r.expanded == false) {
+		retVal = loadCalls(self, row + 1, node->firstChild, node->children, r.depth + 1);
+		self->rows[row].expanded = retVal;
+	}
+	return retVal;
+}
+
+
+static bool loadCalls(Tree* self, uint64_t at, uint64_t first, uint32_t remaining, uint32_t depth) {
+	// a page of calls from first, and a row for the rest if there's any left
+	uint64_t calls[kTreePageSize];
+	uint32_t max = (remaining < self->pageSize) ? remaining: self->pageSize;
+	uint32_t count = CallIndex_getChildren(&self->index, first, calls, max);
+	bool more = (count > 0 && count == max && count < remaining);
+	bool retVal = addRows(self, at, count + more);
+	for (uint32_t i = 0; retVal && i < count; i++) {
+		self->rows[at + i].node = calls[i];
+		self->rows[at + i].depth = depth;
+	}
+	if (retVal && more) {
+		self->rows[at + count].node = CallIndex_getNode(&self->index, calls[count - 1])->next;
+		self->rows[at + count].depth = depth;
+		self->rows[at + count].more = remaining - count;
+	}
+	return retVal;
+}
+
+
+static void collapse(Tree* self, uint64_t row) {
+	uint64_t end = row + 1;
+	while (end < self->count && self->rows[end].depth > self->rows[row].depth) {
+		end++;
+	}
+	memmove(&self->rows[row + 1], &self->rows[end], (self->count - end) * sizeof(TreeRow));
+	self->count -= end - (row + 1);
+	self->rows[row].expanded = false;
+}
+
+
+static void formatRow(Tree* self, char* line, uint32_t size, uint64_t row) {
+	TreeRow* r = &self->rows[row];
+	if (r->more) {
+		(void) snprintf(line, size, "%*s  ... %u more calls", r->depth * 2, "", r->more);
+		
+	} else {
+		const CallIndexNode* node = CallIndex_getNode(&self->index, r->node);
+		char marker = (node->children == 0) ? ' ': (r->expanded ? '-': '+');
+		(void) snprintf(line, size, "%*s%c %s  %llu blocks, %u calls  [%llu-%llu]",
+						r->depth * 2, "",
+						marker,
+						CallIndex_getName(&self->index, r->node),
+						node->blocks,
+						node->children,
+						node->firstBlock,
+						node->lastBlock);
+	}
+}
+
+
+static bool printTree(Tree* self, uint32_t depth) {
+	// each row's calls are inserted after it; so going down the rows is going down the tree, and
+	// each "... more" row is replaced by the next page as it's reached
+	bool retVal = true;
+	char line[kTreeLineSize] = "";
+	printf("%llu calls in %u threads\n", 
+		   self->index.header->nodeCount - self->index.header->threadCount, 
+		   self->index.header->threadCount);
+	for (uint64_t i = 0; retVal && i < self->count; i++) {
+		while (retVal && i < self->count && self->rows[i].more) {
+			retVal = expand(self, i);
+		}
+		if (retVal && i < self->count && self->rows[i].depth < depth) {
+			retVal = expand(self, i);
+		}
+		if (retVal && i < self->count) {
+			formatRow(self, line, sizeof(line), i);
+			printf("%s\n", line);
+		}
+	}
+	return retVal;
+}
+
+
+static bool view(Tree* self) {
+	bool retVal = true;
+	struct termios saved = {0};
+	struct termios raw = {0};
+	(void) tcgetattr(STDIN_FILENO, &saved);
+	raw = saved;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	(void) tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+	
+	// the alternate screen; so the terminal's as it was when we quit
+	printf("\x1b[?1049h\x1b[?25l");
+	TreeKey key = eTreeKey_none;
+	while (retVal && key != eTreeKey_quit) {
+		draw(self);
+		
+		struct winsize size = {0};
+		uint64_t page = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 2) ? size.ws_row - 1: 24;
+		key = readKey();
+		
+		// an empty tree (a trace with only the metadata stream) has no rows to move over
+		if (self->count > 0) {
+			self->pageSize = (page < kTreePageSize) ? (uint32_t) page: kTreePageSize;
+			TreeRow* row = &self->rows[self->cursor];
+			switch (key) {
+				case eTreeKey_up:
+					self->cursor -= (self->cursor > 0);
+					break;
+					
+				case eTreeKey_down:
+					self->cursor += (self->cursor + 1 < self->count);
+					break;
+					
+				case eTreeKey_expand:
+					if (row->expanded) {
+						self->cursor += (self->cursor + 1 < self->count);
+						
+					} else {
+						retVal = expand(self, self->cursor);
+					}
+					break;
+					
+				case eTreeKey_collapse:
+					if (row->expanded) {
+						collapse(self, self->cursor);
+						
+					} else {
+						// up to its caller
+						uint64_t i = self->cursor;
+						while (i > 0 && self->rows[i].depth >= row->depth) {
+							i--;
+						}
+						self->cursor = (self->rows[i].depth < row->depth) ? i: self->cursor;
+					}
+					break;
+					
+				case eTreeKey_toggle:
+					if (row->expanded) {
+						collapse(self, self->cursor);
+						
+					} else {
+						retVal = expand(self, self->cursor);
+					}
+					break;
+					
+				case eTreeKey_pageUp:
+					self->cursor = (self->cursor > page) ? self->cursor - page: 0;
+					break;
+					
+				case eTreeKey_pageDown:
+					self->cursor = (self->cursor + page < self->count) ? self->cursor + page: self->count - 1;
+					break;
+					
+				case eTreeKey_top:
+					self->cursor = 0;
+					break;
+					
+				case eTreeKey_bottom:
+					self->cursor = self->count - 1;
+					break;
+					
+				default:
+					break;
+			}
+		}
+	}
+	
+	printf("\x1b[?25h\x1b[?1049l");
+	fflush(stdout);
+	(void) tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+	return retVal;
+}
+
+
+static void draw(Tree* self) {
+	struct winsize size = {0};
+	uint32_t height = 24;
+	uint32_t width = 80;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 1 && size.ws_col > 0) {
+		height = size.ws_row - 1;
+		width = size.ws_col < kTreeLineSize ? size.ws_col: kTreeLineSize - 1;
+	}
+	
+	// keep the cursor on screen
+	if (self->cursor < self->top) {
+		self->top = self->cursor;
+		
+	} else if (self->cursor >= self->top + height) {
+		self->top = self->cursor - height + 1;
+	}
+	
+	char line[kTreeLineSize] = "";
+	printf("\x1b[H");
+	for (uint32_t i = 0; i < height; i++) {
+		uint64_t row = self->top + i;
+		if (row < self->count) {
+			formatRow(self, line, sizeof(line), row);
+			line[width] = '\0';
+			printf("%s%s\x1b[0m", (row == self->cursor) ? "\x1b[7m": "", line);
+		}
+		printf("\x1b[K\r\n");
+	}
+	(void) snprintf(line, sizeof(line), " %llu/%llu  j/k move  l/h expand/collapse  space/b page  q quit", self->count ? self->cursor + 1: 0, self->count);
+	line[width] = '\0';
+	printf("\x1b[7m%s\x1b[K\x1b[0m", line);
+	fflush(stdout);
+}
+
+
+static TreeKey readKey(void) {
+	static const struct {
+		const char*	sequence;
+		TreeKey		key;
+	} keys[] = {
+		{"k", eTreeKey_up}, {"\x1b[A", eTreeKey_up},
+		{"j", eTreeKey_down}, {"\x1b[B", eTreeKey_down},
+		{"l", eTreeKey_expand}, {"\x1b[C", eTreeKey_expand},
+		{"h", eTreeKey_collapse}, {"\x1b[D", eTreeKey_collapse},
+		{"\r", eTreeKey_toggle}, {"\n", eTreeKey_toggle},
+		{"b", eTreeKey_pageUp}, {"\x1b[5~", eTreeKey_pageUp},
+		{" ", eTreeKey_pageDown}, {"\x1b[6~", eTreeKey_pageDown},
+		{"g", eTreeKey_top}, {"G", eTreeKey_bottom},
+		{"q", eTreeKey_quit}
+	};
+	
+	TreeKey retVal = eTreeKey_none;
+	char buffer[16] = {0};
+	ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
+	if (n == 0 || (n < 0 && errno != EINTR)) {
+		// end of input, or it's gone; an interrupted read is just tried again
+		retVal = eTreeKey_quit;
+		
+	} else if (n > 0) {
+		for (uint32_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+			if (strcmp(buffer, keys[i].sequence) == 0) {
+				retVal = keys[i].key;
+			}
+		}
+	}
+	return retVal;
+}
@@ -34,6 +34,7 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <Security/Authorization.h>
 
 #include "Log.h"
@@ -45,6 +46,15 @@
 
 
 
+/*
+ * Defines
+ */
+#define kDefaultCompressThreads	(2)
+#define kMinRingChunks			(2)
+
+
+
+
 /*
  * Structure definitions
  */
@@ -59,6 +69,7 @@ typedef struct sOptions {
 	pid_t			pid;			// pid to attach too if eLaunchStyle_attach
 	cpu_type_t		cpuType;		// fat binary img to run; CPU_TYPE_ANY means default
 	char*			traceFilename;	// if not NULL, the output trace log filename
+	TraceLogOptions	traceOptions;	// how the trace log is encoded and what it embeds
 	eLaunchStyle	launchStyle;
 } Options;
 
@@ -72,6 +83,8 @@ static bool processTaskExceptions(pid_t pid, task_t task, const char* traceFilen
 
 static int parseOptions(Options* options, int argc, char* argv[]);
 static cpu_type_t parseCpuType(char* cpuTypeStr);
+static TraceLogFormat parseTraceFormat(char* traceFormatStr);
+static void onTriggerSignal(int signum);
 static void usage(void);
 static bool acquireTaskportRight(void);
 
@@ -151,12 +164,13 @@ static bool processTaskExceptions(pid_t pid, task_t task, const char* traceFilen
 	bool retVal = false;
 	
 	Flow flow = {0};
-	if (Flow_create(&flow, task, traceFilename) == KERN_SUCCESS) {
+	if (Flow_create(&flow, task, traceFilename, &options->traceOptions) == KERN_SUCCESS) {
 		ExceptionPort exceptionPort = {0};
 		kern_return_t ret = ExceptionPort_attachToTask(&exceptionPort, 
 													   task,
 													   (ExceptionPort_onException*) Flow_onException,
-													   &flow);
+													   &flow,
+													   options->traceOptions.ringChunks != 0);
 		if (ret == KERN_SUCCESS) {
 			/*
 			 * we must have attached to the tasks exception port before ptrace attaching, 
@@ -171,6 +185,13 @@ static bool processTaskExceptions(pid_t pid, task_t task, const char* traceFilen
 				
 			} else {
 				retVal = true;
+				
+				// SIGUSR2 dumps the flight recorder; SA_RESTART so it doesn't break us out of waitpid
+				struct sigaction action = {0};
+				action.sa_handler = onTriggerSignal;
+				action.sa_flags = SA_RESTART;
+				(void) sigaction(SIGUSR2, &action, NULL);
+				
 				pthread_t exceptionThread = NULL;
 				int err = pthread_create(&exceptionThread, 
 										 NULL, 
@@ -215,9 +236,12 @@ static int parseOptions(Options* options, int argc, char* argv[]) {
 	options->cpuType = CPU_TYPE_ANY;
 	options->pid = -1;
 	options->launchStyle = eLaunchStyle_posixSpawn;
+	options->traceOptions.format = eTraceLogFormat_raw;
+	options->traceOptions.flags = 0;
+	options->traceOptions.compressThreads = kDefaultCompressThreads;
 	
 	int c = -1;
-	while ((c = getopt(argc, argv, "sc:a:o:")) != -1) {
+	while ((c = getopt(argc, argv, "sEmdc:a:o:f:z:r:t:S:T:")) != -1) {
 		switch (c) {
 			case 's':
 				options->launchStyle = eLaunchStyle_springboard;
@@ -236,6 +260,45 @@ static int parseOptions(Options* options, int argc, char* argv[]) {
 				options->traceFilename = optarg;
 				break;
 				
+			case 'f':
+				options->traceOptions.format = parseTraceFormat(optarg);
+				break;
+				
+			case 'E':
+				options->traceOptions.flags |= eTraceLogFlag_embedImages;
+				break;
+				
+			case 'm':
+				options->traceOptions.output = eTraceOutputType_mmap;
+				break;
+				
+			case 'd':
+				options->traceOptions.dropWhenFull = true;
+				break;
+				
+			case 'z':
+				options->traceOptions.compressThreads = atoi(optarg);
+				break;
+				
+			case 'r':
+				options->traceOptions.ringChunks = (atoi(optarg) * 1024 * 1024) / kTraceLogChunkSize;
+				if (options->traceOptions.ringChunks < kMinRingChunks) {
+					options->traceOptions.ringChunks = kMinRingChunks;
+				}
+				break;
+				
+			case 't':
+				options->traceOptions.triggerPC = strtoull(optarg, NULL, 16);
+				break;
+				
+			case 'S':
+				options->traceOptions.segmentSize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+				
+			case 'T':
+				options->traceOptions.segmentSeconds = atoi(optarg);
+				break;
+				
 			default:
 				usage();
 				break;
@@ -263,9 +326,41 @@ static cpu_type_t parseCpuType(char* cpuTypeStr) {
 }
 
 
+static TraceLogFormat parseTraceFormat(char* traceFormatStr) {
+	TraceLogFormat retVal = eTraceLogFormat_raw;
+	if (strcmp(traceFormatStr, "dict") == 0) {
+		retVal = eTraceLogFormat_dictionary;
+	} else if (strcmp(traceFormatStr, "branch") == 0) {
+		retVal = eTraceLogFormat_branch;
+	} else if (strcmp(traceFormatStr, "raw") != 0) {
+		usage();
+	}
+	return retVal;
+}
+
+
+static void onTriggerSignal(int signum) {
+	// there's only the one trigger signal
+	(void) signum;
+	Flow_requestTrigger();
+}
+
+
 static void usage(void) {
-	printf("Usage: flow [-o tracefile] -a pid | [-se] [-c i386|x86_64] prog args\n");
-	printf("    -o: the name of the tracefile\n"); 
+	printf("Usage: flow [-o tracefile] [-f raw|dict|branch] [-E] [-m] [-d] [-z threads] [-r megabytes] [-t pc] [-S megabytes] [-T seconds] -a pid | [-se] [-c i386|x86_64] prog args\n");
+	printf("    -o: the name of the tracefile; or unix:path (a socket) or fd:n (an inherited pipe) for a\n");
+	printf("        consumer reading it live\n");
+	printf("    -f: trace format; raw (default), dict (blocks written once then referenced by id)\n");
+	printf("        or branch (only branch outcomes; FlowCalls.py rebuilds the blocks from the code)\n");
+	printf("    -E: embed the code pages and symbols used in the trace; so it can be analysed without the binaries\n");
+	printf("    -m: write the tracefile through mmap; rather than stdio\n");
+	printf("    -d: if the live consumer falls behind drop chunks (and say so) rather than wait for it\n");
+	printf("    -z: number of threads compressing the trace; 0 to not compress (default %d)\n", kDefaultCompressThreads);
+	printf("    -r: flight recorder; only keep the last megabytes of trace in memory and write it out when\n");
+	printf("        the target crashes, flow gets SIGUSR2 or -t's pc is run\n");
+	printf("    -t: trigger when the target runs this (hex) address\n");
+	printf("    -S: start a new tracefile (tracefile.1, tracefile.2 ...) every megabytes\n");
+	printf("    -T: or every seconds\n");
 	printf("    -a: attach to pid\n");
 	printf("    -s: launch using springboard\n");
 	printf("    -e: log from entrypoint; rather than process start (in dyld)\n");
@@ -26,15 +26,184 @@ from macholib import MachO
 import subprocess
 import struct	
 import os
+import bisect
+import heapq
+import socket
+import sys
+import ctypes
+import array
+import itertools
+import multiprocessing
+from cStringIO import StringIO
 
 
 class TraceBlock:
-	def __init__(self, landed, fc, fcType):
+	def __init__(self, landed, fc, fcType, seq = 0):
 		self.landed = landed
 		self.fc = fc
 		self.fcType = fcType
+		self.seq = seq # its place in the whole trace; across all the threads
 		self.timeline = []
 	
+	
+class CallTree:
+	'''A calling context tree; a node for each different path of calls, with how often it
+	was called and the blocks run in it.  The nodes are an arena of arrays, indexed by 
+	node; node 0 is the root (whatever ran before the first call)'''
+	def __init__(self):
+		self.address = array.array("L", [0]) # the function; where the block after the call landed
+		self.parent = array.array("i", [-1])
+		self.firstChild = array.array("i", [-1])
+		self.nextSibling = array.array("i", [-1])
+		self.calls = array.array("L", [0])
+		self.blocks = array.array("L", [0]) # run in this node; not in the ones it called
+		
+	def __len__(self):
+		return len(self.address)
+		
+	def child(self, node, address):
+		# the node for node calling address; added the first time
+		child = self.firstChild[node]
+		while child != -1 and self.address[child] != address:
+			child = self.nextSibling[child]
+		if child == -1:
+			child = self.add(node, address)
+			self.nextSibling[child] = self.firstChild[node]
+			self.firstChild[node] = child
+		return child
+		
+	def add(self, parent, address):
+		# a new node; child links it in to its parent's children
+		retVal = len(self.address)
+		self.address.append(address)
+		self.parent.append(parent)
+		self.firstChild.append(-1)
+		self.nextSibling.append(-1)
+		self.calls.append(0)
+		self.blocks.append(0)
+		return retVal
+		
+	def children(self, node):
+		# in the order they were first called
+		retVal = []
+		child = self.firstChild[node]
+		while child != -1:
+			retVal.append(child)
+			child = self.nextSibling[child]
+		retVal.reverse()
+		return retVal
+		
+	def totalBlocks(self):
+		# for every node, the blocks run in it and everything it called; a child is always
+		# added after its parent so one pass from the end does it
+		retVal = array.array("L", self.blocks)
+		for node in xrange(len(self.address)-1, 0, -1):
+			retVal[self.parent[node]] += retVal[node]
+		return retVal
+	
+	
+class TraceThread:
+	def __init__(self, id, timeline = False):
+		self.id = id
+		self.tree = CallTree()
+		self.node = 0 # where we are in the tree
+		self.calling = False # the last block was a call; the next one is in a new node
+		self.timeline = [] # only with timeline; a TraceBlock per block
+		self.keepTimeline = timeline
+		self.parseStack = [self]
+		self.seq = 0 # of the next block
+		
+	def addLFCPair(self, landed, fc, fcType):
+		tree = self.tree
+		if self.calling:
+			self.node = tree.child(self.node, landed)
+			tree.calls[self.node] += 1
+			self.calling = False
+		tree.blocks[self.node] += 1
+		if fcType == 0x1:
+			# call
+			self.calling = True
+		elif fcType == 0x2 and self.node != 0:
+			# ret
+			self.node = tree.parent[self.node]
+			
+		if self.keepTimeline:
+			tb = TraceBlock(landed, fc, fcType, self.seq)
+			self.parseStack[-1].timeline.append(tb)
+			if fcType == 0x1:
+				self.parseStack.append(tb)
+			elif fcType == 0x2:
+				if len(self.parseStack) != 1:
+					self.parseStack.pop()
+		self.seq += 1
+		
+	def merge(self, chunk):
+		# adds a ChunkThread's tree (our next chunk, decoded on its own) from where we are now;
+		# its nodes are added in the order they were made, so ours are too
+		tree = self.tree
+		part = chunk.tree
+		start = self.node
+		if self.calling and chunk.first != None:
+			# the chunk starts in the function our last block called
+			start = tree.child(start, chunk.first)
+			tree.calls[start] += 1
+		nodes = array.array("i", [0]) * len(part)
+		for n in xrange(len(part)):
+			if part.parent[n] != -1:
+				nodes[n] = tree.child(nodes[part.parent[n]], part.address[n])
+			elif n == 0:
+				nodes[n] = start
+			else:
+				# returned above where the chunk started; the root stays the root
+				nodes[n] = max(tree.parent[nodes[chunk.above[part.address[n]-1]]], 0)
+			tree.calls[nodes[n]] += part.calls[n]
+			tree.blocks[nodes[n]] += part.blocks[n]
+		if chunk.first != None:
+			self.node = nodes[chunk.node]
+			self.calling = chunk.calling
+		self.seq = chunk.seq
+				
+	def blocks(self):
+		# every block in the order it ran; only with timeline
+		stack = [iter(self.timeline)]
+		while stack:
+			for b in stack[-1]:
+				yield b
+				stack.append(iter(b.timeline))
+				break
+			else:
+				stack.pop()
+	
+		
+class ChunkThread(TraceThread):
+	'''One chunk of a thread, decoded without the chunks before it (FlowChunkDecoder); so its 
+	tree starts (node 0) wherever the thread was.  A ret from there goes to a node of its own, 
+	with the number of levels up as its address.  TraceThread.merge adds it to the thread's'''
+	def __init__(self, id):
+		TraceThread.__init__(self, id)
+		self.above = [0] # the node for each level above where we started
+		self.first = None # the first block's landed; the function it's in if the last chunk ended on a call
+		
+	def addLFCPair(self, landed, fc, fcType):
+		tree = self.tree
+		if self.first == None:
+			self.first = landed
+		if self.calling:
+			self.node = tree.child(self.node, landed)
+			tree.calls[self.node] += 1
+			self.calling = False
+		tree.blocks[self.node] += 1
+		if fcType == 0x1:
+			self.calling = True
+		elif fcType == 0x2 and tree.parent[self.node] != -1:
+			self.node = tree.parent[self.node]
+		elif fcType == 0x2:
+			level = tree.address[self.node]+1
+			if level == len(self.above):
+				self.above.append(tree.add(-1, level))
+			self.node = self.above[level]
+		self.seq += 1
+	
 		
 class TraceArch:
 	def __init__(self, root, cpuType):
@@ -43,15 +212,33 @@ class TraceArch:
 	
 
 class TraceLibrary:
-	def __init__(self, arch, path, baseAddr):
+	def __init__(self, arch, path, baseAddr, embedded = False):
 		self.arch = arch
 		self.path = path
 		self.baseAddr = baseAddr
+		self.endAddr = baseAddr
 		self.defaultBaseAddr = 0
 		self.macho = None
 		self.sections = {}
 		self.symbols = {}
-		fullPath = os.path.join(self.arch.root, path)
+		self.symbolOffsets = None # sorted; built the first time we look for the nearest symbol
+		self.symbolCache = None # a SymbolCache; used rather than symbols if we have the native library
+		self.fullPath = os.path.join(self.arch.root, path)
+		if not embedded:
+			self._readBinary()
+		
+	def _readBinary(self):
+		self.symbolCache = SymbolCache.open(self.fullPath, self.arch.cpuType)
+		if self.symbolCache:
+			# the sections are only needed to read code; we get those when we do
+			self.defaultBaseAddr = self.symbolCache.base
+			self.endAddr = self.baseAddr+self.symbolCache.size
+		else:
+			self._readMachO()
+			self._readSymbols()
+		
+	def _readMachO(self):
+		fullPath = self.fullPath
 		macho = MachO.MachO(fullPath)
 		for h in macho.headers:
 			if h.header.cputype == self.arch.cpuType:
@@ -70,7 +257,10 @@ class TraceLibrary:
 								self.sections[section.addr] = section
 				self.endAddr = self.baseAddr+endAddr
 				#print "%s: %x - %x" % (self.path, self.baseAddr, self.endAddr)
-		# get the symbols (not the best way)
+				
+	def _readSymbols(self):
+		# get the symbols (not the best way); without the native library
+		fullPath = self.fullPath
 		if self.arch.cpuType & 0x01000000:
 			arch = "x86_64" # out version doesn't have the 64bit support
 		else:
@@ -83,107 +273,905 @@ class TraceLibrary:
 				if parts[0][:2] == "0x":
 					offset = int(parts[0][2:], 16)-self.defaultBaseAddr
 					self.symbols[offset] = parts[2].strip()
+					
+	def setEmbedded(self, size, symbols):
+		# symbols and size from the log (eTraceLogRecord_imageSymbols); rather than the binary
+		self.endAddr = self.baseAddr+size
+		self.symbols = symbols
+		self.symbolOffsets = None
+		self.symbolCache = None
 
 			
 	def resolveSymbol(self, offset):
 		retVal = None
-		if offset in self.symbols:	
+		if self.symbolCache:
+			symbol, delta = self.symbolCache.nearest(offset)
+			if delta == 0:
+				retVal = symbol
+		elif offset in self.symbols:	
 			retVal = self.symbols[offset]
 		return retVal
+		
+	def nearestSymbol(self, offset):
+		# (symbol, offset into it) for the last symbol at or before offset; (None, offset) if none
+		if self.symbolCache:
+			return self.symbolCache.nearest(offset)
+		if self.symbolOffsets == None:
+			self.symbolOffsets = sorted(self.symbols)
+		retVal = (None, offset)
+		i = bisect.bisect_right(self.symbolOffsets, offset)-1
+		if i >= 0:
+			start = self.symbolOffsets[i]
+			retVal = (self.symbols[start], offset-start)
+		return retVal
+		
+	def readCode(self, offset, size):
+		retVal = ""
+		if self.macho == None and self.symbolCache:
+			self._readMachO()
+		addr = offset+self.defaultBaseAddr
+		for section in self.sections.values():
+			if addr >= section.addr and addr < (section.addr+section.size):
+				size = min(size, section.addr+section.size-addr)
+				f = file(self.fullPath, "rb")
+				f.seek(self.macho.offset+section.offset+(addr-section.addr))
+				retVal = f.read(size)
+				f.close()
+				break
+		return retVal
 			
 						
 class TraceProcess:
-	def __init__(self, arch):
+	PAGE_SIZE = 4096
+	
+	def __init__(self, arch, embedded = False, timeline = False):
 		self.arch = arch	
-		self.timeline = []
+		self.embedded = embedded # the log has the code pages and symbols in it
+		self.timeline = timeline # keep every block (TraceThread.timeline); not just the call tree
 		self.libraries = {}
-		self.parseStack = [self]
+		self.bases = [] # the libraries' baseAddrs, sorted; they don't overlap
+		self.resolved = {} # address -> (library, symbol, offset); cleared when the libraries change
+		self.threads = {} # thread id -> TraceThread
+		self.thread = None # the one we're adding blocks to
+		self.pages = {} # page address -> hash of its contents
+		self.pageData = {} # hash -> page contents
 		
 	def addLibrary(self, path, baseAddr):
 		#print "%x - %s" %  (baseAddr, path)
-		self.libraries[baseAddr] = TraceLibrary(self.arch, path, baseAddr)
+		if baseAddr not in self.libraries:
+			bisect.insort(self.bases, baseAddr)
+		self.libraries[baseAddr] = TraceLibrary(self.arch, path, baseAddr, self.embedded)
+		self.resolved = {}
 		
 	def removeLibrary(self, baseAddr):
-		del self.libraries[baseAddr]
+		# a flight recorder dump can start after the image was added
+		if self.libraries.pop(baseAddr, None):
+			del self.bases[bisect.bisect_left(self.bases, baseAddr)]
+			self.resolved = {}
+			
+	def setEmbedded(self, baseAddr, size, symbols):
+		if baseAddr in self.libraries:
+			self.libraries[baseAddr].setEmbedded(size, symbols)
+			self.resolved = {}
+		
+	def setThread(self, id, seq):
+		if id not in self.threads:
+			self.threads[id] = TraceThread(id, self.timeline)
+		self.thread = self.threads[id]
+		self.thread.seq = seq
 		
 	def addLFCPair(self, landed, fc, fcType):
-		tb = TraceBlock(landed, fc, fcType)
-		self.parseStack[-1].timeline.append(tb)
-		if fcType == 0x1:
-			# call
-			self.parseStack.append(tb)
-		elif fcType == 0x2:
-			# ret
-			if len(self.parseStack) != 1:
-				self.parseStack.pop()
+		self.thread.addLFCPair(landed, fc, fcType)
+		
+	def blocks(self):
+		# every threads blocks, merged back into the order they ran; only with timeline
+		return heapq.merge(*[[(b.seq, b) for b in t.blocks()] for t in self.threads.values()])
 
+	def readCode(self, pc, size):
+		retVal = ""
+		page = pc & ~(TraceProcess.PAGE_SIZE-1)
+		if page in self.pages:
+			# embedded pages; carry on into the following pages while we have them
+			start = pc & (TraceProcess.PAGE_SIZE-1)
+			while len(retVal) < start+size and page in self.pages:
+				retVal += self.pageData[self.pages[page]]
+				page += TraceProcess.PAGE_SIZE
+			retVal = retVal[start:start+size]
+		else:
+			offset, lib = self.resolveLibrary(pc)
+			if lib:
+				retVal = lib.readCode(offset, size)
+		return retVal
+		
 	def resolveLibrary(self, pc):
 		offset = pc
 		library = None
-		for l in self.libraries.values():
-			if pc >= l.baseAddr and pc < l.endAddr:
+		i = bisect.bisect_right(self.bases, pc)-1
+		if i >= 0:
+			l = self.libraries[self.bases[i]]
+			if pc < l.endAddr:
 				offset = pc-l.baseAddr # get offset into library
 				library = l
-				break
 		return (offset, library)
 		
+	def resolveSymbol(self, pc):
+		# (library, symbol, offset); the symbol is the nearest one before pc and offset is from
+		# it; or from the library if there isn't one, or pc if there's no library
+		retVal = self.resolved.get(pc)
+		if retVal == None:
+			offset, lib = self.resolveLibrary(pc)
+			symbol = None
+			if lib:
+				symbol, offset = lib.nearestSymbol(offset)
+			retVal = (lib, symbol, offset)
+			self.resolved[pc] = retVal
+		return retVal
+		
 
+class TraceCode:
+	'''Finds the block starting at an address the same way Flow's findNextBranch does; this
+	duplicates BranchSearch_findNextBranch, so change both together'''
+	READ_AHEAD = 4096
+	
+	def __init__(self, process):
+		import distorm3 # only needed for branch format logs
+		self.distorm3 = distorm3
+		self.process = process
+		self.blocks = {}
+		self.dt = distorm3.Decode32Bits
+		if process.arch.cpuType & 0x01000000:
+			self.dt = distorm3.Decode64Bits
+		
+	def findNextBranch(self, pc):
+		# returns (landed, fc, fcType, next, target, conditional); target is None if indirect
+		block = self.blocks.get(pc)
+		if block == None:
+			code = self.process.readCode(pc, TraceCode.READ_AHEAD)
+			for inst in self.distorm3.Decompose(pc, code, self.dt):
+				if not inst.valid:
+					break
+				fc = inst.flowControl
+				if fc != "FC_NONE":
+					next = inst.address+inst.size
+					target = None
+					conditional = False
+					if (	fc in ("FC_CALL", "FC_UNC_BRANCH", "FC_CND_BRANCH")
+						and len(inst.operands) > 0 
+						and inst.operands[0].type == self.distorm3.OPERAND_IMMEDIATE):
+						target = inst.operands[0].value
+						conditional = fc == "FC_CND_BRANCH"
+					elif fc == "FC_SYS":
+						target = next # we always come back to the next instruction
+					fcType = {"FC_CALL": 1, "FC_RET": 2, "FC_SYS": 3}.get(fc, 0)
+					block = (pc, inst.address, fcType, next, target, conditional)
+					break
+			if block == None:
+				raise ValueError("unable to find branch at %x" % pc)
+			self.blocks[pc] = block
+		return block
+		
+		
+class FlowReaderBlock(ctypes.Structure):
+	_fields_ = [("landed", ctypes.c_uint64), ("fc", ctypes.c_uint64), ("seq", ctypes.c_uint64), 
+				("fcType", ctypes.c_uint32), ("reserved", ctypes.c_uint32)]
+	
+	
+class FlowReaderMeta(ctypes.Structure):
+	_fields_ = [("type", ctypes.c_uint32), ("reserved", ctypes.c_uint32), ("data", ctypes.c_void_p), 
+				("size", ctypes.c_uint64)]
+		
+		
+class FlowReader:
+	'''The native reader (Flow/FlowReader.h); decodes raw and dictionary chunks straight out of
+	the mapped log.  From libFlowReader.dylib, next to us or at $FLOWREADER'''
+	BATCH = 4096 # blocks per FlowReader_read
+	BLOCK = "QQQII" # FlowReaderBlock
+	lib = None
+	
+	@staticmethod
+	def load():
+		# the library; None if we can't load it
+		if FlowReader.lib == None:
+			path = os.environ.get("FLOWREADER", os.path.join(os.path.dirname(os.path.abspath(__file__)), "libFlowReader.dylib"))
+			try:
+				lib = ctypes.CDLL(path)
+			except OSError:
+				return None
+			lib.FlowReader_getSize.restype = ctypes.c_uint64
+			lib.FlowReader_getSize.argtypes = []
+			lib.FlowReader_open.restype = ctypes.c_bool
+			lib.FlowReader_open.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+			lib.FlowReader_startChunk.restype = ctypes.c_bool
+			lib.FlowReader_startChunk.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+			lib.FlowReader_read.restype = ctypes.c_uint32
+			lib.FlowReader_read.argtypes = [ctypes.c_void_p, ctypes.POINTER(FlowReaderBlock), ctypes.c_uint32, ctypes.POINTER(FlowReaderMeta)]
+			lib.FlowReader_close.restype = None
+			lib.FlowReader_close.argtypes = [ctypes.c_void_p]
+			lib.SymbolCache_getSize.restype = ctypes.c_uint64
+			lib.SymbolCache_getSize.argtypes = []
+			lib.SymbolCache_open.restype = ctypes.c_bool
+			lib.SymbolCache_open.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint32, ctypes.c_char_p]
+			lib.SymbolCache_getHeader.restype = ctypes.POINTER(SymbolCacheHeader)
+			lib.SymbolCache_getHeader.argtypes = [ctypes.c_void_p]
+			lib.SymbolCache_getSymbol.restype = ctypes.c_bool
+			lib.SymbolCache_getSymbol.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint64), ctypes.POINTER(ctypes.c_char_p)]
+			lib.SymbolCache_find.restype = ctypes.c_uint32
+			lib.SymbolCache_find.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+			lib.SymbolCache_close.restype = None
+			lib.SymbolCache_close.argtypes = [ctypes.c_void_p]
+			FlowReader.lib = lib
+		return FlowReader.lib
+		
+	@staticmethod
+	def open(filename):
+		# None if we can't load the library; the caller parses the log itself
+		if FlowReader.load() == None:
+			return None
+		retVal = FlowReader()
+		retVal.opened = FlowReader.lib.FlowReader_open(retVal.reader, filename)
+		if not retVal.opened:
+			retVal = None
+		return retVal
+	
+	def __init__(self):
+		self.reader = ctypes.create_string_buffer(FlowReader.lib.FlowReader_getSize())
+		self.blocks = (FlowReaderBlock * FlowReader.BATCH)()
+		self.meta = FlowReaderMeta()
+		self.opened = False
+		
+	def __del__(self):
+		if self.opened:
+			FlowReader.lib.FlowReader_close(self.reader)
+		
+	def records(self, offset):
+		# the records of the chunk at offset; (0, (seq, [(landed, fc, fcType)])) for a run of 
+		# blocks with consecutive sequence numbers, (type, data) for anything else
+		if not FlowReader.lib.FlowReader_startChunk(self.reader, offset):
+			raise ValueError("unable to read chunk at %u" % offset)
+		meta = ctypes.byref(self.meta)
+		while True:
+			n = FlowReader.lib.FlowReader_read(self.reader, self.blocks, FlowReader.BATCH, meta)
+			if n:
+				# unpacked in one go; its much quicker than a ctypes object per block
+				fields = struct.unpack_from(FlowReader.BLOCK * n, self.blocks)
+				yield (0, (fields[2], zip(fields[0::5], fields[1::5], fields[3::5])))
+			elif self.meta.type:
+				yield (self.meta.type, ctypes.string_at(self.meta.data, self.meta.size))
+			else:
+				break
+		
+		
+class SymbolCacheHeader(ctypes.Structure):
+	_fields_ = [("magic", ctypes.c_uint32), ("version", ctypes.c_uint32), ("format", ctypes.c_uint32), 
+				("cpuType", ctypes.c_uint32), ("mtime", ctypes.c_uint64), ("fileSize", ctypes.c_uint64), 
+				("uuid", ctypes.c_uint8 * 20), ("uuidSize", ctypes.c_uint32), ("base", ctypes.c_uint64), 
+				("size", ctypes.c_uint64), ("count", ctypes.c_uint32), ("pathSize", ctypes.c_uint32), 
+				("stringsSize", ctypes.c_uint64)]
+		
+		
+class SymbolCache:
+	'''An image's symbols from the native library (Flow/SymbolCache.h); the image is parsed once
+	and what's found cached in $FLOWSYMBOLS (~/.flow/symbols), which later runs just map in'''
+	NONE = 0xFFFFFFFF # kSymbolCacheNone
+	
+	@staticmethod
+	def open(path, cpuType):
+		# None if we can't load the library (or read the image); the caller uses macholib/otool
+		lib = FlowReader.load()
+		if lib == None:
+			return None
+		cacheDir = os.environ.get("FLOWSYMBOLS", os.path.expanduser(os.path.join("~", ".flow", "symbols")))
+		try:
+			os.makedirs(cacheDir)
+		except OSError:
+			pass # its already there; or we can't, and the symbols are just kept in memory
+		retVal = SymbolCache()
+		retVal.opened = lib.SymbolCache_open(retVal.cache, path, cpuType, cacheDir)
+		if retVal.opened:
+			header = lib.SymbolCache_getHeader(retVal.cache).contents
+			retVal.base = header.base
+			retVal.size = header.size
+		else:
+			retVal = None
+		return retVal
+		
+	def __init__(self):
+		self.cache = ctypes.create_string_buffer(FlowReader.lib.SymbolCache_getSize())
+		self.offset = ctypes.c_uint64()
+		self.name = ctypes.c_char_p()
+		self.opened = False
+		self.base = 0
+		self.size = 0
+		
+	def __del__(self):
+		if self.opened:
+			FlowReader.lib.SymbolCache_close(self.cache)
+			
+	def nearest(self, offset):
+		# (symbol, offset into it) for the last symbol at or before offset; (None, offset) if none
+		retVal = (None, offset)
+		i = FlowReader.lib.SymbolCache_find(self.cache, offset)
+		if i != SymbolCache.NONE:
+			FlowReader.lib.SymbolCache_getSymbol(self.cache, i, ctypes.byref(self.offset), ctypes.byref(self.name))
+			retVal = (self.name.value, offset-self.offset.value)
+		return retVal
+		
+		
 class FlowLog:
-	def __init__(self, filename, root):
-		self.log = file(filename, "rb")
+	MAGIC = 0x574F4C46 # 'FLOW'
+	
+	FORMAT_RAW = 0
+	FORMAT_DICTIONARY = 1
+	FORMAT_BRANCH = 2
+	
+	BRANCH_TARGET = 0x83
+	BRANCH_RESYNC = 0x84
+	BRANCH_END = 0x85
+	RETURN = 0x8B
+	RETURN_STACK_SIZE = 64 # kTraceLogReturnStackSize
+	FOLD = 0x8C
+	FOLD_WINDOW = 32 # kTraceLogFoldWindow
+	PATH_DEFINITION = 0x8D
+	IMAGE_NOTIFICATION = 0x8E
+	SYNC = 0x8F
+	
+	FLAG_EMBED_IMAGES = 0x1
+	
+	TRIGGER_CRASH = 1
+	TRIGGER_SIGNAL = 2
+	TRIGGER_REQUEST = 3
+	TRIGGER_PC = 4
+	
+	CHUNK_MAGIC = 0x4B4E4843 # 'CHNK'
+	FOOTER_MAGIC = 0x58444946 # 'FIDX'
+	CHUNK_HEADER = "IIQQQII" # magic, size, firstBlock, timestamp, thread, flags, rawSize
+	INDEX_ENTRY = "QQQQII" # offset, firstBlock, timestamp, thread, size, flags
+	FOOTER = "IIQ" # magic, count, indexOffset
+	CHUNK_FLAG_IMAGES = 0x1
+	CHUNK_FLAG_COMPRESSED = 0x2
+	CHUNK_FLAG_DROPPED = 0x4
+	
+	def __init__(self, filename, root, jobs = 1, timeline = False):
+		# filename can also be unix:path, fd:n or - (stdin); then we read the trace live.  With
+		# jobs > 1 raw and dict chunks are decoded by that many processes; unless we're keeping
+		# the timeline.  Each thread's blocks go into its call tree (TraceThread.tree); with 
+		# timeline they're all kept too
+		live, headerSize, cpuType = self._open(filename)
+		self.process = TraceProcess(TraceArch(root, cpuType), (self.flags & FlowLog.FLAG_EMBED_IMAGES) != 0, timeline)
+		if self.version >= 2 and live:
+			self._readLive(headerSize)
+		elif self.version >= 2:
+			self._readIndex(headerSize)
+			if jobs > 1 and self.format != FlowLog.FORMAT_BRANCH and not timeline:
+				self._parseParallel(filename, jobs)
+			else:
+				for chunk in self.index:
+					self.parseChunk(chunk)
+		elif self.reader:
+			self.process.setThread(0, 0)
+			self._parseNative(headerSize)
+		else:
+			self.process.setThread(0, 0)
+			self._parseRecords()
+			
+	def _open(self, filename):
+		# returns (live, headerSize, cpuType)
+		live = True
+		if filename.startswith("unix:"):
+			listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+			listener.bind(filename[5:])
+			listener.listen(1)
+			connection, addr = listener.accept()
+			self.log = connection.makefile("rb")
+			listener.close()
+			os.unlink(filename[5:])
+		elif filename.startswith("fd:"):
+			self.log = os.fdopen(int(filename[3:]), "rb")
+		elif filename == "-":
+			self.log = sys.stdin
+		else:
+			self.log = file(filename, "rb")
+			live = False
+		self.reader = None # a FlowReader if we can use the native library
+		self.format = FlowLog.FORMAT_RAW
+		self.version = 0
+		self.flags = 0
+		self.blocks = [] # dictionary format; (landed, fc, fcType) indexed by block id
+		self.code = None # branch format; shared by all the chunks
+		self.returnStack = [] # shadow call stack; raw and branch formats
+		self.returnTo = None
+		self.history = [] # the last FOLD_WINDOW blocks; raw and dictionary formats
+		self.index = [] # version 2; an INDEX_ENTRY tuple per chunk
+		self.triggers = [] # (reason, code, pc) for each time the flight recorder was triggered
+		self.paths = {} # image paths by id; for IMAGE_NOTIFICATION
+		self.drops = [] # (firstBlock, timestamp, chunks, bytes) for each run of chunks Flow dropped
 		cpuType, = struct.unpack("I", self.log.read(struct.calcsize("I")))
-		self.process = TraceProcess(TraceArch(root, cpuType))
-		self._parseFile()
+		headerSize = struct.calcsize("I")
+		if cpuType == FlowLog.MAGIC:
+			# new style header; old logs start directly with the cpuType
+			self.version, self.format, cpuType, self.flags = struct.unpack("HHII", self.log.read(struct.calcsize("HHII")))
+			headerSize += struct.calcsize("HHII")
+		if not live and self.format != FlowLog.FORMAT_BRANCH:
+			self.reader = FlowReader.open(filename)
+		return (live, headerSize, cpuType)
+			
+	def _readIndex(self, headerSize):
+		footerSize = struct.calcsize(FlowLog.FOOTER)
+		self.log.seek(0, os.SEEK_END)
+		fileSize = self.log.tell()
+		footer = (0, 0, 0)
+		if fileSize >= headerSize+footerSize:
+			self.log.seek(-footerSize, os.SEEK_END)
+			footer = struct.unpack(FlowLog.FOOTER, self.log.read(footerSize))
+		if footer[0] == FlowLog.FOOTER_MAGIC:
+			entrySize = struct.calcsize(FlowLog.INDEX_ENTRY)
+			self.log.seek(footer[2])
+			for i in xrange(0, footer[1]):
+				self.index.append(struct.unpack(FlowLog.INDEX_ENTRY, self.log.read(entrySize)))
+		else:
+			# no footer (Flow didn't exit cleanly); walk the chunk headers instead
+			chunkSize = struct.calcsize(FlowLog.CHUNK_HEADER)
+			offset = headerSize
+			while offset+chunkSize <= fileSize:
+				self.log.seek(offset)
+				magic, size, firstBlock, timestamp, thread, flags, rawSize = struct.unpack(FlowLog.CHUNK_HEADER, self.log.read(chunkSize))
+				if magic != FlowLog.CHUNK_MAGIC:
+					break
+				self.index.append((offset, firstBlock, timestamp, thread, size, flags))
+				offset += chunkSize+size
+		# each thread's chunks are in order; but they're interleaved with the other threads
+		self.threadChunks = {}
+		for i, c in enumerate(self.index):
+			self.threadChunks.setdefault(c[3], []).append(i)
+		self.chunkBlocks = dict((t, [self.index[i][1] for i in c]) for t, c in self.threadChunks.items())
+		self.chunkTimes = dict((t, [self.index[i][2] for i in c]) for t, c in self.threadChunks.items())
+				
+	def _readLive(self, offset):
+		# chunks as they arrive; we can't seek, so there's no looking at the index first
+		chunkSize = struct.calcsize(FlowLog.CHUNK_HEADER)
+		self.index = []
+		while True:
+			data = self.log.read(chunkSize)
+			if len(data) < chunkSize:
+				break
+			header = struct.unpack(FlowLog.CHUNK_HEADER, data)
+			magic, size, firstBlock, timestamp, thread, flags, rawSize = header
+			if magic != FlowLog.CHUNK_MAGIC:
+				break # the index; which we've just built ourselves
+			chunk = (offset, firstBlock, timestamp, thread, size, flags)
+			self.index.append(chunk)
+			self._parseChunkData(chunk, header, self.log.read(size))
+			offset += chunkSize+size
+			
+	def chunkForBlock(self, block, thread):
+		# the index of the thread's chunk holding the block with this sequence number
+		i = bisect.bisect_right(self.chunkBlocks[thread], block)-1
+		return self.threadChunks[thread][max(i, 0)]
+		
+	def chunkForTime(self, timestamp, thread):
+		# the index of the thread's chunk running at timestamp (mach_absolute_time)
+		i = bisect.bisect_right(self.chunkTimes[thread], timestamp)-1
+		return self.threadChunks[thread][max(i, 0)]
+		
+	def chunksForThread(self, thread):
+		return [i for i, c in enumerate(self.index) if c[3] == thread]
+		
+	def parseChunk(self, chunk):
+		# each chunk decodes on its own; but when seeking, parse the CHUNK_FLAG_IMAGES chunks 
+		# before it too, so the libraries are known
+		offset, firstBlock, timestamp, thread, size, flags = chunk
+		if self.reader and not flags & FlowLog.CHUNK_FLAG_DROPPED:
+			self.process.setThread(thread, firstBlock)
+			self._parseNative(offset)
+			return
+		log = self.log
+		log.seek(offset)
+		chunkSize = struct.calcsize(FlowLog.CHUNK_HEADER)
+		header = struct.unpack(FlowLog.CHUNK_HEADER, log.read(chunkSize))
+		self._parseChunkData(chunk, header, log.read(size))
+		
+	def _parseChunkData(self, chunk, header, data):
+		offset, firstBlock, timestamp, thread, size, flags = chunk
+		log = self.log
+		if flags & FlowLog.CHUNK_FLAG_DROPPED:
+			# Flow's live consumer (maybe us) fell behind; these chunks are missing
+			chunks, bytes = struct.unpack("QQ", data)
+			self.drops.append((firstBlock, timestamp, chunks, bytes))
+			return
+		if flags & FlowLog.CHUNK_FLAG_COMPRESSED:
+			data = FlowLog._decompress(data, header[6])
+		self.log = StringIO(data)
+		self.blocks = []
+		self.returnStack = []
+		self.returnTo = None
+		self.history = []
+		self.process.setThread(thread, firstBlock)
+		try:
+			self._parseRecords()
+		finally:
+			self.log = log
+		
+	def _parseNative(self, offset):
+		# the library decodes the blocks; we still do the meta records
+		self._addRecords(self.reader.records(offset))
+		
+	def _addRecords(self, records):
+		# (0, (seq, [(landed, fc, fcType)])) for a run of blocks, (type, data) for the rest
+		log = self.log
+		process = self.process
+		try:
+			for type, data in records:
+				if type == 0:
+					seq, blocks = data
+					process.thread.seq = seq
+					for landed, fc, fcType in blocks:
+						process.addLFCPair(landed, fc, fcType)
+				else:
+					self.log = StringIO(data)
+					self._parseMeta(type)
+		finally:
+			self.log = log
+			
+	def _parseParallel(self, filename, jobs):
+		# every chunk decodes on its own so workers decode them, each into a tree of its own; 
+		# we merge those and add the meta records, in chunk order
+		pool = multiprocessing.Pool(jobs)
+		try:
+			work = [(filename, chunk) for chunk in self.index]
+			for chunk, decoded in itertools.izip(self.index, pool.imap(_decodeChunk, work, 4)):
+				if decoded == None:
+					self.parseChunk(chunk) # not ours to decode; a dropped chunk marker
+				else:
+					thread, records = decoded
+					self.process.setThread(chunk[3], chunk[1])
+					self.process.thread.merge(thread)
+					self._addRecords(records)
+			pool.close()
+		finally:
+			pool.terminate()
+		
+	@staticmethod
+	def _decompress(data, rawSize):
+		# see TraceCompress.h; a token |llllmmmm|, literals, 16bit offset, match of m+4 bytes
+		src = bytearray(data)
+		out = bytearray()
+		i = 0
+		while i < len(src):
+			token = src[i]
+			i += 1
+			length = token >> 4
+			if length == 15:
+				b = 255
+				while b == 255:
+					b = src[i]
+					i += 1
+					length += b
+			out += src[i:i+length]
+			i += length
+			if i >= len(src):
+				break # last sequence; just literals
+			offset = src[i] | (src[i+1] << 8)
+			i += 2
+			length = token & 0xF
+			if length == 15:
+				b = 255
+				while b == 255:
+					b = src[i]
+					i += 1
+					length += b
+			length += 4
+			start = len(out)-offset
+			if offset >= length:
+				out += out[start:start+length]
+			else:
+				for j in xrange(length):
+					out.append(out[start+j])
+		if len(out) != rawSize:
+			raise ValueError("chunk decompressed to %u bytes; expected %u" % (len(out), rawSize))
+		return str(out)
+		
+	def _parseRecords(self):
+		if self.format == FlowLog.FORMAT_BRANCH:
+			self._parseBranchFile()
+		else:
+			self._parseFile()
+		
+	def _readBlock(self, type, landed = None):
+		# landed, next flow control pair
+		if landed == None:
+			landed, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+		fcType = type & 0x60
+		fc = landed + (type & 0x1F)
+		if (type & 0x1F) == 0x1F:
+			fc, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+		return (landed, fc, fcType >> 5)
+		
+	def _addBlock(self, landed, fc, fcType):
+		self.process.addLFCPair(landed, fc, fcType)
+		self.history.append((landed, fc, fcType))
+		if len(self.history) > FlowLog.FOLD_WINDOW:
+			del self.history[0]
+		if self.format == FlowLog.FORMAT_RAW:
+			self._updateReturns(fcType, fc)
+		
+	def _updateReturns(self, fcType, address):
+		# the same shadow stack as the writer; calls push, rets pop where we expect to go
+		self.returnTo = None
+		if fcType == 0x1:
+			self.returnStack.append(address)
+			if len(self.returnStack) > FlowLog.RETURN_STACK_SIZE:
+				del self.returnStack[0]
+		elif fcType == 0x2 and self.returnStack:
+			self.returnTo = self.returnStack.pop()
+		
+	def _readVarint(self):
+		type, = struct.unpack("B", self.log.read(struct.calcsize("B")))
+		return self._readBlockId(type)
+		
+	def _readBlockId(self, type):
+		# first byte holds 6 bits (bit 6 is the continuation), the rest hold 7
+		id = type & 0x3F
+		shift = 6
+		more = type & 0x40
+		while more:
+			b, = struct.unpack("B", self.log.read(struct.calcsize("B")))
+			id |= (b & 0x7F) << shift
+			shift += 7
+			more = b & 0x80
+		return id
 		
 	def _parseFile(self):
 		try:
 			while True:
 				type, = struct.unpack("B", self.log.read(struct.calcsize("B")))
 				if (type & 0x80) == 0:
-					# landed, next flow control pair
-					landed, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
-					fcType = type & 0x60
-					fc = landed + (type & 0x1F)
-					if (type & 0x1F) == 0x1F:
-						fc, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
-					self.process.addLFCPair(landed, fc, fcType >> 5)
+					if self.format == FlowLog.FORMAT_DICTIONARY:
+						self._addBlock(*self.blocks[self._readBlockId(type)])
+					else:
+						self._addBlock(*self._readBlock(type))
+				elif type == FlowLog.RETURN:
+					# raw format; landed where the last ret should have, after the call (fc) 
+					length, type = struct.unpack("BB", self.log.read(struct.calcsize("BB")))
+					self._addBlock(*self._readBlock(type, self.returnTo+length))
+				elif type == FlowLog.FOLD:
+					# repeat the previous period blocks count times
+					period = self._readVarint()
+					count = self._readVarint()
+					pattern = self.history[-period:]
+					for i in xrange(count):
+						for block in pattern:
+							self._addBlock(*block)
+				elif type == 0x82:
+					# block definition; gets the next id and also counts as executed
+					type, = struct.unpack("B", self.log.read(struct.calcsize("B")))
+					block = self._readBlock(type)
+					self.blocks.append(block)
+					self._addBlock(*block)
 				else:
-					if type == 0x81:
-						mode, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
-						infoCount, = struct.unpack("I", self.log.read(struct.calcsize("I")))
-						for i in xrange(0, infoCount):
-							baseAddr, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
-							strlen, = struct.unpack("H", self.log.read(struct.calcsize("H")))
-							path = self.log.read(strlen) # drop the null at the end
-							if mode == 0:
-								self.process.addLibrary(path, baseAddr)
-							else:
-								self.process.removeLibrary(baseAddr)
-					elif type == 0x80:
-						dyldAddr, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
-						self.process.addLibrary("/usr/lib/dyld", dyldAddr)						
+					self._parseMeta(type)
 		except struct.error:
 			pass
+			
+	def _parseMeta(self, type):
+		if type == 0x81:
+			# library notification; older logs, paths written out in full
+			mode, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+			infoCount, = struct.unpack("I", self.log.read(struct.calcsize("I")))
+			images = []
+			for i in xrange(0, infoCount):
+				baseAddr, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+				strlen, = struct.unpack("H", self.log.read(struct.calcsize("H")))
+				images.append((baseAddr, self.log.read(strlen))) # drop the null at the end
+			self._imageNotification(mode, images)
+		elif type == FlowLog.IMAGE_NOTIFICATION:
+			# library notification; paths by id
+			mode = self._readVarint()
+			images = []
+			for i in xrange(0, self._readVarint()):
+				baseAddr, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+				images.append((baseAddr, self.paths.get(self._readVarint())))
+			self._imageNotification(mode, images)
+		elif type == FlowLog.PATH_DEFINITION:
+			id = self._readVarint()
+			self.paths[id] = self.log.read(self._readVarint())
+		elif type == 0x80:
+			dyldAddr, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+			self.process.addLibrary("/usr/lib/dyld", dyldAddr)
+		elif type == 0x86:
+			# image symbols; so we don't need the binary
+			baseAddr, size = struct.unpack("QQ", self.log.read(struct.calcsize("QQ")))
+			uuid = self.log.read(16)
+			symbols = {}
+			offset = 0
+			for i in xrange(0, self._readVarint()):
+				offset += self._readVarint()
+				symbols[offset] = self.log.read(self._readVarint())
+			self.process.setEmbedded(baseAddr, size, symbols)
+		elif type == 0x87:
+			# code page contents
+			hash, size = struct.unpack("QI", self.log.read(struct.calcsize("QI")))
+			self.process.pageData[hash] = self.log.read(size)
+		elif type == 0x88:
+			# where a code page was seen
+			page, hash = struct.unpack("QQ", self.log.read(struct.calcsize("QQ")))
+			self.process.pages[page] = hash
+		elif type == 0x8A:
+			# another thread ran; this is the sequence number of our next block
+			self.process.thread.seq = self._readVarint()
+		elif type == FlowLog.SYNC:
+			# the start of a thread's chunk; how deep in calls it was.  We pick up where its last
+			# chunk left off (TraceThread.merge when they're decoded apart) so we don't need it
+			self._readVarint()
+		elif type == 0x89:
+			# trigger; reason is one of TRIGGER_*
+			self.triggers.append(struct.unpack("=BIQ", self.log.read(struct.calcsize("=BIQ"))))
+		else:
+			raise ValueError("unknown record type: %x" % type)
+			
+	def _imageNotification(self, mode, images):
+		for baseAddr, path in images:
+			if mode == 0:
+				self.process.addLibrary(path, baseAddr)
+			else:
+				self.process.removeLibrary(baseAddr)
+		if mode != 0:
+			# the writer recaptures any pages used after an unload
+			self.process.pages = {}
+			
+	def _readBranchRecord(self):
+		# returns the next non meta record; ("bits", [outcomes]), (BRANCH_TARGET, addr), 
+		# (BRANCH_RESYNC, silent, addr) or (BRANCH_END, silent).  None at the end of the file
+		if self.pendingRecord:
+			retVal = self.pendingRecord
+			self.pendingRecord = None
+			return retVal
+		while True:
+			data = self.log.read(struct.calcsize("B"))
+			if len(data) == 0:
+				return None
+			type, = struct.unpack("B", data)
+			if (type & 0x80) == 0:
+				# |0sxxxxxx| s is the stop bit, oldest outcome in bit 0
+				bits = []
+				while type != 1:
+					bits.append(type & 1)
+					type >>= 1
+				return ("bits", bits)
+			elif type == FlowLog.BRANCH_TARGET:
+				addr, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+				return (type, addr)
+			elif type == FlowLog.BRANCH_RESYNC:
+				silent = self._readVarint()
+				addr, = struct.unpack("Q", self.log.read(struct.calcsize("Q")))
+				return (type, silent, addr)
+			elif type == FlowLog.BRANCH_END:
+				return (type, self._readVarint())
+			elif type == FlowLog.RETURN:
+				return (type,)
+			else:
+				self._parseMeta(type)
+				
+	def _parseBranchFile(self):
+		# only branch outcomes are in the log; rebuild the blocks by decoding the code
+		if self.code == None:
+			self.code = TraceCode(self.process)
+		code = self.code
+		self.pendingRecord = None
+		bits = []
+		silent = 0 # direct branches followed since the last record/bit
+		try:
+			rec = self._readBranchRecord()
+			while rec and rec[0] in (FlowLog.BRANCH_TARGET, FlowLog.BRANCH_RESYNC):
+				pc = rec[-1]
+				rec = None
+				while True:
+					landed, fc, fcType, next, target, conditional = code.findNextBranch(pc)
+					self.process.addLFCPair(landed, fc, fcType)
+					self._updateReturns(fcType, next)
+					
+					# now work out where that branch went
+					if len(bits) == 0:
+						rec = self._readBranchRecord()
+						if rec == None:
+							break # truncated log
+						elif rec[0] in (FlowLog.BRANCH_RESYNC, FlowLog.BRANCH_END) and rec[1] == silent:
+							break
+						elif target == None:
+							if rec[0] == FlowLog.RETURN and self.returnTo != None:
+								rec = (FlowLog.BRANCH_TARGET, self.returnTo)
+							if rec[0] != FlowLog.BRANCH_TARGET:
+								raise ValueError("expected branch target at %x" % fc)
+							break
+						elif conditional:
+							if rec[0] != "bits":
+								raise ValueError("expected taken bits at %x" % fc)
+							bits = rec[1]
+						else:
+							self.pendingRecord = rec # not for us; we're direct
+						rec = None
+							
+					if conditional:
+						taken = bits.pop(0)
+						silent = 0
+						pc = next
+						if taken:
+							pc = target
+					else:
+						silent += 1
+						pc = target
+				silent = 0
+				if rec and rec[0] == FlowLog.BRANCH_END:
+					# a thread switch; the stream carries on from a new target
+					rec = self._readBranchRecord()
+		except struct.error:
+			pass
+		
+		
+class TraceRecorder(TraceProcess):
+	'''Stands in for the TraceProcess in a FlowChunkDecoder; the blocks go into a ChunkThread
+	and the meta records are kept for FlowLog._addRecords'''
+	def __init__(self):
+		TraceProcess.__init__(self, TraceArch(None, 0), True)
+		self.records = []
+		
+	def setThread(self, id, seq):
+		self.thread = ChunkThread(id)
+		self.thread.seq = seq
+		
+		
+class FlowChunkDecoder(FlowLog):
+	'''Decodes chunks for FlowLog(jobs > 1) in a worker process; it returns the chunk's 
+	ChunkThread and meta records for FlowLog._parseParallel to add in order'''
+	SEQUENCE = 0x8A
+	
+	def __init__(self, filename):
+		self.filename = filename
+		self._open(filename)
+		
+	def decode(self, chunk):
+		# None if its a CHUNK_FLAG_DROPPED marker; the parent does those
+		if chunk[5] & FlowLog.CHUNK_FLAG_DROPPED:
+			return None
+		self.process = TraceRecorder()
+		self.parseChunk(chunk)
+		return (self.process.thread, self.process.records)
+		
+	def _parseMeta(self, type):
+		start = self.log.tell()
+		FlowLog._parseMeta(self, type)
+		if type not in (FlowChunkDecoder.SEQUENCE, FlowLog.SYNC):
+			# the ChunkThread has the sequence numbers; and merges without the SYNC
+			end = self.log.tell()
+			self.log.seek(start)
+			self.process.records.append((type, self.log.read(end-start)))
+			
+			
+_chunkDecoder = None # each worker process's
+def _decodeChunk(args):
+	# a multiprocessing.Pool worker for FlowLog._parseParallel
+	global _chunkDecoder
+	filename, chunk = args
+	if _chunkDecoder == None or _chunkDecoder.filename != filename:
+		_chunkDecoder = FlowChunkDecoder(filename)
+	return _chunkDecoder.decode(chunk)
 		
 		
 if __name__ == "__main__":
 	import sys
-	import difflib
 	
 	if len(sys.argv) != 3:
 		print "Usage: FlowView.py <sdk-root> <log1>"
 		sys.exit(0)
 	
-	f1 = FlowLog(sys.argv[2], sys.argv[1])
+	f1 = FlowLog(sys.argv[2], sys.argv[1], multiprocessing.cpu_count())
 	
 
 	def addrStr(addr):
-		offset, lib = f1.process.resolveLibrary(addr)
+		lib, symbol, offset = f1.process.resolveSymbol(addr)
 		name = '%x !' % offset
-		if lib:
-			symbol = lib.resolveSymbol(offset)
-			
-		if lib and symbol:
+		if lib and symbol and offset:
+			name = '%s::%s+%x' % (lib.path, symbol, offset)
+		elif lib and symbol:
 			name = '%s::%s' % (lib.path, symbol)
 		elif lib:
 			name = '%s:%x' % (lib.path, offset)		
@@ -214,29 +1202,24 @@ if __name__ == "__main__":
 			outputStr(target, lib, padding+'│')
 	'''
 
-	def outputBlock(block, idx, target, padding = ''):
-		offset, lib = f1.process.resolveLibrary(block.fc)
-		if idx == 0 or lib == None or (lib != None and lib.resolveSymbol(offset)):
-			if idx == 0:
-				outputStr(target, lib, padding+'├┬ '+addrStr(block.landed))
-			else:
-				outputStr(target, lib, padding+'├ '+addrStr(block.landed))
-
-		if block.fcType == 3: # syscall
-			outputStr(target, lib, padding+'├─ #')
-			
-		if len(block.timeline) > 0:
-			i = 0
-			for b in block.timeline:
-				outputBlock(b, i, target, padding+'│')
-				i += 1
+	def outputNode(tree, node, totals, target, padding = ''):
+		# a line per node of the call tree; without recursing as they can get deep
+		stack = [(node, padding)]
+		while stack:
+			node, padding = stack.pop()
+			offset, lib = f1.process.resolveLibrary(tree.address[node])
+			outputStr(target, lib, padding+'├┬ %s (%u calls, %u blocks, %u in total)' % (addrStr(tree.address[node]), tree.calls[node], tree.blocks[node], totals[node]))
+			for child in reversed(tree.children(node)):
+				stack.append((child, padding+'│'))
 		
 	
 	def outputProcess(process, target = None):
-		i = 0
-		for b in process.timeline:
-			outputBlock(b, i, target)
-			i += 1
+		for thread in sorted(process.threads.values(), key = lambda t: t.id):
+			tree = thread.tree
+			totals = tree.totalBlocks()
+			print "thread %x (%u blocks, %u call paths)" % (thread.id, totals[0], len(tree)-1)
+			for node in tree.children(0):
+				outputNode(tree, node, totals, target)
 			
 	
 	outputProcess(f1.process, "/usr/bin/bc")